@@ -0,0 +1,133 @@
+#include "Benchmarks.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+
+#include <windows.h>
+
+#include "../ProjectDefines.h"
+#include "../ECS/ecsAllocator.h"
+
+BenchArgs::BenchArgs(const std::vector<std::string>& args) :
+	m_Args(args)
+{
+}
+
+uint32_t BenchArgs::GetUInt(size_t nIndex, uint32_t nDefault) const
+{
+	return nIndex < m_Args.size() ? static_cast<uint32_t>(strtoul(m_Args[nIndex].c_str(), nullptr, 10)) : nDefault;
+}
+
+float BenchArgs::GetFloat(size_t nIndex, float fDefault) const
+{
+	return nIndex < m_Args.size() ? strtof(m_Args[nIndex].c_str(), nullptr) : fDefault;
+}
+
+std::string BenchArgs::GetString(size_t nIndex, const std::string& strDefault) const
+{
+	return nIndex < m_Args.size() ? m_Args[nIndex] : strDefault;
+}
+
+BenchReport::BenchReport(const std::string& strLogPath) :
+	m_strLogPath(strLogPath)
+{
+}
+
+void BenchReport::Print(const char* szFormat, ...)
+{
+	char szLine[1024];
+	va_list args;
+	va_start(args, szFormat);
+	vsnprintf(szLine, sizeof(szLine), szFormat, args);
+	va_end(args);
+
+	OutputDebugStringA(szLine);
+
+	if (FILE* pFile = fopen(m_strLogPath.c_str(), "a"))
+	{
+		fputs(szLine, pFile);
+		fclose(pFile);
+	}
+}
+
+BenchTimer::BenchTimer() :
+	m_Start(std::chrono::steady_clock::now())
+{
+}
+
+void BenchTimer::Reset()
+{
+	m_Start = std::chrono::steady_clock::now();
+}
+
+double BenchTimer::GetElapsed() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_Start).count();
+}
+
+uint32_t GetBenchWorkerCount()
+{
+	return JOB_SYSTEM_WORKER_COUNT ? JOB_SYSTEM_WORKER_COUNT : std::thread::hardware_concurrency();
+}
+
+bool RunBenchmarkCommand(const std::string& strCmdLine, int& nExitCode)
+{
+	std::istringstream cmdLine(strCmdLine);
+	std::string strCommand;
+	cmdLine >> strCommand;
+	if (strCommand != "-bench")
+		return false;
+
+	std::string strName;
+	cmdLine >> strName;
+
+	bool bSystemHeap = false;
+	std::vector<std::string> args;
+	for (std::string strArg; cmdLine >> strArg; )
+	{
+		if (strArg == "-systemheap")
+			bSystemHeap = true;
+		else
+			args.push_back(strArg);
+	}
+
+	std::vector<Benchmark> benchmarks;
+	register_ecs_benchmarks(benchmarks);
+	register_entity_benchmarks(benchmarks);
+	register_script_benchmarks(benchmarks);
+
+	BenchReport report("bench.log");
+
+	auto benchmark = std::find_if(benchmarks.begin(), benchmarks.end(),
+		[&strName](const Benchmark& b) { return strName == b.szName; });
+	if (benchmark == benchmarks.end())
+	{
+		if (!strName.empty())
+			report.Print("No benchmark %s\n", strName.c_str());
+		for (const Benchmark& b : benchmarks)
+			report.Print("-bench %s %s\n", b.szName, b.szUsage);
+		nExitCode = strName.empty() ? 0 : 2;
+		return true;
+	}
+
+#ifdef ECS_POOL_ALLOCATOR
+	// Same flecs heap the game runs with, before any benchmark creates a world
+	if (!bSystemHeap)
+		EcsAllocator::Install();
+#endif
+
+	std::string strArgs;
+	for (const std::string& strArg : args)
+		strArgs += " " + strArg;
+	report.Print("== %s%s, flecs on %s heap\n", benchmark->szName, strArgs.c_str(),
+		EcsAllocator::IsInstalled() ? "pool" : "system");
+
+	benchmark->pRun(BenchArgs(args), report);
+
+	nExitCode = 0;
+	return true;
+}
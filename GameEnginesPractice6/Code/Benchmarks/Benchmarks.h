@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Positional arguments following the benchmark name, missing ones take defaults
+class BenchArgs
+{
+public:
+	BenchArgs(const std::vector<std::string>& args);
+
+	uint32_t GetUInt(size_t nIndex, uint32_t nDefault) const;
+	float GetFloat(size_t nIndex, float fDefault) const;
+	std::string GetString(size_t nIndex, const std::string& strDefault) const;
+
+private:
+	std::vector<std::string> m_Args;
+};
+
+// Result lines go to debugger output and are appended to a log file
+class BenchReport
+{
+public:
+	BenchReport(const std::string& strLogPath);
+
+	void Print(const char* szFormat, ...);
+
+private:
+	std::string m_strLogPath;
+};
+
+class BenchTimer
+{
+public:
+	BenchTimer();
+
+	void Reset();
+	// Milliseconds since construction or last Reset
+	double GetElapsed() const;
+
+private:
+	std::chrono::steady_clock::time_point m_Start;
+};
+
+// Job system workers the game runs with, see JOB_SYSTEM_WORKER_COUNT
+uint32_t GetBenchWorkerCount();
+
+typedef void (*TBenchmark)(const BenchArgs& args, BenchReport& report);
+
+struct Benchmark
+{
+	const char* szName;
+	// Arguments with their defaults, printed when listing
+	const char* szUsage;
+	TBenchmark pRun;
+};
+
+void register_ecs_benchmarks(std::vector<Benchmark>& benchmarks);
+void register_entity_benchmarks(std::vector<Benchmark>& benchmarks);
+void register_script_benchmarks(std::vector<Benchmark>& benchmarks);
+
+// -bench <name> [args]: runs a benchmark instead of starting the game, results are appended to bench.log.
+// -bench alone lists benchmarks. -systemheap anywhere leaves flecs on system heap even with ECS_POOL_ALLOCATOR.
+// Exit code is 0 if the benchmark ran, 2 if there is no benchmark of that name.
+bool RunBenchmarkCommand(const std::string& strCmdLine, int& nExitCode);
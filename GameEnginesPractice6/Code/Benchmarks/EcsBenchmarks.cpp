@@ -0,0 +1,667 @@
+#include "Benchmarks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+#include "../ProjectDefines.h"
+#include "../ECS/ecsPhys.h"
+#include "../ECS/ecsSpatial.h"
+#include "../ECS/ecsDeterminism.h"
+#include "../ECS/ecsGravity.h"
+#include "../ECS/ecsSnapshot.h"
+#include "../ECS/ecsAllocator.h"
+#include "../ECS/ecsLod.h"
+#include "../JobSystem/JobSystem.h"
+
+static const uint64_t BENCH_SEED = 12345;
+
+static Ogre::Vector3 RandomPoint(uint64_t nKey, uint64_t nIndex, float fExtent)
+{
+	return Ogre::Vector3(
+		CounterRng::Uniform(nKey, nIndex * 3, -fExtent, fExtent),
+		CounterRng::Uniform(nKey, nIndex * 3 + 1, -fExtent, fExtent),
+		CounterRng::Uniform(nKey, nIndex * 3 + 2, -fExtent, fExtent));
+}
+
+static Ogre::Vector3 RandomDirection(uint64_t nKey, uint64_t nIndex)
+{
+	Ogre::Vector3 vDirection = RandomPoint(nKey, nIndex, 1.0f);
+	return vDirection.isZeroLength() ? Ogre::Vector3::UNIT_X : vDirection.normalisedCopy();
+}
+
+// Same as SpatialIndexUpdate system
+static void UpdateSpatialIndex(flecs::query<const Position>& query, SpatialIndex& spatialIndex)
+{
+	query.iter([&](flecs::iter& it, const Position* positions)
+		{
+			const ecs_iter_t* pIter = it.c_ptr();
+			spatialIndex.UpdateTable(pIter->table, pIter->entities, positions, static_cast<uint32_t>(it.count()));
+		});
+	spatialIndex.EndUpdate();
+}
+
+// spatial [count] [queries] [moved%]: entities spread about one per cell. Update cost with
+// nothing moved and with moved% moving, against the per entity update every entity used to get,
+// then throughput of each query.
+static void RunSpatialBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = args.GetUInt(0, 1000000);
+	uint32_t nQueries = args.GetUInt(1, 100000);
+	float fMovedShare = args.GetFloat(2, 1.0f) * 0.01f;
+
+	const float fCellSize = SPATIAL_INDEX_CELL_SIZE;
+	float fExtent = 0.5f * fCellSize * std::cbrt(static_cast<float>(nCount));
+
+	flecs::world ecs;
+	ecs_bulk_new_w_id(ecs.c_ptr(), ecs.id<Position>(), static_cast<int32_t>(nCount));
+	flecs::query<Position> positionQuery = ecs.query<Position>();
+	flecs::query<const Position> spatialQuery = ecs.query<const Position>();
+	positionQuery.each([fExtent](flecs::entity e, Position& pos)
+		{
+			static_cast<Ogre::Vector3&>(pos) = RandomPoint(BENCH_SEED, static_cast<uint32_t>(e.id()), fExtent);
+		});
+
+	SpatialIndex spatialIndex(fCellSize);
+	BenchTimer timer;
+	UpdateSpatialIndex(spatialQuery, spatialIndex);
+	report.Print("%u entities, cell %.1f, world %.0f units wide: build %.2f ms\n",
+		spatialIndex.GetEntityCount(), fCellSize, 2.0f * fExtent, timer.GetElapsed());
+
+	timer.Reset();
+	UpdateSpatialIndex(spatialQuery, spatialIndex);
+	report.Print("Update, nothing moved: %.2f ms, %u moved\n", timer.GetElapsed(), spatialIndex.GetMovedCount());
+
+	uint32_t nMoveKey = 1;
+	positionQuery.each([&](flecs::entity e, Position& pos)
+		{
+			if (CounterRng::Uniform(nMoveKey, e.id(), 0.0f, 1.0f) < fMovedShare)
+				pos += RandomPoint(nMoveKey + 1, static_cast<uint32_t>(e.id()), fCellSize);
+		});
+	timer.Reset();
+	UpdateSpatialIndex(spatialQuery, spatialIndex);
+	report.Print("Update, %.1f%% moved: %.2f ms, %u moved\n", fMovedShare * 100.0f, timer.GetElapsed(), spatialIndex.GetMovedCount());
+
+	timer.Reset();
+	spatialQuery.each([&](flecs::entity e, const Position& pos)
+		{
+			spatialIndex.Update(e.id(), pos);
+		});
+	report.Print("Update of every entity: %.2f ms\n", timer.GetElapsed());
+
+	std::vector<Ogre::Vector3> centers(nQueries);
+	std::vector<Ogre::Vector3> directions(nQueries);
+	for (uint32_t i = 0; i < nQueries; ++i)
+	{
+		centers[i] = RandomPoint(BENCH_SEED + 1, i, fExtent);
+		directions[i] = RandomDirection(BENCH_SEED + 2, i);
+	}
+
+	std::vector<flecs::entity_t> entities;
+	size_t nFound = 0;
+	timer.Reset();
+	for (const Ogre::Vector3& vCenter : centers)
+	{
+		entities.clear();
+		spatialIndex.QueryRadius(vCenter, fCellSize, entities);
+		nFound += entities.size();
+	}
+	double fTime = timer.GetElapsed();
+	report.Print("QueryRadius r=%.1f: %.0f queries/s, %.2f hits per query\n",
+		fCellSize, nQueries / (fTime * 0.001), static_cast<double>(nFound) / nQueries);
+
+	std::vector<SpatialHit> hits;
+	nFound = 0;
+	timer.Reset();
+	for (const Ogre::Vector3& vCenter : centers)
+	{
+		hits.clear();
+		spatialIndex.QueryNearest(vCenter, 8, 4.0f * fCellSize, hits);
+		nFound += hits.size();
+	}
+	fTime = timer.GetElapsed();
+	report.Print("QueryNearest k=8: %.0f queries/s, %.2f hits per query\n",
+		nQueries / (fTime * 0.001), static_cast<double>(nFound) / nQueries);
+
+	nFound = 0;
+	timer.Reset();
+	for (uint32_t i = 0; i < nQueries; ++i)
+	{
+		SpatialHit hit;
+		nFound += spatialIndex.Raycast(centers[i], directions[i], 10.0f * fCellSize, 1.0f, hit) ? 1 : 0;
+	}
+	fTime = timer.GetElapsed();
+	report.Print("Raycast %.0f units, radius 1: %.0f queries/s, %.1f%% hit\n",
+		10.0f * fCellSize, nQueries / (fTime * 0.001), 100.0 * nFound / nQueries);
+}
+
+// Gaussian cluster, sigma 50, masses in [0.5, 2)
+static void RandomCluster(uint32_t nCount, std::vector<Ogre::Vector3>& positions, std::vector<float>& masses)
+{
+	positions.resize(nCount);
+	masses.resize(nCount);
+	for (uint32_t i = 0; i < nCount; ++i)
+	{
+		// Box-Muller, two uniforms per axis
+		for (int nAxis = 0; nAxis < 3; ++nAxis)
+		{
+			uint64_t nCounter = (static_cast<uint64_t>(i) * 3 + nAxis) * 2;
+			float u1 = CounterRng::Uniform(BENCH_SEED, nCounter, 1e-7f, 1.0f);
+			float u2 = CounterRng::Uniform(BENCH_SEED, nCounter + 1, 0.0f, 1.0f);
+			positions[i][nAxis] = 50.0f * std::sqrt(-2.0f * std::log(u1)) * std::cos(2.0f * Ogre::Math::PI * u2);
+		}
+		masses[i] = CounterRng::Uniform(BENCH_SEED + 1, i, 0.5f, 2.0f);
+	}
+}
+
+// Practice2 CelestialBody::UpdateVelocity style: every pair visited from both sides,
+// normalisedCopy and a division per pair. Softened like the solver, so results compare.
+static Ogre::Vector3 BruteForceAcceleration(size_t nBody, const std::vector<Ogre::Vector3>& positions,
+	const std::vector<float>& masses, float fGravConst, float fSoftening)
+{
+	Ogre::Vector3 vAcceleration = Ogre::Vector3::ZERO;
+	for (size_t j = 0; j < positions.size(); ++j)
+	{
+		if (j == nBody)
+			continue;
+
+		Ogre::Vector3 vDelta = positions[j] - positions[nBody];
+		float fDistanceSq = vDelta.squaredLength();
+		float fSoftenedSq = fDistanceSq + fSoftening * fSoftening;
+		vAcceleration += vDelta.normalisedCopy() * (fGravConst * masses[j] * std::sqrt(fDistanceSq) / (fSoftenedSq * std::sqrt(fSoftenedSq)));
+	}
+	return vAcceleration;
+}
+
+// Mean and max of |a - reference| / |reference| over sampled bodies
+static void AccelerationError(const std::vector<Ogre::Vector3>& accelerations, const std::vector<Ogre::Vector3>& reference,
+	const std::vector<uint32_t>& samples, double& fMean, double& fMax)
+{
+	fMean = 0.0;
+	fMax = 0.0;
+	for (size_t i = 0; i < samples.size(); ++i)
+	{
+		double fError = (accelerations[samples[i]] - reference[i]).length() / std::max(reference[i].length(), 1e-30f);
+		fMean += fError;
+		fMax = std::max(fMax, fError);
+	}
+	fMean /= std::max<size_t>(samples.size(), 1);
+}
+
+// nbody [count] [samples] [exact limit]: Barnes-Hut at several opening angles and the tiled
+// exact kernel against brute force. Brute force runs for sampled bodies only and its time
+// per step is extrapolated, the exact kernel only up to exact limit bodies.
+static void RunNBodyBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = std::max(args.GetUInt(0, 100000), 2u);
+	uint32_t nSampleCount = std::min(args.GetUInt(1, 1000), nCount);
+	uint32_t nExactLimit = args.GetUInt(2, 100000);
+
+	uint32_t nWorkerCount = GetBenchWorkerCount();
+	JobSystem jobSystem(nWorkerCount);
+	flecs::world ecs;
+	NBodySolver solver(&ecs, nWorkerCount);
+
+	std::vector<Ogre::Vector3> positions;
+	std::vector<float> masses;
+	RandomCluster(nCount, positions, masses);
+
+	std::vector<uint32_t> samples(nSampleCount);
+	for (uint32_t i = 0; i < nSampleCount; ++i)
+		samples[i] = static_cast<uint32_t>(static_cast<uint64_t>(i) * nCount / nSampleCount);
+
+	std::vector<Ogre::Vector3> reference(nSampleCount);
+	BenchTimer timer;
+	for (uint32_t i = 0; i < nSampleCount; ++i)
+		reference[i] = BruteForceAcceleration(samples[i], positions, masses, NBODY_GRAV_CONST, NBODY_SOFTENING);
+	double fBruteForceTime = timer.GetElapsed() * nCount / nSampleCount;
+	report.Print("%u bodies, %u workers, brute force: %.0f ms per step, %.2e interactions/s (from %u bodies)\n",
+		nCount, nWorkerCount, fBruteForceTime, static_cast<double>(nCount) * (nCount - 1) / (fBruteForceTime * 0.001), nSampleCount);
+
+	std::vector<Ogre::Vector3> accelerations;
+	double fMeanError, fMaxError;
+	if (nCount <= nExactLimit)
+	{
+		timer.Reset();
+		solver.ComputeExact(positions, masses, accelerations);
+		double fTime = timer.GetElapsed();
+		AccelerationError(accelerations, reference, samples, fMeanError, fMaxError);
+		report.Print("Tiled exact: %.0f ms per step, %.1fx brute force, error mean %.1e max %.1e\n",
+			fTime, fBruteForceTime / fTime, fMeanError, fMaxError);
+	}
+
+	const float thetas[] = { 0.3f, 0.5f, 0.7f, 1.0f };
+	for (float fTheta : thetas)
+	{
+		solver.SetOpeningAngle(fTheta);
+		timer.Reset();
+		solver.ComputeBarnesHut(positions, masses, accelerations);
+		double fTime = timer.GetElapsed();
+		AccelerationError(accelerations, reference, samples, fMeanError, fMaxError);
+		report.Print("Barnes-Hut theta %.1f: %.0f ms per step (%.1f steps/s), %.1fx brute force, error mean %.1e max %.1e\n",
+			fTheta, fTime, 1000.0 / fTime, fBruteForceTime / fTime, fMeanError, fMaxError);
+	}
+}
+
+// nbodykernel [count] [repeats]: tiled all-pairs kernel against the brute force loop it replaced,
+// both over every body. Interactions are counted as count * (count - 1) for both.
+static void RunNBodyKernelBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = std::max(args.GetUInt(0, 3000), 2u);
+	uint32_t nRepeats = std::max(args.GetUInt(1, 5), 1u);
+
+	uint32_t nWorkerCount = GetBenchWorkerCount();
+	JobSystem jobSystem(nWorkerCount);
+	flecs::world ecs;
+	NBodySolver solver(&ecs, nWorkerCount);
+
+	std::vector<Ogre::Vector3> positions;
+	std::vector<float> masses;
+	RandomCluster(nCount, positions, masses);
+	double fInteractions = static_cast<double>(nCount) * (nCount - 1);
+
+	std::vector<uint32_t> samples(nCount);
+	for (uint32_t i = 0; i < nCount; ++i)
+		samples[i] = i;
+
+	std::vector<Ogre::Vector3> reference(nCount);
+	BenchTimer timer;
+	for (uint32_t nRepeat = 0; nRepeat < nRepeats; ++nRepeat)
+	{
+		for (uint32_t i = 0; i < nCount; ++i)
+			reference[i] = BruteForceAcceleration(i, positions, masses, NBODY_GRAV_CONST, NBODY_SOFTENING);
+	}
+	double fBruteForceTime = timer.GetElapsed() / nRepeats;
+
+	std::vector<Ogre::Vector3> accelerations;
+	timer.Reset();
+	for (uint32_t nRepeat = 0; nRepeat < nRepeats; ++nRepeat)
+		solver.ComputeExact(positions, masses, accelerations);
+	double fTiledTime = timer.GetElapsed() / nRepeats;
+
+	double fMeanError, fMaxError;
+	AccelerationError(accelerations, reference, samples, fMeanError, fMaxError);
+	report.Print("%u bodies, %u workers\n", nCount, nWorkerCount);
+	report.Print("Brute force: %.2f ms, %.2e interactions/s\n", fBruteForceTime, fInteractions / (fBruteForceTime * 0.001));
+	report.Print("Tiled: %.2f ms, %.2e interactions/s, %.1fx, error mean %.1e max %.1e\n",
+		fTiledTime, fInteractions / (fTiledTime * 0.001), fBruteForceTime / fTiledTime, fMeanError, fMaxError);
+}
+
+// Largest and final relative energy error of an eccentric two body orbit, G = 1
+static void MeasureEnergyDrift(NBodySolver& solver, uint32_t nSteps, float dt, double& fMaxDrift, double& fFinalDrift)
+{
+	std::vector<Ogre::Vector3> positions = { Ogre::Vector3(0.0f, 0.0f, 0.0f), Ogre::Vector3(1.0f, 0.0f, 0.0f) };
+	std::vector<Ogre::Vector3> velocities = { Ogre::Vector3(0.0f, -0.2f, 0.0f), Ogre::Vector3(0.0f, 2.0f, 0.0f) };
+	std::vector<float> masses = { 10.0f, 1.0f };
+	std::vector<uint8_t> movable = { 1, 1 };
+
+	double fInitialEnergy = solver.ComputeTotalEnergy(positions, velocities, masses);
+	fMaxDrift = 0.0;
+	for (uint32_t nStep = 0; nStep < nSteps; ++nStep)
+	{
+		solver.Integrate(positions, velocities, masses, movable, dt);
+		double fDrift = std::abs((solver.ComputeTotalEnergy(positions, velocities, masses) - fInitialEnergy) / fInitialEnergy);
+		fMaxDrift = std::max(fMaxDrift, fDrift);
+	}
+	fFinalDrift = std::abs((solver.ComputeTotalEnergy(positions, velocities, masses) - fInitialEnergy) / fInitialEnergy);
+}
+
+// integrators [steps] [dt]: energy drift of every integrator over steps, then over the same
+// simulated time with 10x the timestep
+static void RunIntegratorBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nSteps = std::max(args.GetUInt(0, 1000000), 10u);
+	float dt = args.GetFloat(1, 0.001f);
+
+	flecs::world ecs;
+	NBodySolver solver(&ecs, 1);
+	solver.SetGravConst(1.0f);
+	solver.SetSoftening(0.01f);
+
+	const char* integratorNames[eINT_Max] = { "symplectic Euler", "leapfrog", "Yoshida4" };
+	for (uint32_t nIntegrator = 0; nIntegrator < eINT_Max; ++nIntegrator)
+	{
+		solver.SetIntegrator(static_cast<EIntegrator>(nIntegrator));
+		for (uint32_t nScale = 1; nScale <= 10; nScale *= 10)
+		{
+			double fMaxDrift, fFinalDrift;
+			BenchTimer timer;
+			MeasureEnergyDrift(solver, nSteps / nScale, dt * nScale, fMaxDrift, fFinalDrift);
+			report.Print("%s, %u steps of %g: max drift %.2e, final %.2e, %.0f ms\n",
+				integratorNames[nIntegrator], nSteps / nScale, dt * nScale, fMaxDrift, fFinalDrift, timer.GetElapsed());
+		}
+	}
+}
+
+// snapshot [count] [changed%] [repeats]: capture and restore of Position, Velocity and Orientation,
+// a third of the entities in a second table. Deltas are taken with changed% of the positions
+// changed and with all of them. Times are averages over repeats.
+static void RunSnapshotBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = args.GetUInt(0, 100000);
+	float fChangedShare = args.GetFloat(1, 1.0f) * 0.01f;
+	uint32_t nRepeats = std::max(args.GetUInt(2, 20), 1u);
+
+	flecs::world ecs;
+	EcsSnapshotter snapshotter(&ecs);
+	snapshotter.AddComponent<Position>();
+	snapshotter.AddComponent<Velocity>();
+	snapshotter.AddComponent<Orientation>();
+
+	std::vector<flecs::entity> entities(nCount);
+	for (uint32_t i = 0; i < nCount; ++i)
+	{
+		entities[i] = ecs.entity()
+			.set(Position(static_cast<float>(i), 0.0f, 0.0f))
+			.set(Velocity(1.0f, 0.0f, 0.0f))
+			.set(Orientation(1.0f, 0.0f, 0.0f, 0.0f));
+		if (i % 3 == 0)
+			entities[i].set(Gravity(0.0f, -1.0f, 0.0f));
+	}
+
+	// First fShare of the entities, the ones that changed sit together in their columns
+	auto moveEntities = [&](float fShare, float fOffset)
+	{
+		uint32_t nMoved = std::min(static_cast<uint32_t>(fShare * nCount), nCount);
+		for (uint32_t i = 0; i < nMoved; ++i)
+			entities[i].get_mut<Position>()->x += fOffset;
+	};
+
+	BenchTimer timer;
+	EcsSnapshot* pBase = snapshotter.Capture();
+	report.Print("%u entities, %.1f MB per full snapshot, first capture %.2f ms\n",
+		nCount, pBase->GetDataSize() / (1024.0 * 1024.0), timer.GetElapsed());
+
+	double fCaptureTime = 0.0;
+	for (uint32_t nRepeat = 0; nRepeat < nRepeats; ++nRepeat)
+	{
+		timer.Reset();
+		EcsSnapshot* pSnapshot = snapshotter.Capture();
+		fCaptureTime += timer.GetElapsed();
+		snapshotter.Release(pSnapshot);
+	}
+	report.Print("Capture from pool: %.2f ms\n", fCaptureTime / nRepeats);
+
+	const float shares[] = { fChangedShare, 1.0f };
+	for (float fShare : shares)
+	{
+		double fDeltaTime = 0.0;
+		double fRestoreTime = 0.0;
+		EcsSnapshot* pDelta = nullptr;
+		for (uint32_t nRepeat = 0; nRepeat < nRepeats; ++nRepeat)
+		{
+			moveEntities(fShare, 1.0f);
+			timer.Reset();
+			pDelta = snapshotter.CaptureDelta(pBase);
+			fDeltaTime += timer.GetElapsed();
+
+			moveEntities(fShare, 1.0f);
+			timer.Reset();
+			snapshotter.Restore(pDelta);
+			fRestoreTime += timer.GetElapsed();
+			if (nRepeat + 1 < nRepeats)
+				snapshotter.Release(pDelta);
+		}
+		report.Print("%.1f%% of positions changed: delta capture %.2f ms (%u chunks, %.2f MB), delta restore %.2f ms\n",
+			fShare * 100.0f, fDeltaTime / nRepeats, pDelta->GetChangedChunkCount(),
+			pDelta->GetDataSize() / (1024.0 * 1024.0), fRestoreTime / nRepeats);
+		snapshotter.Release(pDelta);
+	}
+
+	double fRestoreTime = 0.0;
+	for (uint32_t nRepeat = 0; nRepeat < nRepeats; ++nRepeat)
+	{
+		moveEntities(1.0f, 1.0f);
+		timer.Reset();
+		snapshotter.Restore(pBase);
+		fRestoreTime += timer.GetElapsed();
+	}
+	report.Print("Full restore: %.2f ms\n", fRestoreTime / nRepeats);
+
+	// Entity set differs from the snapshot, restore matches entities by id
+	entities[nCount / 2].destruct();
+	ecs.entity().set(Position(0.0f, 0.0f, 0.0f));
+	timer.Reset();
+	snapshotter.Restore(pBase);
+	report.Print("Full restore after a spawn and a destroy: %.2f ms\n", timer.GetElapsed());
+
+	snapshotter.Release(pBase);
+}
+
+static void PrintAllocatorDelta(BenchReport& report, const EcsAllocatorStats& before, uint32_t nEntities)
+{
+	if (!EcsAllocator::IsInstalled())
+		return;
+
+	EcsAllocatorStats after = EcsAllocator::GetTotalStats();
+	int64_t nAllocCount = after.nAllocCount - before.nAllocCount;
+	int64_t nReallocCount = after.nReallocCount - before.nReallocCount;
+	int64_t nSystemCount = after.nSystemAllocCount - before.nSystemAllocCount;
+	report.Print("  %lld allocs, %lld reallocs, %lld from system heap, %.2f allocs per entity, %.1f MB live, %.1f MB reserved\n",
+		static_cast<long long>(nAllocCount), static_cast<long long>(nReallocCount), static_cast<long long>(nSystemCount),
+		nEntities ? static_cast<double>(nAllocCount + nReallocCount) / nEntities : 0.0,
+		after.nLiveBytes / (1024.0 * 1024.0), after.nReservedBytes / (1024.0 * 1024.0));
+}
+
+// ecsalloc [count] [rounds]: one at a time spawns over four tables, churn of destroying and
+// respawning half of them per round, then world teardown. Run again with -systemheap to compare,
+// counters are only there on the pool heap.
+static void RunEcsAllocBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = args.GetUInt(0, 100000);
+	uint32_t nRounds = std::max(args.GetUInt(1, 10), 1u);
+
+	flecs::world* pEcs = new flecs::world();
+	std::vector<flecs::entity> entities(nCount);
+	auto spawnEntity = [pEcs](uint32_t i)
+	{
+		flecs::entity e = pEcs->entity()
+			.set(Position(static_cast<float>(i), 0.0f, 0.0f))
+			.set(Velocity(1.0f, 0.0f, 0.0f));
+		if (i & 1)
+			e.set(Orientation(1.0f, 0.0f, 0.0f, 0.0f));
+		if (i & 2)
+			e.set(Gravity(0.0f, -1.0f, 0.0f));
+		return e;
+	};
+
+	EcsAllocatorStats before = EcsAllocator::GetTotalStats();
+	BenchTimer timer;
+	for (uint32_t i = 0; i < nCount; ++i)
+		entities[i] = spawnEntity(i);
+	double fSpawnTime = timer.GetElapsed();
+	report.Print("Spawn %u entities: %.2f ms (%.0f entities/s)\n", nCount, fSpawnTime, nCount / (fSpawnTime * 0.001));
+	PrintAllocatorDelta(report, before, nCount);
+
+	before = EcsAllocator::GetTotalStats();
+	timer.Reset();
+	for (uint32_t nRound = 0; nRound < nRounds; ++nRound)
+	{
+		for (uint32_t i = nRound & 1; i < nCount; i += 2)
+			entities[i].destruct();
+		for (uint32_t i = nRound & 1; i < nCount; i += 2)
+			entities[i] = spawnEntity(i);
+	}
+	double fChurnTime = timer.GetElapsed();
+	uint32_t nChurned = nRounds * (nCount / 2);
+	report.Print("Churn %u rounds of %u destroys and spawns: %.2f ms per round\n", nRounds, nCount / 2, fChurnTime / nRounds);
+	PrintAllocatorDelta(report, before, nChurned);
+
+	timer.Reset();
+	delete pEcs;
+	report.Print("World teardown: %.2f ms\n", timer.GetElapsed());
+}
+
+// Stands in for a job's work, about nIterations * 4 cycles that can't be folded away
+static uint32_t SpinWork(uint32_t nSeed, uint32_t nIterations)
+{
+	uint32_t nValue = nSeed;
+	for (uint32_t i = 0; i < nIterations; ++i)
+		nValue = nValue * 1664525u + 1013904223u;
+	return nValue;
+}
+
+struct SpinJobData
+{
+	uint32_t nIterations;
+	std::atomic<uint32_t> nResult;
+};
+
+static void RunSpinJob(void* pData, size_t nBegin, size_t nEnd)
+{
+	SpinJobData* pSpin = static_cast<SpinJobData*>(pData);
+	uint32_t nResult = 0;
+	for (size_t i = nBegin; i < nEnd; ++i)
+		nResult += SpinWork(static_cast<uint32_t>(i), pSpin->nIterations);
+	pSpin->nResult.fetch_add(nResult, std::memory_order_relaxed);
+}
+
+struct TreeJobData
+{
+	uint32_t nDepth;
+	uint32_t nIterations;
+	std::atomic<uint32_t>* pResult;
+};
+
+// Binary tree of jobs, every inner job submits two children and waits for them
+static void RunTreeJob(void* pData, size_t, size_t)
+{
+	TreeJobData* pTree = static_cast<TreeJobData*>(pData);
+	pTree->pResult->fetch_add(SpinWork(pTree->nDepth, pTree->nIterations), std::memory_order_relaxed);
+	if (pTree->nDepth == 0)
+		return;
+
+	TreeJobData children[2] = { { pTree->nDepth - 1, pTree->nIterations, pTree->pResult },
+		{ pTree->nDepth - 1, pTree->nIterations, pTree->pResult } };
+	JobCounter counter;
+	Job jobs[2] = { { RunTreeJob, &children[0], 0, 1, &counter }, { RunTreeJob, &children[1], 0, 1, &counter } };
+	JobSystem::Get()->Submit(jobs, 2);
+	JobSystem::Get()->Wait(&counter);
+}
+
+// jobs [max workers] [jobs] [iterations]: same work on 1, 2, 4... workers, each count in a
+// job system of its own. Small jobs from main thread, a parallel for of big chunks and a tree
+// of jobs waiting for their children. Speedup is against 1 worker, capped by cores.
+static void RunJobBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nMaxWorkers = std::max(args.GetUInt(0, 32), 1u);
+	uint32_t nJobCount = std::max(args.GetUInt(1, 100000), 1u);
+	uint32_t nIterations = args.GetUInt(2, 1000);
+	const uint32_t nTreeDepth = 14;
+
+	report.Print("%u cores, %u jobs of %u iterations, tree of %u jobs\n",
+		std::thread::hardware_concurrency(), nJobCount, nIterations, (2u << nTreeDepth) - 1);
+
+	double baseTimes[3] = {};
+	for (uint32_t nWorkers = 1; nWorkers <= nMaxWorkers; nWorkers *= 2)
+	{
+		JobSystem jobSystem(nWorkers);
+		double times[3];
+
+		SpinJobData spin = { nIterations, { 0 } };
+		JobCounter counter;
+		std::vector<Job> jobs(nJobCount);
+		for (uint32_t i = 0; i < nJobCount; ++i)
+			jobs[i] = Job{ RunSpinJob, &spin, i, i + 1, &counter };
+		BenchTimer timer;
+		jobSystem.Submit(jobs.data(), nJobCount);
+		jobSystem.Wait(&counter);
+		times[0] = timer.GetElapsed();
+
+		auto spinRange = [&spin](uint32_t, size_t nBegin, size_t nEnd) { RunSpinJob(&spin, nBegin, nEnd); };
+		timer.Reset();
+		jobSystem.ParallelFor(nJobCount, 1, nWorkers * 4, spinRange);
+		times[1] = timer.GetElapsed();
+
+		std::atomic<uint32_t> nTreeResult(0);
+		TreeJobData tree = { nTreeDepth, nIterations, &nTreeResult };
+		timer.Reset();
+		RunTreeJob(&tree, 0, 1);
+		times[2] = timer.GetElapsed();
+
+		if (nWorkers == 1)
+			std::copy(times, times + 3, baseTimes);
+		report.Print("%2u workers: small jobs %.2f ms (x%.2f), parallel for %.2f ms (x%.2f), job tree %.2f ms (x%.2f)\n",
+			nWorkers, times[0], baseTimes[0] / times[0], times[1], baseTimes[1] / times[1], times[2], baseTimes[2] / times[2]);
+	}
+}
+
+// lod [count] [extent] [iterations] [frames]: entities spread over a square world around the camera,
+// each doing iterations of work when it updates, as a script update would. Every entity every frame
+// against the LOD scheduler with the game's bucket distances. Scheduler time is included.
+static void RunLodBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = args.GetUInt(0, 100000);
+	float fExtent = args.GetFloat(1, 1000.0f);
+	uint32_t nIterations = args.GetUInt(2, 1000);
+	uint32_t nFrames = std::max(args.GetUInt(3, 60), 1u);
+	const float dt = 1.0f / 60.0f;
+
+	flecs::world ecs;
+	ecs.entity().set(CameraPosition(0.0f, 0.0f, 0.0f));
+	for (uint32_t i = 0; i < nCount; ++i)
+	{
+		Ogre::Vector3 vPoint = RandomPoint(BENCH_SEED, i, fExtent);
+		ecs.entity()
+			.set(Position(vPoint.x, 0.0f, vPoint.z))
+			.set(MakeUpdateLod(0, UpdateLodScheduler::MaxBuckets - 1));
+	}
+
+	std::vector<float> lodDistances;
+	for (uint32_t nBucket = 1; nBucket < UPDATE_LOD_BUCKET_COUNT; ++nBucket)
+		lodDistances.push_back(UPDATE_LOD_BASE_DISTANCE * (1 << (nBucket - 1)));
+	UpdateLodScheduler lodScheduler(&ecs);
+	lodScheduler.SetBucketDistances(lodDistances);
+
+	flecs::query<const UpdateLod, const Position> updateQuery = ecs.query<const UpdateLod, const Position>();
+	uint32_t nResult = 0;
+	auto runUpdates = [&](bool bUseLod)
+	{
+		updateQuery.each([&](const UpdateLod& lod, const Position& pos)
+			{
+				if (!bUseLod || lod.bTick)
+					nResult += SpinWork(static_cast<uint32_t>(pos.x), nIterations);
+			});
+	};
+
+	BenchTimer timer;
+	for (uint32_t nFrame = 0; nFrame < nFrames; ++nFrame)
+		runUpdates(false);
+	double fFullTime = timer.GetElapsed() / nFrames;
+
+	// First update assigns buckets and slots to everyone
+	lodScheduler.Update(dt);
+	double fSchedulerTime = 0.0;
+	uint64_t nTicks = 0;
+	timer.Reset();
+	for (uint32_t nFrame = 0; nFrame < nFrames; ++nFrame)
+	{
+		BenchTimer schedulerTimer;
+		lodScheduler.Update(dt);
+		fSchedulerTime += schedulerTimer.GetElapsed();
+		nTicks += lodScheduler.GetTickCount();
+		runUpdates(true);
+	}
+	double fLodTime = timer.GetElapsed() / nFrames;
+
+	// Checksum keeps the work from being optimised away
+	report.Print("%u entities within %.0f of camera, %u iterations per update, %u frames, checksum %08x\n",
+		nCount, fExtent, nIterations, nFrames, nResult);
+	for (uint32_t nBucket = 0; nBucket < lodScheduler.GetBucketCount(); ++nBucket)
+		report.Print("  bucket %u, every %u frames: %u entities\n", nBucket, 1u << nBucket, lodScheduler.GetEntityCount(nBucket));
+	report.Print("Every entity every frame: %.2f ms per frame\n", fFullTime);
+	report.Print("LOD: %.2f ms per frame (x%.2f), %.0f updates per frame, scheduler %.3f ms\n",
+		fLodTime, fFullTime / fLodTime, static_cast<double>(nTicks) / nFrames, fSchedulerTime / nFrames);
+}
+
+void register_ecs_benchmarks(std::vector<Benchmark>& benchmarks)
+{
+	benchmarks.push_back({ "spatial", "[count=1000000] [queries=100000] [moved%=1]", RunSpatialBenchmark });
+	benchmarks.push_back({ "nbody", "[count=100000] [samples=1000] [exact limit=100000]", RunNBodyBenchmark });
+	benchmarks.push_back({ "nbodykernel", "[count=3000] [repeats=5]", RunNBodyKernelBenchmark });
+	benchmarks.push_back({ "integrators", "[steps=1000000] [dt=0.001]", RunIntegratorBenchmark });
+	benchmarks.push_back({ "snapshot", "[count=100000] [changed%=1] [repeats=20]", RunSnapshotBenchmark });
+	benchmarks.push_back({ "ecsalloc", "[count=100000] [rounds=10]", RunEcsAllocBenchmark });
+	benchmarks.push_back({ "jobs", "[max workers=32] [jobs=100000] [iterations=1000]", RunJobBenchmark });
+	benchmarks.push_back({ "lod", "[count=100000] [extent=1000] [iterations=1000] [frames=60]", RunLodBenchmark });
+}
@@ -0,0 +1,83 @@
+#include "Benchmarks.h"
+
+#include "../EntityManager.h"
+#include "../FileSystem/FileSystem.h"
+#include "../ResourceManager.h"
+#include "../Input/InputHandler.h"
+#include "../RenderEngine.h"
+#include "../ScriptSystem/ScriptSystem.h"
+
+// Render thread executes commands of a frame one frame later,
+// after this spawned scene nodes exist and destroyed ones are gone
+static void FlushFrames(RenderEngine* pRenderEngine, EntityManager* pEntityManager)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		pRenderEngine->GetRT()->RC_BeginFrame();
+		pEntityManager->Update();
+		pRenderEngine->GetRT()->RC_EndFrame();
+	}
+}
+
+// spawn [count] [script]: CreateEntity one at a time against CreateEntities, each in a fresh world.
+// Script is compiled before timing, create is main thread time, total includes scene nodes.
+static void RunSpawnBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = args.GetUInt(0, 10000);
+	std::string strScript = args.GetString(1, "Actor.lua");
+
+	FileSystem fileSystem;
+	ResourceManager resourceManager(fileSystem.GetMediaRoot());
+	InputHandler inputHandler(fileSystem.GetMediaRoot());
+	RenderEngine renderEngine(&resourceManager);
+
+	EntityInfo prototype;
+	prototype.meshName = "ogrehead.mesh";
+	prototype.scriptName = strScript;
+	prototype.position = Ogre::Vector3::ZERO;
+	prototype.rotation = Ogre::Quaternion::IDENTITY;
+
+	const char* modeNames[] = { "CreateEntity", "CreateEntities" };
+	for (int nMode = 0; nMode < 2; ++nMode)
+	{
+		flecs::world ecs;
+		ScriptSystem scriptSystem(&inputHandler, fileSystem.GetScriptsRoot(), fileSystem.GetScriptCacheRoot(), 0);
+		EntityManager entityManager(&renderEngine, &scriptSystem, &ecs);
+		if (!scriptSystem.GetChunk(fileSystem.GetScriptsRoot() + strScript))
+		{
+			report.Print("Can't load %s\n", strScript.c_str());
+			return;
+		}
+
+		size_t nLuaBytesBefore = scriptSystem.GetMemoryUsage();
+		BenchTimer timer;
+		if (nMode == 0)
+		{
+			for (uint32_t i = 0; i < nCount; ++i)
+				entityManager.CreateEntity(prototype);
+		}
+		else
+			entityManager.CreateEntities(nCount, prototype);
+		double fCreateTime = timer.GetElapsed();
+		FlushFrames(&renderEngine, &entityManager);
+		double fTotalTime = timer.GetElapsed();
+
+		size_t nLuaBytes = scriptSystem.GetMemoryUsage() - nLuaBytesBefore;
+		uint32_t nSpawned = entityManager.GetEntityCount();
+		report.Print("%s: %u entities, create %.2f ms (%.0f entities/s), with scene nodes %.2f ms, %.0f lua bytes per entity\n",
+			modeNames[nMode], nSpawned, fCreateTime, nSpawned / (fCreateTime * 0.001), fTotalTime,
+			nSpawned ? static_cast<double>(nLuaBytes) / nSpawned : 0.0);
+
+		// Scene nodes go before the pool that owns their render nodes
+		EntitySpan<EntityHandle> liveHandles = entityManager.GetEntityHandles();
+		std::vector<EntityHandle> handles(liveHandles.begin(), liveHandles.end());
+		for (EntityHandle handle : handles)
+			entityManager.DestroyEntity(handle);
+		FlushFrames(&renderEngine, &entityManager);
+	}
+}
+
+void register_entity_benchmarks(std::vector<Benchmark>& benchmarks)
+{
+	benchmarks.push_back({ "spawn", "[count=10000] [script=Actor.lua]", RunSpawnBenchmark });
+}
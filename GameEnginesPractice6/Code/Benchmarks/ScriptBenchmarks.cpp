@@ -0,0 +1,248 @@
+#include "Benchmarks.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "../ProjectDefines.h"
+#include "../FileSystem/FileSystem.h"
+#include "../Input/InputHandler.h"
+#include "../JobSystem/JobSystem.h"
+#include "../ScriptSystem/ScriptSystem.h"
+
+// Scripted entities as EntityManager::CreateEntity makes them, without render nodes
+static uint32_t SpawnScripted(flecs::world& ecs, ScriptSystem& scriptSystem, const std::string& strScript, uint32_t nCount)
+{
+	for (uint32_t i = 0; i < nCount; ++i)
+	{
+		flecs::entity e = ecs.entity();
+		ScriptNode* pScriptNode = scriptSystem.CreateScriptNode(strScript, e);
+		if (!pScriptNode)
+		{
+			e.destruct();
+			return i;
+		}
+		e.set(ScriptNodeComponent{ pScriptNode });
+	}
+	return nCount;
+}
+
+// Script systems of one frame, every entity updates
+static void UpdateScripts(flecs::world& ecs, flecs::query<ScriptNodeComponent>& scriptQuery, ScriptSystem& scriptSystem, float dt)
+{
+	scriptQuery.each([&scriptSystem, dt](ScriptNodeComponent& scriptNode)
+		{
+			if (!scriptSystem.QueueUpdate(scriptNode.ptr, dt))
+				scriptNode.ptr->Update(dt);
+		});
+	scriptSystem.RunBatchUpdates(dt);
+	scriptSystem.RunParallelUpdates(dt);
+	scriptSystem.ApplyCommands(ecs.c_ptr());
+}
+
+// scriptspawn [count] [script]: every instance in one shared lua state against a state of its own
+// per instance, which is what every entity used to get. Script has to be thread safe, worker
+// states are what gives each instance its own state. Both load the chunk's bytecode, so the
+// per instance parse entities also used to pay is left out.
+static void RunScriptSpawnBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = args.GetUInt(0, 10000);
+	std::string strScript = args.GetString(1, "Actor.lua");
+
+	FileSystem fileSystem;
+	InputHandler inputHandler(fileSystem.GetMediaRoot());
+
+	const char* modeNames[] = { "Shared state", "State per entity" };
+	for (int nMode = 0; nMode < 2; ++nMode)
+	{
+		flecs::world ecs;
+		BenchTimer timer;
+		ScriptSystem scriptSystem(&inputHandler, fileSystem.GetScriptsRoot(), fileSystem.GetScriptCacheRoot(), nMode == 0 ? 0 : nCount);
+		double fStateTime = timer.GetElapsed();
+
+		const ScriptChunk* pChunk = scriptSystem.GetChunk(fileSystem.GetScriptsRoot() + strScript);
+		if (!pChunk)
+		{
+			report.Print("Can't load %s\n", strScript.c_str());
+			return;
+		}
+		if (nMode == 1 && !pChunk->bThreadSafe)
+		{
+			report.Print("%s isn't thread safe, can't give its instances states of their own\n", strScript.c_str());
+			return;
+		}
+
+		size_t nBytesBefore = scriptSystem.GetMemoryUsage();
+		timer.Reset();
+		uint32_t nSpawned = SpawnScripted(ecs, scriptSystem, strScript, nCount);
+		double fSpawnTime = timer.GetElapsed();
+		size_t nBytes = scriptSystem.GetMemoryUsage();
+
+		// States exist only for their instances in the second mode, they are part of the cost
+		double fPerEntityTime = nSpawned ? (fSpawnTime + (nMode == 1 ? fStateTime : 0.0)) / nSpawned : 0.0;
+		size_t nEntityBytes = nMode == 0 ? nBytes - nBytesBefore : nBytes;
+		report.Print("%s: %u entities, states %.2f ms, spawn %.2f ms, %.1f us per entity, %.1f MB lua, %.0f bytes per entity\n",
+			modeNames[nMode], nSpawned, fStateTime, fSpawnTime, fPerEntityTime * 1000.0, nBytes / (1024.0 * 1024.0),
+			nSpawned ? static_cast<double>(nEntityBytes) / nSpawned : 0.0);
+	}
+}
+
+// scriptupdate [count] [frames]: cost per entity of calling a script whose OnUpdate is empty,
+// and of the getters control systems call
+static void RunScriptUpdateBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = args.GetUInt(0, 10000);
+	uint32_t nFrames = std::max(args.GetUInt(1, 100), 1u);
+	const std::string strScript = "Bench/Empty.lua";
+	const float dt = 1.0f / 60.0f;
+
+	FileSystem fileSystem;
+	InputHandler inputHandler(fileSystem.GetMediaRoot());
+	flecs::world ecs;
+	ScriptSystem scriptSystem(&inputHandler, fileSystem.GetScriptsRoot(), fileSystem.GetScriptCacheRoot(), 0);
+	uint32_t nSpawned = SpawnScripted(ecs, scriptSystem, strScript, nCount);
+	if (nSpawned == 0)
+	{
+		report.Print("Can't load %s\n", strScript.c_str());
+		return;
+	}
+
+	std::vector<ScriptNode*> nodes;
+	ecs.each([&nodes](ScriptNodeComponent& scriptNode) { nodes.push_back(scriptNode.ptr); });
+
+	uint64_t nCalls = static_cast<uint64_t>(nodes.size()) * nFrames;
+	auto timePerCall = [&](auto func)
+	{
+		BenchTimer timer;
+		for (uint32_t nFrame = 0; nFrame < nFrames; ++nFrame)
+		{
+			for (ScriptNode* pScriptNode : nodes)
+				func(pScriptNode);
+		}
+		return timer.GetElapsed() * 1e6 / nCalls;
+	};
+
+	// Sum of what getters return keeps their calls from being optimised away
+	float fSum = 0.0f;
+	double fUpdateTime = timePerCall([dt](ScriptNode* pScriptNode) { pScriptNode->Update(dt); });
+	double fPositionTime = timePerCall([&fSum](ScriptNode* pScriptNode) { fSum += pScriptNode->GetPosition().x; });
+	double fOrientationTime = timePerCall([&fSum](ScriptNode* pScriptNode) { fSum += pScriptNode->GetOrientation().w; });
+	// Script has no GetCameraPosition, what is left is finding out it's missing
+	double fCameraTime = timePerCall([&fSum](ScriptNode* pScriptNode) { fSum += pScriptNode->GetCameraPosition().x; });
+
+	report.Print("%u entities, %u frames, checksum %.0f\n", nSpawned, nFrames, fSum);
+	report.Print("Empty OnUpdate: %.1f ns per entity\n", fUpdateTime);
+	report.Print("GetPosition %.1f ns, GetOrientation %.1f ns, missing GetCameraPosition %.1f ns\n",
+		fPositionTime, fOrientationTime, fCameraTime);
+}
+
+// scriptgc [count] [frames]: Pawn.lua, written with in place math, against the same script written
+// with operators. Lua allocations per frame come from the script's memory account and
+// need SCRIPT_POOL_ALLOCATOR, frame time includes the collector keeping up with them.
+static void RunScriptGcBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = args.GetUInt(0, 10000);
+	uint32_t nFrames = std::max(args.GetUInt(1, 100), 1u);
+	const float dt = 1.0f / 60.0f;
+
+	FileSystem fileSystem;
+	InputHandler inputHandler(fileSystem.GetMediaRoot());
+
+	const char* scripts[] = { "Pawn.lua", "Bench/PawnOperators.lua" };
+	for (const char* szScript : scripts)
+	{
+		flecs::world ecs;
+		ScriptSystem scriptSystem(&inputHandler, fileSystem.GetScriptsRoot(), fileSystem.GetScriptCacheRoot(), 0);
+		uint32_t nSpawned = SpawnScripted(ecs, scriptSystem, szScript, nCount);
+		const ScriptChunk* pChunk = scriptSystem.GetChunk(fileSystem.GetScriptsRoot() + szScript);
+		if (nSpawned == 0 || !pChunk)
+		{
+			report.Print("Can't load %s\n", szScript);
+			continue;
+		}
+
+		flecs::query<ScriptNodeComponent> scriptQuery = ecs.query<ScriptNodeComponent>();
+		// Spawn allocations end up in the first frame's counters, not measured
+		UpdateScripts(ecs, scriptQuery, scriptSystem, dt);
+		scriptSystem.GetAllocator()->EndFrame(dt);
+
+		int64_t nAllocCount = 0;
+		int64_t nBytesAllocated = 0;
+		int64_t nMaxLiveBytes = 0;
+		BenchTimer timer;
+		for (uint32_t nFrame = 0; nFrame < nFrames; ++nFrame)
+		{
+			UpdateScripts(ecs, scriptQuery, scriptSystem, dt);
+			scriptSystem.GetAllocator()->EndFrame(dt);
+			nAllocCount += pChunk->pMemoryAccount->nFrameAllocCount;
+			nBytesAllocated += pChunk->pMemoryAccount->nFrameBytesAllocated;
+			nMaxLiveBytes = std::max(nMaxLiveBytes, pChunk->pMemoryAccount->nTotalLiveBytes);
+		}
+		double fFrameTime = timer.GetElapsed() / nFrames;
+
+		report.Print("%s: %u entities, %.2f ms per frame", szScript, nSpawned, fFrameTime);
+#ifdef SCRIPT_POOL_ALLOCATOR
+		report.Print(", %.1f allocs and %.0f bytes per entity per frame, %.1f MB live at most\n",
+			static_cast<double>(nAllocCount) / nFrames / nSpawned, static_cast<double>(nBytesAllocated) / nFrames / nSpawned,
+			nMaxLiveBytes / (1024.0 * 1024.0));
+#else
+		report.Print(", lua on system heap, no allocation counters\n");
+#endif
+	}
+}
+
+// scriptthreads [count] [max threads] [frames] [script]: thread safe script updated on the main
+// state only, then spread over 1, 2, 4... worker states, each run in a job system with as many
+// workers. Speedup is against main state, capped by cores.
+static void RunScriptThreadBenchmark(const BenchArgs& args, BenchReport& report)
+{
+	uint32_t nCount = args.GetUInt(0, 10000);
+	uint32_t nMaxThreads = std::max(args.GetUInt(1, 16), 1u);
+	uint32_t nFrames = std::max(args.GetUInt(2, 60), 1u);
+	std::string strScript = args.GetString(3, "Bench/Worker.lua");
+	const float dt = 1.0f / 60.0f;
+
+	FileSystem fileSystem;
+	InputHandler inputHandler(fileSystem.GetMediaRoot());
+	report.Print("%u cores, %u entities of %s, %u frames\n",
+		std::thread::hardware_concurrency(), nCount, strScript.c_str(), nFrames);
+
+	double fMainStateTime = 0.0;
+	// 0 is main state alone, scripts stay off the job system
+	for (uint32_t nThreads = 0; nThreads <= nMaxThreads; nThreads = nThreads ? nThreads * 2 : 1)
+	{
+		JobSystem jobSystem(std::max(nThreads, 1u));
+		flecs::world ecs;
+		ScriptSystem scriptSystem(&inputHandler, fileSystem.GetScriptsRoot(), fileSystem.GetScriptCacheRoot(), nThreads);
+		uint32_t nSpawned = SpawnScripted(ecs, scriptSystem, strScript, nCount);
+		if (nSpawned == 0)
+		{
+			report.Print("Can't load %s\n", strScript.c_str());
+			return;
+		}
+
+		flecs::query<ScriptNodeComponent> scriptQuery = ecs.query<ScriptNodeComponent>();
+		// Components scripts add through commands are there after the first frame
+		UpdateScripts(ecs, scriptQuery, scriptSystem, dt);
+
+		BenchTimer timer;
+		for (uint32_t nFrame = 0; nFrame < nFrames; ++nFrame)
+			UpdateScripts(ecs, scriptQuery, scriptSystem, dt);
+		double fFrameTime = timer.GetElapsed() / nFrames;
+
+		if (nThreads == 0)
+		{
+			fMainStateTime = fFrameTime;
+			report.Print("Main state: %.2f ms per frame\n", fFrameTime);
+		}
+		else
+			report.Print("%2u worker states: %.2f ms per frame (x%.2f)\n", nThreads, fFrameTime, fMainStateTime / fFrameTime);
+	}
+}
+
+void register_script_benchmarks(std::vector<Benchmark>& benchmarks)
+{
+	benchmarks.push_back({ "scriptspawn", "[count=10000] [script=Actor.lua]", RunScriptSpawnBenchmark });
+	benchmarks.push_back({ "scriptupdate", "[count=10000] [frames=100]", RunScriptUpdateBenchmark });
+	benchmarks.push_back({ "scriptgc", "[count=10000] [frames=100]", RunScriptGcBenchmark });
+	benchmarks.push_back({ "scriptthreads", "[count=10000] [max threads=16] [frames=60] [script=Bench/Worker.lua]", RunScriptThreadBenchmark });
+}
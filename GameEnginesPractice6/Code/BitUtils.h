@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the highest set bit, nValue must not be 0
+inline uint32_t FloorLog2(uint64_t nValue)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+	unsigned long nIndex;
+	_BitScanReverse64(&nIndex, nValue);
+	return static_cast<uint32_t>(nIndex);
+#elif defined(_MSC_VER)
+	// 64 bit scan is x64 only, Win32 scans the halves
+	unsigned long nIndex;
+	if (_BitScanReverse(&nIndex, static_cast<unsigned long>(nValue >> 32)))
+		return static_cast<uint32_t>(nIndex) + 32;
+	_BitScanReverse(&nIndex, static_cast<unsigned long>(nValue));
+	return static_cast<uint32_t>(nIndex);
+#else
+	return 63u - static_cast<uint32_t>(__builtin_clzll(nValue));
+#endif
+}
@@ -0,0 +1,442 @@
+#include "ecsAllocator.h"
+#include "flecs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "../BitUtils.h"
+
+// 16 byte steps up to 256, then 4 classes per power of two up to 64K
+static const uint32_t ALLOCATOR_SMALL_CLASSES = 16;
+static const uint32_t ALLOCATOR_SMALL_STEP = 16;
+static const uint32_t ALLOCATOR_CLASS_COUNT = 48;
+static const size_t ALLOCATOR_MAX_CLASS_SIZE = 64 * 1024;
+static const size_t ALLOCATOR_SLAB_SIZE = 256 * 1024;
+// Thread cache holds about this many bytes per class before giving half back
+static const size_t ALLOCATOR_THREAD_CACHE_BYTES = 64 * 1024;
+static const uint32_t ALLOCATOR_SYSTEM_CLASS = 0xFFFFFFFF;
+
+// Keeps user memory 16 byte aligned, holds what free needs since flecs doesn't pass size
+struct BlockHeader
+{
+	uint32_t nClass;
+	uint32_t nSize;
+	uint64_t nPadding;
+};
+static_assert(sizeof(BlockHeader) == 16, "block header must keep 16 byte alignment");
+
+struct FreeBlock
+{
+	FreeBlock* pNext;
+};
+
+static uint32_t GetSizeClass(size_t nSize)
+{
+	if (nSize <= ALLOCATOR_SMALL_CLASSES * ALLOCATOR_SMALL_STEP)
+		return nSize == 0 ? 0 : static_cast<uint32_t>((nSize - 1) / ALLOCATOR_SMALL_STEP);
+
+	uint32_t nPower = FloorLog2(nSize - 1);
+	uint32_t nSub = static_cast<uint32_t>((nSize - 1) >> (nPower - 2)) & 3;
+	return ALLOCATOR_SMALL_CLASSES + (nPower - 8) * 4 + nSub;
+}
+
+static size_t GetClassSize(uint32_t nClass)
+{
+	if (nClass < ALLOCATOR_SMALL_CLASSES)
+		return (nClass + 1) * ALLOCATOR_SMALL_STEP;
+
+	uint32_t nPower = 8 + (nClass - ALLOCATOR_SMALL_CLASSES) / 4;
+	uint32_t nSub = (nClass - ALLOCATOR_SMALL_CLASSES) % 4;
+	return (size_t(1) << nPower) + (nSub + 1) * (size_t(1) << (nPower - 2));
+}
+
+struct SizeClassPool
+{
+	std::mutex mutex;
+	FreeBlock* pFree = nullptr;
+	uint32_t nFreeCount = 0;
+};
+
+struct AllocatorCounters
+{
+	std::atomic<int64_t> nAllocCount{ 0 };
+	std::atomic<int64_t> nReallocCount{ 0 };
+	std::atomic<int64_t> nFreeCount{ 0 };
+	std::atomic<int64_t> nSystemAllocCount{ 0 };
+	std::atomic<int64_t> nBytesAllocated{ 0 };
+	std::atomic<int64_t> nBytesFreed{ 0 };
+	std::atomic<int64_t> nReservedBytes{ 0 };
+};
+
+struct AllocatorState
+{
+	SizeClassPool pools[ALLOCATOR_CLASS_COUNT];
+	AllocatorCounters counters;
+
+	std::mutex slabMutex;
+	std::vector<void*> slabs;
+
+	// Main thread only
+	EcsAllocatorStats lastTotals = {};
+	EcsAllocatorStats frameStats = {};
+	uint64_t nFrame = 0;
+	std::string strDumpPath;
+	float fDumpPeriod = 0.0f;
+	float fTimeSinceDump = 0.0f;
+};
+
+// Never destroyed, flecs may free memory during static destruction
+static AllocatorState* g_pAllocator = nullptr;
+
+struct ThreadCache
+{
+	FreeBlock* pFree[ALLOCATOR_CLASS_COUNT] = {};
+	uint32_t nCount[ALLOCATOR_CLASS_COUNT] = {};
+
+	~ThreadCache();
+};
+
+static uint32_t GetThreadCacheLimit(uint32_t nClass)
+{
+	size_t nBlockSize = GetClassSize(nClass) + sizeof(BlockHeader);
+	return static_cast<uint32_t>(std::max<size_t>(ALLOCATOR_THREAD_CACHE_BYTES / nBlockSize, 4));
+}
+
+// Moves nCount blocks from the cache into the shared pool
+static void FlushThreadCache(ThreadCache& cache, uint32_t nClass, uint32_t nCount)
+{
+	if (nCount == 0)
+		return;
+
+	FreeBlock* pFirst = cache.pFree[nClass];
+	FreeBlock* pLast = pFirst;
+	for (uint32_t i = 1; i < nCount; ++i)
+		pLast = pLast->pNext;
+
+	cache.pFree[nClass] = pLast->pNext;
+	cache.nCount[nClass] -= nCount;
+
+	SizeClassPool& pool = g_pAllocator->pools[nClass];
+	std::scoped_lock<std::mutex> lock(pool.mutex);
+	pLast->pNext = pool.pFree;
+	pool.pFree = pFirst;
+	pool.nFreeCount += nCount;
+}
+
+ThreadCache::~ThreadCache()
+{
+	for (uint32_t nClass = 0; nClass < ALLOCATOR_CLASS_COUNT; ++nClass)
+		FlushThreadCache(*this, nClass, nCount[nClass]);
+}
+
+static thread_local ThreadCache t_ThreadCache;
+
+// Takes up to nCount blocks from the shared pool, carving a new slab if it's empty
+static void RefillThreadCache(ThreadCache& cache, uint32_t nClass, uint32_t nCount)
+{
+	SizeClassPool& pool = g_pAllocator->pools[nClass];
+	std::scoped_lock<std::mutex> lock(pool.mutex);
+
+	if (pool.pFree == nullptr)
+	{
+		size_t nBlockSize = GetClassSize(nClass) + sizeof(BlockHeader);
+		size_t nSlabSize = std::max(ALLOCATOR_SLAB_SIZE, nBlockSize * 4);
+		uint8_t* pSlab = static_cast<uint8_t*>(malloc(nSlabSize));
+		if (pSlab == nullptr)
+			return;
+
+		{
+			std::scoped_lock<std::mutex> slabLock(g_pAllocator->slabMutex);
+			g_pAllocator->slabs.push_back(pSlab);
+		}
+		g_pAllocator->counters.nReservedBytes.fetch_add(static_cast<int64_t>(nSlabSize), std::memory_order_relaxed);
+
+		size_t nBlockCount = nSlabSize / nBlockSize;
+		for (size_t i = nBlockCount; i-- > 0; )
+		{
+			FreeBlock* pBlock = reinterpret_cast<FreeBlock*>(pSlab + i * nBlockSize);
+			pBlock->pNext = pool.pFree;
+			pool.pFree = pBlock;
+		}
+		pool.nFreeCount += static_cast<uint32_t>(nBlockCount);
+	}
+
+	while (nCount-- > 0 && pool.pFree != nullptr)
+	{
+		FreeBlock* pBlock = pool.pFree;
+		pool.pFree = pBlock->pNext;
+		--pool.nFreeCount;
+
+		pBlock->pNext = cache.pFree[nClass];
+		cache.pFree[nClass] = pBlock;
+		++cache.nCount[nClass];
+	}
+}
+
+static void* ecs_allocator_malloc(ecs_size_t size)
+{
+	return EcsAllocator::Allocate(static_cast<size_t>(size));
+}
+
+static void* ecs_allocator_calloc(ecs_size_t size)
+{
+	return EcsAllocator::AllocateZeroed(static_cast<size_t>(size));
+}
+
+static void* ecs_allocator_realloc(void* ptr, ecs_size_t size)
+{
+	return EcsAllocator::Reallocate(ptr, static_cast<size_t>(size));
+}
+
+static void ecs_allocator_free(void* ptr)
+{
+	EcsAllocator::Free(ptr);
+}
+
+void EcsAllocator::Install()
+{
+	if (g_pAllocator)
+		return;
+
+	// Memory a world already got from system heap would be freed into the pools
+	assert(ecs_os_api_malloc_count == 0 && ecs_os_api_calloc_count == 0 && "EcsAllocator installed after a flecs world was created");
+
+	g_pAllocator = new AllocatorState();
+
+	// Keep flecs defaults for everything but memory
+	ecs_os_set_api_defaults();
+	ecs_os_api_t api = ecs_os_api;
+	api.malloc_ = ecs_allocator_malloc;
+	api.calloc_ = ecs_allocator_calloc;
+	api.realloc_ = ecs_allocator_realloc;
+	api.free_ = ecs_allocator_free;
+	ecs_os_set_api(&api);
+
+	// Ignored above when os api was already set (job system thread hooks), patch in place then
+	ecs_os_api.malloc_ = ecs_allocator_malloc;
+	ecs_os_api.calloc_ = ecs_allocator_calloc;
+	ecs_os_api.realloc_ = ecs_allocator_realloc;
+	ecs_os_api.free_ = ecs_allocator_free;
+}
+
+bool EcsAllocator::IsInstalled()
+{
+	return g_pAllocator != nullptr;
+}
+
+void* EcsAllocator::Allocate(size_t nSize)
+{
+	AllocatorCounters& counters = g_pAllocator->counters;
+	counters.nAllocCount.fetch_add(1, std::memory_order_relaxed);
+	counters.nBytesAllocated.fetch_add(static_cast<int64_t>(nSize), std::memory_order_relaxed);
+
+	if (nSize > ALLOCATOR_MAX_CLASS_SIZE)
+	{
+		counters.nSystemAllocCount.fetch_add(1, std::memory_order_relaxed);
+		BlockHeader* pHeader = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + nSize));
+		if (pHeader == nullptr)
+			return nullptr;
+
+		pHeader->nClass = ALLOCATOR_SYSTEM_CLASS;
+		pHeader->nSize = static_cast<uint32_t>(nSize);
+		return pHeader + 1;
+	}
+
+	uint32_t nClass = GetSizeClass(nSize);
+	ThreadCache& cache = t_ThreadCache;
+	if (cache.pFree[nClass] == nullptr)
+	{
+		RefillThreadCache(cache, nClass, GetThreadCacheLimit(nClass) / 2);
+		if (cache.pFree[nClass] == nullptr)
+			return nullptr;
+	}
+
+	FreeBlock* pBlock = cache.pFree[nClass];
+	cache.pFree[nClass] = pBlock->pNext;
+	--cache.nCount[nClass];
+
+	BlockHeader* pHeader = reinterpret_cast<BlockHeader*>(pBlock);
+	pHeader->nClass = nClass;
+	pHeader->nSize = static_cast<uint32_t>(nSize);
+	return pHeader + 1;
+}
+
+void* EcsAllocator::AllocateZeroed(size_t nSize)
+{
+	void* pMemory = Allocate(nSize);
+	if (pMemory)
+		memset(pMemory, 0, nSize);
+	return pMemory;
+}
+
+void* EcsAllocator::Reallocate(void* pMemory, size_t nSize)
+{
+	if (pMemory == nullptr)
+		return Allocate(nSize);
+
+	BlockHeader* pHeader = static_cast<BlockHeader*>(pMemory) - 1;
+	size_t nOldSize = pHeader->nSize;
+
+	AllocatorCounters& counters = g_pAllocator->counters;
+	counters.nReallocCount.fetch_add(1, std::memory_order_relaxed);
+
+	// Still fits the same block, table columns often grow within a class
+	bool bFits = pHeader->nClass != ALLOCATOR_SYSTEM_CLASS ?
+		nSize <= ALLOCATOR_MAX_CLASS_SIZE && GetSizeClass(nSize) == pHeader->nClass :
+		nSize > ALLOCATOR_MAX_CLASS_SIZE && nSize <= nOldSize;
+	if (bFits)
+	{
+		counters.nBytesAllocated.fetch_add(static_cast<int64_t>(nSize), std::memory_order_relaxed);
+		counters.nBytesFreed.fetch_add(static_cast<int64_t>(nOldSize), std::memory_order_relaxed);
+		pHeader->nSize = static_cast<uint32_t>(nSize);
+		return pMemory;
+	}
+
+	if (pHeader->nClass == ALLOCATOR_SYSTEM_CLASS && nSize > ALLOCATOR_MAX_CLASS_SIZE)
+	{
+		counters.nBytesAllocated.fetch_add(static_cast<int64_t>(nSize), std::memory_order_relaxed);
+		counters.nBytesFreed.fetch_add(static_cast<int64_t>(nOldSize), std::memory_order_relaxed);
+		BlockHeader* pNewHeader = static_cast<BlockHeader*>(realloc(pHeader, sizeof(BlockHeader) + nSize));
+		if (pNewHeader == nullptr)
+			return nullptr;
+
+		pNewHeader->nSize = static_cast<uint32_t>(nSize);
+		return pNewHeader + 1;
+	}
+
+	// Moves between classes, Allocate and Free do the counting
+	counters.nAllocCount.fetch_sub(1, std::memory_order_relaxed);
+	counters.nFreeCount.fetch_sub(1, std::memory_order_relaxed);
+
+	void* pNewMemory = Allocate(nSize);
+	if (pNewMemory == nullptr)
+		return nullptr;
+
+	memcpy(pNewMemory, pMemory, std::min(nOldSize, nSize));
+	Free(pMemory);
+	return pNewMemory;
+}
+
+void EcsAllocator::Free(void* pMemory)
+{
+	if (pMemory == nullptr)
+		return;
+
+	BlockHeader* pHeader = static_cast<BlockHeader*>(pMemory) - 1;
+
+	AllocatorCounters& counters = g_pAllocator->counters;
+	counters.nFreeCount.fetch_add(1, std::memory_order_relaxed);
+	counters.nBytesFreed.fetch_add(static_cast<int64_t>(pHeader->nSize), std::memory_order_relaxed);
+
+	uint32_t nClass = pHeader->nClass;
+	if (nClass == ALLOCATOR_SYSTEM_CLASS)
+	{
+		free(pHeader);
+		return;
+	}
+
+	ThreadCache& cache = t_ThreadCache;
+	FreeBlock* pBlock = reinterpret_cast<FreeBlock*>(pHeader);
+	pBlock->pNext = cache.pFree[nClass];
+	cache.pFree[nClass] = pBlock;
+	++cache.nCount[nClass];
+
+	uint32_t nLimit = GetThreadCacheLimit(nClass);
+	if (cache.nCount[nClass] > nLimit)
+		FlushThreadCache(cache, nClass, nLimit / 2);
+}
+
+EcsAllocatorStats EcsAllocator::GetTotalStats()
+{
+	EcsAllocatorStats stats = {};
+	if (!g_pAllocator)
+		return stats;
+
+	const AllocatorCounters& counters = g_pAllocator->counters;
+	stats.nAllocCount = counters.nAllocCount.load(std::memory_order_relaxed);
+	stats.nReallocCount = counters.nReallocCount.load(std::memory_order_relaxed);
+	stats.nFreeCount = counters.nFreeCount.load(std::memory_order_relaxed);
+	stats.nSystemAllocCount = counters.nSystemAllocCount.load(std::memory_order_relaxed);
+	stats.nBytesAllocated = counters.nBytesAllocated.load(std::memory_order_relaxed);
+	stats.nBytesFreed = counters.nBytesFreed.load(std::memory_order_relaxed);
+	stats.nLiveBytes = stats.nBytesAllocated - stats.nBytesFreed;
+	stats.nReservedBytes = counters.nReservedBytes.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void EcsAllocator::EndFrame(float dt)
+{
+	if (!g_pAllocator)
+		return;
+
+	AllocatorState& state = *g_pAllocator;
+	EcsAllocatorStats totals = GetTotalStats();
+
+	EcsAllocatorStats& frame = state.frameStats;
+	frame.nAllocCount = totals.nAllocCount - state.lastTotals.nAllocCount;
+	frame.nReallocCount = totals.nReallocCount - state.lastTotals.nReallocCount;
+	frame.nFreeCount = totals.nFreeCount - state.lastTotals.nFreeCount;
+	frame.nSystemAllocCount = totals.nSystemAllocCount - state.lastTotals.nSystemAllocCount;
+	frame.nBytesAllocated = totals.nBytesAllocated - state.lastTotals.nBytesAllocated;
+	frame.nBytesFreed = totals.nBytesFreed - state.lastTotals.nBytesFreed;
+	frame.nLiveBytes = totals.nLiveBytes;
+	frame.nReservedBytes = totals.nReservedBytes;
+	state.lastTotals = totals;
+	++state.nFrame;
+
+	if (state.strDumpPath.empty())
+		return;
+
+	state.fTimeSinceDump += dt;
+	if (state.fTimeSinceDump < state.fDumpPeriod)
+		return;
+	state.fTimeSinceDump = 0.0f;
+
+	std::ifstream existing(state.strDumpPath);
+	bool bWriteHeader = !existing.good();
+	existing.close();
+
+	std::ofstream file(state.strDumpPath, std::ios::app);
+	if (!file.is_open())
+		return;
+
+	if (bWriteHeader)
+		file << "frame,allocs,reallocs,frees,system_allocs,bytes_allocated,bytes_freed,live_bytes,reserved_bytes\n";
+
+	file << state.nFrame << ','
+		<< frame.nAllocCount << ','
+		<< frame.nReallocCount << ','
+		<< frame.nFreeCount << ','
+		<< frame.nSystemAllocCount << ','
+		<< frame.nBytesAllocated << ','
+		<< frame.nBytesFreed << ','
+		<< frame.nLiveBytes << ','
+		<< frame.nReservedBytes << '\n';
+}
+
+EcsAllocatorStats EcsAllocator::GetFrameStats()
+{
+	return g_pAllocator ? g_pAllocator->frameStats : EcsAllocatorStats{};
+}
+
+void EcsAllocator::EnableDump(const std::string& strPath, float fPeriod)
+{
+	if (!g_pAllocator)
+		return;
+
+	g_pAllocator->strDumpPath = strPath;
+	g_pAllocator->fDumpPeriod = fPeriod;
+	g_pAllocator->fTimeSinceDump = 0.0f;
+}
+
+void EcsAllocator::DisableDump()
+{
+	if (g_pAllocator)
+		g_pAllocator->strDumpPath.clear();
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+struct EcsAllocatorStats
+{
+	int64_t nAllocCount;
+	int64_t nReallocCount;
+	int64_t nFreeCount;
+	// Requests above the largest size class, served by system heap
+	int64_t nSystemAllocCount;
+	int64_t nBytesAllocated;
+	int64_t nBytesFreed;
+	// Totals only, not reset every frame
+	int64_t nLiveBytes;
+	int64_t nReservedBytes;
+};
+
+// Size class pool allocator behind flecs os api malloc/realloc/calloc/free.
+// Blocks are carved from slabs that are never returned to the system, every thread
+// keeps a small cache per size class and only goes to the shared pool in batches.
+// Pools live until process exit, so memory flecs frees late is still valid.
+class EcsAllocator
+{
+public:
+	// Must be called before the first flecs world is created
+	static void Install();
+	static bool IsInstalled();
+
+	static void* Allocate(size_t nSize);
+	static void* AllocateZeroed(size_t nSize);
+	static void* Reallocate(void* pMemory, size_t nSize);
+	static void Free(void* pMemory);
+
+	static EcsAllocatorStats GetTotalStats();
+	// Counters since previous call become last frame stats
+	static void EndFrame(float dt);
+	static EcsAllocatorStats GetFrameStats();
+
+	// Appends a csv line per period
+	static void EnableDump(const std::string& strPath, float fPeriod);
+	static void DisableDump();
+};
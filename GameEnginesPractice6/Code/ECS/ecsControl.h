@@ -1,5 +1,6 @@
 #pragma once
 #include "flecs.h"
+#include "ecsScheduler.h"
 #include <OgreVector3.h>
 
 struct Controllable {};
@@ -9,5 +10,5 @@ struct CameraPosition : public Ogre::Vector3
 	using Ogre::Vector3::Vector3;
 };
 
-void register_ecs_control_systems(flecs::world* ecs);
+void register_ecs_control_systems(flecs::world* ecs, EcsScheduler* pScheduler);
 
@@ -0,0 +1,166 @@
+#include "ecsDeterminism.h"
+
+#include <iomanip>
+#include <sstream>
+
+uint64_t CounterRng::Mix(uint64_t nKey, uint64_t nCounter)
+{
+	// splitmix64 finalizer over key and weyl-spaced counter
+	uint64_t z = nKey ^ (nCounter * 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	z = z ^ (z >> 31);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	return z ^ (z >> 27);
+}
+
+float CounterRng::Uniform(uint64_t nKey, uint64_t nCounter, float fFrom, float fTo)
+{
+	// Top 24 bits fill float mantissa exactly
+	float fUnit = static_cast<float>(Mix(nKey, nCounter) >> 40) * (1.0f / 16777216.0f);
+	return fFrom + fUnit * (fTo - fFrom);
+}
+
+DeterministicSimulation::DeterministicSimulation(flecs::world* ecs, uint64_t nSeed) :
+	m_pEcs(ecs),
+	m_nSeed(nSeed),
+	m_nTick(0),
+	m_nLastChecksum(0)
+{
+	crc32::generate_table(m_CrcTable);
+}
+
+DeterministicSimulation::~DeterministicSimulation()
+{
+	DisableChecksumLog();
+}
+
+uint64_t DeterministicSimulation::GetSeed() const
+{
+	return m_nSeed;
+}
+
+uint64_t DeterministicSimulation::GetTick() const
+{
+	return m_nTick;
+}
+
+float DeterministicSimulation::RandomFloat(flecs::entity_t entity, uint32_t nDraw, float fFrom, float fTo) const
+{
+	uint64_t nKey = CounterRng::Mix(m_nSeed, entity);
+	return CounterRng::Uniform(nKey, (m_nTick << 32) | nDraw, fFrom, fTo);
+}
+
+bool DeterministicSimulation::EnableChecksumLog(const std::string& strPath, float fTimestep)
+{
+	DisableChecksumLog();
+
+	m_ChecksumLog.open(strPath, std::ios::out | std::ios::trunc);
+	if (!m_ChecksumLog.is_open())
+		return false;
+
+	m_ChecksumLog << "seed " << m_nSeed << " timestep " << std::setprecision(9) << fTimestep << '\n';
+	return true;
+}
+
+void DeterministicSimulation::DisableChecksumLog()
+{
+	if (m_ChecksumLog.is_open())
+		m_ChecksumLog.close();
+}
+
+void DeterministicSimulation::EndTick()
+{
+	uint32_t nTotal = 0;
+	for (const ChecksumComponent& component : m_Components)
+	{
+		uint32_t nChecksum = ComputeChecksum(component);
+		nTotal = crc32::update(m_CrcTable, nTotal, &nChecksum, sizeof(nChecksum));
+
+		if (m_ChecksumLog.is_open())
+			m_ChecksumLog << m_nTick << ' ' << component.strName << ' ' << std::hex << std::setw(8) << std::setfill('0') << nChecksum << std::dec << '\n';
+	}
+	m_nLastChecksum = nTotal;
+
+	++m_nTick;
+}
+
+uint32_t DeterministicSimulation::GetLastChecksum() const
+{
+	return m_nLastChecksum;
+}
+
+uint32_t DeterministicSimulation::ComputeChecksum(const ChecksumComponent& component)
+{
+	uint32_t nChecksum = 0;
+
+	// Tables and rows are visited in creation order, which is the same for identical runs
+	component.query.iter([&](flecs::iter& it)
+		{
+			flecs::unsafe_column column = it.term(1);
+			for (auto i : it)
+			{
+				flecs::entity_t entity = it.entity(i).id();
+				nChecksum = crc32::update(m_CrcTable, nChecksum, &entity, sizeof(entity));
+				nChecksum = crc32::update(m_CrcTable, nChecksum, column[i], component.nSize);
+			}
+		});
+
+	return nChecksum;
+}
+
+bool DiffChecksumLogs(const std::string& strPathA, const std::string& strPathB, ChecksumLogDiff& diff)
+{
+	diff.bDiverged = false;
+	diff.nTick = 0;
+	diff.strComponent.clear();
+	diff.strMessage.clear();
+
+	std::ifstream fileA(strPathA);
+	std::ifstream fileB(strPathB);
+	if (!fileA.is_open() || !fileB.is_open())
+	{
+		diff.strMessage = "can't open " + (fileA.is_open() ? strPathB : strPathA);
+		return false;
+	}
+
+	std::string strLineA, strLineB;
+	std::getline(fileA, strLineA);
+	std::getline(fileB, strLineB);
+	if (strLineA != strLineB)
+		diff.strMessage = "headers differ: '" + strLineA + "' vs '" + strLineB + "'. ";
+
+	while (true)
+	{
+		bool bHasA = static_cast<bool>(std::getline(fileA, strLineA));
+		bool bHasB = static_cast<bool>(std::getline(fileB, strLineB));
+		if (!bHasA && !bHasB)
+			break;
+
+		uint64_t nTickA = 0, nTickB = 0;
+		std::string strComponentA, strComponentB, strChecksumA, strChecksumB;
+		std::istringstream(strLineA) >> nTickA >> strComponentA >> strChecksumA;
+		std::istringstream(strLineB) >> nTickB >> strComponentB >> strChecksumB;
+
+		if (!bHasA || !bHasB)
+		{
+			diff.bDiverged = true;
+			diff.nTick = bHasA ? nTickA : nTickB;
+			diff.strMessage += std::string(bHasA ? strPathB : strPathA) + " ends before tick " + std::to_string(diff.nTick);
+			return true;
+		}
+
+		if (nTickA != nTickB || strComponentA != strComponentB || strChecksumA != strChecksumB)
+		{
+			diff.bDiverged = true;
+			diff.nTick = nTickA;
+			diff.strComponent = strComponentA;
+			diff.strMessage += "first divergence at tick " + std::to_string(nTickA) + ", component " + strComponentA +
+				" (" + strChecksumA + " vs " + strChecksumB + ")";
+			return true;
+		}
+	}
+
+	diff.strMessage += "logs match";
+	return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include "flecs.h"
+#include "crc32.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+// Counter based generator: every value is a pure function of (key, counter),
+// so results don't depend on call order or on the thread drawing them.
+struct CounterRng
+{
+	static uint64_t Mix(uint64_t nKey, uint64_t nCounter);
+	// Uniform in [fFrom, fTo)
+	static float Uniform(uint64_t nKey, uint64_t nCounter, float fFrom, float fTo);
+};
+
+// Seed, tick counter and per tick checksums of simulation state.
+// Random values are keyed by seed, entity and tick, so two runs with the same
+// seed, timestep and inputs produce the same values regardless of scheduling.
+class DeterministicSimulation
+{
+public:
+	DeterministicSimulation(flecs::world* ecs, uint64_t nSeed);
+	~DeterministicSimulation();
+	DeterministicSimulation(const DeterministicSimulation&) = delete;
+	DeterministicSimulation& operator=(const DeterministicSimulation&) = delete;
+
+	uint64_t GetSeed() const;
+	uint64_t GetTick() const;
+
+	// Same entity, tick and draw always give the same value. Safe from any thread.
+	float RandomFloat(flecs::entity_t entity, uint32_t nDraw, float fFrom, float fTo) const;
+
+	// Raw bytes of T and ids of entities holding it go into the checksum
+	template <typename T>
+	void AddChecksumComponent(const char* szName)
+	{
+		ChecksumComponent component;
+		component.strName = szName;
+		component.nSize = sizeof(T);
+		component.query = m_pEcs->query_builder<>()
+			.term<T>()
+			.build();
+		m_Components.push_back(component);
+	}
+
+	// Log has a header line with the seed and one "tick component crc" line per component per tick
+	bool EnableChecksumLog(const std::string& strPath, float fTimestep);
+	void DisableChecksumLog();
+
+	// Call once per tick outside of ecs progress: checksums finished tick and moves to the next one
+	void EndTick();
+	uint32_t GetLastChecksum() const;
+
+private:
+	struct ChecksumComponent
+	{
+		std::string strName;
+		size_t nSize;
+		flecs::query<> query;
+	};
+
+	flecs::world* m_pEcs;
+	uint64_t m_nSeed;
+	uint64_t m_nTick;
+
+	std::vector<ChecksumComponent> m_Components;
+	uint32_t m_CrcTable[256];
+	uint32_t m_nLastChecksum;
+
+	std::ofstream m_ChecksumLog;
+
+	uint32_t ComputeChecksum(const ChecksumComponent& component);
+};
+
+struct DeterministicSimulationPtr
+{
+	DeterministicSimulation* ptr;
+};
+
+struct ChecksumLogDiff
+{
+	bool bDiverged;
+	uint64_t nTick;
+	std::string strComponent;
+	std::string strMessage;
+};
+
+// Walks two checksum logs side by side and reports the first tick and component that differ.
+// Returns false if a log can't be read.
+bool DiffChecksumLogs(const std::string& strPathA, const std::string& strPathB, ChecksumLogDiff& diff);
@@ -0,0 +1,631 @@
+#include "ecsGravity.h"
+#include "ecsParallel.h"
+#include "../ProjectDefines.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#endif
+
+// Leaves are summed directly, deeper trees cost more than they save
+static const uint32_t NBODY_LEAF_SIZE = 8;
+// Coincident bodies would split forever otherwise
+static const uint32_t NBODY_MAX_DEPTH = 32;
+// Below this many bodies per thread running on one thread is faster
+static const size_t NBODY_MIN_BODIES_PER_THREAD = 256;
+// Bodies per tile of the all-pairs kernel, a tile pair fits in L1
+static const uint32_t NBODY_TILE_SIZE = 128;
+static const size_t NBODY_MIN_TILE_PAIRS_PER_THREAD = 4;
+// Padding bodies are massless and parked far away, so they add nothing
+static const float NBODY_PADDING_DISTANCE = 1e15f;
+
+NBodySolver::NBodySolver(flecs::world* ecs, uint32_t nThreadCount) :
+	m_pEcs(ecs),
+	m_nThreadCount(std::max(nThreadCount, 1u)),
+	m_fGravConst(NBODY_GRAV_CONST),
+	m_fTheta(NBODY_OPENING_ANGLE),
+	m_fSoftening(NBODY_SOFTENING),
+	m_nExactThreshold(NBODY_EXACT_THRESHOLD),
+	m_eIntegrator(NBODY_INTEGRATOR)
+{
+	m_bodyQuery = m_pEcs->query<Position, const Mass, Velocity*>();
+}
+
+NBodySolver::~NBodySolver()
+{
+
+}
+
+void NBodySolver::SetGravConst(float fGravConst)
+{
+	m_fGravConst = fGravConst;
+}
+
+void NBodySolver::SetOpeningAngle(float fTheta)
+{
+	m_fTheta = fTheta;
+}
+
+void NBodySolver::SetSoftening(float fSoftening)
+{
+	m_fSoftening = fSoftening;
+}
+
+void NBodySolver::SetExactThreshold(uint32_t nExactThreshold)
+{
+	m_nExactThreshold = nExactThreshold;
+}
+
+void NBodySolver::SetIntegrator(EIntegrator eIntegrator)
+{
+	m_eIntegrator = eIntegrator;
+}
+
+EIntegrator NBodySolver::GetIntegrator() const
+{
+	return m_eIntegrator;
+}
+
+void NBodySolver::Step(float dt)
+{
+	m_Positions.clear();
+	m_Velocities.clear();
+	m_Masses.clear();
+	m_Movable.clear();
+	m_PositionPtrs.clear();
+	m_VelocityPtrs.clear();
+
+	// Component pointers stay valid until the end of step, nothing is added or removed meanwhile
+	m_bodyQuery.each([&](Position& pos, const Mass& mass, Velocity* pVel)
+		{
+			m_Positions.push_back(pos);
+			m_Velocities.push_back(pVel ? Ogre::Vector3(*pVel) : Ogre::Vector3::ZERO);
+			m_Masses.push_back(mass.val);
+			m_Movable.push_back(pVel ? 1 : 0);
+			m_PositionPtrs.push_back(&pos);
+			m_VelocityPtrs.push_back(pVel);
+		});
+
+	if (m_Positions.empty())
+		return;
+
+	Integrate(m_Positions, m_Velocities, m_Masses, m_Movable, dt);
+
+	for (size_t i = 0; i < m_Positions.size(); ++i)
+	{
+		if (!m_Movable[i])
+			continue;
+
+		static_cast<Ogre::Vector3&>(*m_PositionPtrs[i]) = m_Positions[i];
+		static_cast<Ogre::Vector3&>(*m_VelocityPtrs[i]) = m_Velocities[i];
+	}
+}
+
+void NBodySolver::Drift(std::vector<Ogre::Vector3>& positions, const std::vector<Ogre::Vector3>& velocities,
+	const std::vector<uint8_t>& movable, float dt) const
+{
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		if (movable[i])
+			positions[i] += velocities[i] * dt;
+	}
+}
+
+void NBodySolver::Kick(const std::vector<Ogre::Vector3>& positions, std::vector<Ogre::Vector3>& velocities,
+	const std::vector<float>& masses, const std::vector<uint8_t>& movable, float dt)
+{
+	if (positions.size() < 2)
+		return;
+
+	ComputeAccelerations(positions, masses, m_Accelerations);
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		if (movable[i])
+			velocities[i] += m_Accelerations[i] * dt;
+	}
+}
+
+void NBodySolver::Integrate(std::vector<Ogre::Vector3>& positions, std::vector<Ogre::Vector3>& velocities,
+	const std::vector<float>& masses, const std::vector<uint8_t>& movable, float dt)
+{
+	switch (m_eIntegrator)
+	{
+	case eINT_SymplecticEuler:
+	{
+		Kick(positions, velocities, masses, movable, dt);
+		Drift(positions, velocities, movable, dt);
+		break;
+	}
+	case eINT_Leapfrog:
+	{
+		// Drift-kick-drift, one force evaluation per step
+		Drift(positions, velocities, movable, 0.5f * dt);
+		Kick(positions, velocities, masses, movable, dt);
+		Drift(positions, velocities, movable, 0.5f * dt);
+		break;
+	}
+	case eINT_Yoshida4:
+	{
+		// Three leapfrog substeps with Yoshida's weights, the middle one goes backwards
+		const double fCubeRootTwo = std::cbrt(2.0);
+		const float w1 = static_cast<float>(1.0 / (2.0 - fCubeRootTwo));
+		const float w0 = static_cast<float>(-fCubeRootTwo / (2.0 - fCubeRootTwo));
+		const float c1 = 0.5f * w1;
+		const float c2 = 0.5f * (w0 + w1);
+
+		Drift(positions, velocities, movable, c1 * dt);
+		Kick(positions, velocities, masses, movable, w1 * dt);
+		Drift(positions, velocities, movable, c2 * dt);
+		Kick(positions, velocities, masses, movable, w0 * dt);
+		Drift(positions, velocities, movable, c2 * dt);
+		Kick(positions, velocities, masses, movable, w1 * dt);
+		Drift(positions, velocities, movable, c1 * dt);
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+double NBodySolver::ComputeTotalEnergy(const std::vector<Ogre::Vector3>& positions, const std::vector<Ogre::Vector3>& velocities,
+	const std::vector<float>& masses) const
+{
+	double fKinetic = 0.0;
+	double fPotential = 0.0;
+	double fSofteningSq = static_cast<double>(m_fSoftening) * m_fSoftening;
+
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		fKinetic += 0.5 * masses[i] * velocities[i].squaredLength();
+
+		for (size_t j = i + 1; j < positions.size(); ++j)
+		{
+			double fDistanceSq = positions[i].squaredDistance(positions[j]) + fSofteningSq;
+			fPotential -= m_fGravConst * static_cast<double>(masses[i]) * masses[j] / std::sqrt(fDistanceSq);
+		}
+	}
+
+	return fKinetic + fPotential;
+}
+
+void NBodySolver::ComputeAccelerations(const std::vector<Ogre::Vector3>& positions, const std::vector<float>& masses,
+	std::vector<Ogre::Vector3>& accelerations)
+{
+	if (positions.size() < m_nExactThreshold)
+		ComputeExact(positions, masses, accelerations);
+	else
+		ComputeBarnesHut(positions, masses, accelerations);
+}
+
+void NBodySolver::ComputeExact(const std::vector<Ogre::Vector3>& positions, const std::vector<float>& masses,
+	std::vector<Ogre::Vector3>& accelerations)
+{
+	uint32_t nCount = static_cast<uint32_t>(positions.size());
+	uint32_t nTiles = (nCount + NBODY_TILE_SIZE - 1) / NBODY_TILE_SIZE;
+	uint32_t nPadded = nTiles * NBODY_TILE_SIZE;
+
+	m_SoA.x.resize(nPadded);
+	m_SoA.y.resize(nPadded);
+	m_SoA.z.resize(nPadded);
+	m_SoA.m.resize(nPadded);
+	for (uint32_t i = 0; i < nPadded; ++i)
+	{
+		bool bPadding = i >= nCount;
+		m_SoA.x[i] = bPadding ? NBODY_PADDING_DISTANCE * (i - nCount + 1) : positions[i].x;
+		m_SoA.y[i] = bPadding ? NBODY_PADDING_DISTANCE : positions[i].y;
+		m_SoA.z[i] = bPadding ? NBODY_PADDING_DISTANCE : positions[i].z;
+		m_SoA.m[i] = bPadding ? 0.0f : masses[i];
+	}
+
+	m_TilePairs.clear();
+	for (uint32_t nTileI = 0; nTileI < nTiles; ++nTileI)
+		for (uint32_t nTileJ = nTileI; nTileJ < nTiles; ++nTileJ)
+			m_TilePairs.push_back(std::make_pair(nTileI, nTileJ));
+
+	// Both bodies of a pair are written, so every thread accumulates
+	// into its own buffer and buffers are summed at the end
+	uint32_t nThreadCount = static_cast<uint32_t>(std::min<size_t>(m_nThreadCount,
+		std::max<size_t>(m_TilePairs.size() / NBODY_MIN_TILE_PAIRS_PER_THREAD, 1)));
+	m_ThreadAccelerations.resize(nThreadCount);
+	for (SoABuffer& buffer : m_ThreadAccelerations)
+	{
+		buffer.x.assign(nPadded, 0.0f);
+		buffer.y.assign(nPadded, 0.0f);
+		buffer.z.assign(nPadded, 0.0f);
+	}
+
+	parallel_for(m_TilePairs.size(), NBODY_MIN_TILE_PAIRS_PER_THREAD, nThreadCount, [&](uint32_t nThread, size_t nBegin, size_t nEnd)
+		{
+			for (size_t nPair = nBegin; nPair < nEnd; ++nPair)
+				ComputeTilePair(m_TilePairs[nPair].first, m_TilePairs[nPair].second, nCount, m_ThreadAccelerations[nThread]);
+		});
+
+	accelerations.resize(nCount);
+	for (uint32_t i = 0; i < nCount; ++i)
+	{
+		Ogre::Vector3 vAcceleration = Ogre::Vector3::ZERO;
+		for (const SoABuffer& buffer : m_ThreadAccelerations)
+			vAcceleration += Ogre::Vector3(buffer.x[i], buffer.y[i], buffer.z[i]);
+		accelerations[i] = vAcceleration * m_fGravConst;
+	}
+}
+
+// Accumulates a = sum(m_j * d / (|d|^2 + eps^2)^1.5) for both tiles, G is applied by the caller.
+// Off diagonal pairs are computed once and applied to both bodies with opposite signs.
+void NBodySolver::ComputeTilePair(uint32_t nTileI, uint32_t nTileJ, uint32_t nCount, SoABuffer& accelerations) const
+{
+	const float* px = m_SoA.x.data();
+	const float* py = m_SoA.y.data();
+	const float* pz = m_SoA.z.data();
+	const float* pm = m_SoA.m.data();
+	float* ax = accelerations.x.data();
+	float* ay = accelerations.y.data();
+	float* az = accelerations.z.data();
+
+	uint32_t nBeginI = nTileI * NBODY_TILE_SIZE;
+	uint32_t nBeginJ = nTileJ * NBODY_TILE_SIZE;
+	float fSofteningSq = m_fSoftening * m_fSoftening;
+
+	if (nTileI == nTileJ)
+	{
+		// Diagonal tile is a small triangle, plain scalar loop.
+		// Padding is massless, so it is left out of the last tile
+		uint32_t nEndI = std::min(nBeginI + NBODY_TILE_SIZE, nCount);
+		for (uint32_t i = nBeginI; i < nEndI; ++i)
+		{
+			for (uint32_t j = i + 1; j < nEndI; ++j)
+			{
+				float dx = px[j] - px[i];
+				float dy = py[j] - py[i];
+				float dz = pz[j] - pz[i];
+				float fInvDistance = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + fSofteningSq);
+				float fInvDistanceCube = fInvDistance * fInvDistance * fInvDistance;
+
+				float fPullI = pm[j] * fInvDistanceCube;
+				float fPullJ = pm[i] * fInvDistanceCube;
+				ax[i] += dx * fPullI; ay[i] += dy * fPullI; az[i] += dz * fPullI;
+				ax[j] -= dx * fPullJ; ay[j] -= dy * fPullJ; az[j] -= dz * fPullJ;
+			}
+		}
+		return;
+	}
+
+#if defined(_M_X64) || defined(__SSE2__)
+	const __m128 vSofteningSq = _mm_set1_ps(fSofteningSq);
+	const __m128 vHalf = _mm_set1_ps(0.5f);
+	const __m128 vThreeHalves = _mm_set1_ps(1.5f);
+
+	for (uint32_t i = nBeginI; i < nBeginI + NBODY_TILE_SIZE; ++i)
+	{
+		const __m128 xi = _mm_set1_ps(px[i]);
+		const __m128 yi = _mm_set1_ps(py[i]);
+		const __m128 zi = _mm_set1_ps(pz[i]);
+		const __m128 mi = _mm_set1_ps(pm[i]);
+		__m128 axi = _mm_setzero_ps();
+		__m128 ayi = _mm_setzero_ps();
+		__m128 azi = _mm_setzero_ps();
+
+		for (uint32_t j = nBeginJ; j < nBeginJ + NBODY_TILE_SIZE; j += 4)
+		{
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(px + j), xi);
+			__m128 dy = _mm_sub_ps(_mm_loadu_ps(py + j), yi);
+			__m128 dz = _mm_sub_ps(_mm_loadu_ps(pz + j), zi);
+
+			__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)),
+				_mm_add_ps(_mm_mul_ps(dz, dz), vSofteningSq));
+
+			// Hardware estimate plus one Newton-Raphson step, ~22 bits
+			__m128 inv = _mm_rsqrt_ps(r2);
+			inv = _mm_mul_ps(inv, _mm_sub_ps(vThreeHalves, _mm_mul_ps(_mm_mul_ps(vHalf, r2), _mm_mul_ps(inv, inv))));
+			__m128 inv3 = _mm_mul_ps(_mm_mul_ps(inv, inv), inv);
+
+			__m128 pullI = _mm_mul_ps(_mm_loadu_ps(pm + j), inv3);
+			axi = _mm_add_ps(axi, _mm_mul_ps(dx, pullI));
+			ayi = _mm_add_ps(ayi, _mm_mul_ps(dy, pullI));
+			azi = _mm_add_ps(azi, _mm_mul_ps(dz, pullI));
+
+			__m128 pullJ = _mm_mul_ps(mi, inv3);
+			_mm_storeu_ps(ax + j, _mm_sub_ps(_mm_loadu_ps(ax + j), _mm_mul_ps(dx, pullJ)));
+			_mm_storeu_ps(ay + j, _mm_sub_ps(_mm_loadu_ps(ay + j), _mm_mul_ps(dy, pullJ)));
+			_mm_storeu_ps(az + j, _mm_sub_ps(_mm_loadu_ps(az + j), _mm_mul_ps(dz, pullJ)));
+		}
+
+		alignas(16) float sums[3][4];
+		_mm_store_ps(sums[0], axi);
+		_mm_store_ps(sums[1], ayi);
+		_mm_store_ps(sums[2], azi);
+		ax[i] += sums[0][0] + sums[0][1] + sums[0][2] + sums[0][3];
+		ay[i] += sums[1][0] + sums[1][1] + sums[1][2] + sums[1][3];
+		az[i] += sums[2][0] + sums[2][1] + sums[2][2] + sums[2][3];
+	}
+#else
+	for (uint32_t i = nBeginI; i < nBeginI + NBODY_TILE_SIZE; ++i)
+	{
+		float axi = 0.0f, ayi = 0.0f, azi = 0.0f;
+		for (uint32_t j = nBeginJ; j < nBeginJ + NBODY_TILE_SIZE; ++j)
+		{
+			float dx = px[j] - px[i];
+			float dy = py[j] - py[i];
+			float dz = pz[j] - pz[i];
+			float fInvDistance = 1.0f / std::sqrt(dx * dx + dy * dy + dz * dz + fSofteningSq);
+			float fInvDistanceCube = fInvDistance * fInvDistance * fInvDistance;
+
+			float fPullI = pm[j] * fInvDistanceCube;
+			float fPullJ = pm[i] * fInvDistanceCube;
+			axi += dx * fPullI; ayi += dy * fPullI; azi += dz * fPullI;
+			ax[j] -= dx * fPullJ; ay[j] -= dy * fPullJ; az[j] -= dz * fPullJ;
+		}
+		ax[i] += axi; ay[i] += ayi; az[i] += azi;
+	}
+#endif
+}
+
+void NBodySolver::ComputeBarnesHut(const std::vector<Ogre::Vector3>& positions, const std::vector<float>& masses,
+	std::vector<Ogre::Vector3>& accelerations)
+{
+	accelerations.resize(positions.size());
+
+	BuildTree(positions, masses);
+
+	parallel_for(positions.size(), NBODY_MIN_BODIES_PER_THREAD, m_nThreadCount, [&](uint32_t, size_t nBegin, size_t nEnd)
+		{
+			for (size_t i = nBegin; i < nEnd; ++i)
+				accelerations[i] = AccelerationAt(static_cast<uint32_t>(i), positions, masses);
+		});
+}
+
+void NBodySolver::PartitionOctants(const std::vector<Ogre::Vector3>& positions, std::vector<uint32_t>& scratch,
+	uint32_t nFirst, uint32_t nCount, const Ogre::Vector3& vCenter, uint32_t octantStart[9])
+{
+	auto octantOf = [&](uint32_t nBody)
+	{
+		const Ogre::Vector3& vPos = positions[nBody];
+		return (vPos.x >= vCenter.x ? 1 : 0) | (vPos.y >= vCenter.y ? 2 : 0) | (vPos.z >= vCenter.z ? 4 : 0);
+	};
+
+	uint32_t counts[8] = {};
+	for (uint32_t i = nFirst; i < nFirst + nCount; ++i)
+		++counts[octantOf(m_Order[i])];
+
+	octantStart[0] = nFirst;
+	for (int nOctant = 0; nOctant < 8; ++nOctant)
+		octantStart[nOctant + 1] = octantStart[nOctant] + counts[nOctant];
+
+	// Counting sort through scratch keeps every octant contiguous in m_Order
+	uint32_t fill[8];
+	std::copy(octantStart, octantStart + 8, fill);
+	for (uint32_t i = nFirst; i < nFirst + nCount; ++i)
+	{
+		uint32_t nBody = m_Order[i];
+		scratch[fill[octantOf(nBody)]++] = nBody;
+	}
+	std::copy(scratch.begin() + nFirst, scratch.begin() + nFirst + nCount, m_Order.begin() + nFirst);
+}
+
+int32_t NBodySolver::BuildNode(std::vector<Node>& nodes, std::vector<uint32_t>& scratch,
+	const std::vector<Ogre::Vector3>& positions, const std::vector<float>& masses,
+	uint32_t nFirst, uint32_t nCount, const Ogre::Vector3& vCenter, float fHalfSize, uint32_t nDepth)
+{
+	int32_t nNode = static_cast<int32_t>(nodes.size());
+	nodes.push_back(Node());
+	{
+		Node& node = nodes[nNode];
+		node.vCenter = vCenter;
+		node.fHalfSize = fHalfSize;
+		node.nFirst = nFirst;
+		node.nCount = nCount;
+		std::fill(node.nChildren, node.nChildren + 8, -1);
+	}
+
+	Ogre::Vector3 vMoment = Ogre::Vector3::ZERO;
+	float fMass = 0.0f;
+
+	if (nCount <= NBODY_LEAF_SIZE || nDepth >= NBODY_MAX_DEPTH)
+	{
+		for (uint32_t i = nFirst; i < nFirst + nCount; ++i)
+		{
+			vMoment += positions[m_Order[i]] * masses[m_Order[i]];
+			fMass += masses[m_Order[i]];
+		}
+		nodes[nNode].bLeaf = true;
+	}
+	else
+	{
+		uint32_t octantStart[9];
+		PartitionOctants(positions, scratch, nFirst, nCount, vCenter, octantStart);
+
+		float fChildHalfSize = fHalfSize * 0.5f;
+		for (int nOctant = 0; nOctant < 8; ++nOctant)
+		{
+			uint32_t nChildCount = octantStart[nOctant + 1] - octantStart[nOctant];
+			if (nChildCount == 0)
+				continue;
+
+			Ogre::Vector3 vChildCenter(
+				vCenter.x + ((nOctant & 1) ? fChildHalfSize : -fChildHalfSize),
+				vCenter.y + ((nOctant & 2) ? fChildHalfSize : -fChildHalfSize),
+				vCenter.z + ((nOctant & 4) ? fChildHalfSize : -fChildHalfSize));
+
+			// nodes may reallocate, don't hold references across this call
+			int32_t nChild = BuildNode(nodes, scratch, positions, masses,
+				octantStart[nOctant], nChildCount, vChildCenter, fChildHalfSize, nDepth + 1);
+			nodes[nNode].nChildren[nOctant] = nChild;
+
+			vMoment += nodes[nChild].vCenterOfMass * nodes[nChild].fMass;
+			fMass += nodes[nChild].fMass;
+		}
+		nodes[nNode].bLeaf = false;
+	}
+
+	nodes[nNode].fMass = fMass;
+	nodes[nNode].vCenterOfMass = fMass > 0.0f ? vMoment / fMass : vCenter;
+
+	return nNode;
+}
+
+void NBodySolver::BuildTree(const std::vector<Ogre::Vector3>& positions, const std::vector<float>& masses)
+{
+	uint32_t nCount = static_cast<uint32_t>(positions.size());
+
+	Ogre::Vector3 vMin = positions[0];
+	Ogre::Vector3 vMax = positions[0];
+	for (const Ogre::Vector3& vPos : positions)
+	{
+		vMin.makeFloor(vPos);
+		vMax.makeCeil(vPos);
+	}
+
+	Ogre::Vector3 vCenter = (vMin + vMax) * 0.5f;
+	Ogre::Vector3 vExtent = vMax - vMin;
+	float fHalfSize = std::max(std::max(vExtent.x, vExtent.y), std::max(vExtent.z, 1e-3f)) * 0.5f * 1.001f;
+
+	m_Order.resize(nCount);
+	for (uint32_t i = 0; i < nCount; ++i)
+		m_Order[i] = i;
+
+	std::vector<uint32_t> scratch(nCount);
+
+	// Root is split here and its eight subtrees are built as jobs
+	// into separate node arrays, then appended with child indices shifted
+	uint32_t octantStart[9];
+	PartitionOctants(positions, scratch, 0, nCount, vCenter, octantStart);
+
+	std::vector<Node> subtrees[8];
+	int32_t subtreeRoots[8];
+	float fChildHalfSize = fHalfSize * 0.5f;
+
+	auto buildOctant = [&](int nOctant)
+	{
+		subtreeRoots[nOctant] = -1;
+		uint32_t nChildCount = octantStart[nOctant + 1] - octantStart[nOctant];
+		if (nChildCount == 0)
+			return;
+
+		Ogre::Vector3 vChildCenter(
+			vCenter.x + ((nOctant & 1) ? fChildHalfSize : -fChildHalfSize),
+			vCenter.y + ((nOctant & 2) ? fChildHalfSize : -fChildHalfSize),
+			vCenter.z + ((nOctant & 4) ? fChildHalfSize : -fChildHalfSize));
+
+		subtrees[nOctant].reserve(2 * nChildCount / NBODY_LEAF_SIZE + 1);
+		subtreeRoots[nOctant] = BuildNode(subtrees[nOctant], scratch, positions, masses,
+			octantStart[nOctant], nChildCount, vChildCenter, fChildHalfSize, 1);
+	};
+
+	// Octants touch disjoint ranges of m_Order and scratch, so they don't race
+	uint32_t nOctantJobs = nCount >= NBODY_MIN_BODIES_PER_THREAD ? std::min(m_nThreadCount, 8u) : 1;
+	parallel_for(8, 1, nOctantJobs, [&](uint32_t, size_t nBegin, size_t nEnd)
+	{
+		for (size_t nOctant = nBegin; nOctant < nEnd; ++nOctant)
+			buildOctant(static_cast<int>(nOctant));
+	});
+
+	m_Nodes.clear();
+	m_Nodes.push_back(Node());
+	Node root;
+	root.vCenter = vCenter;
+	root.fHalfSize = fHalfSize;
+	root.nFirst = 0;
+	root.nCount = nCount;
+	root.bLeaf = false;
+
+	Ogre::Vector3 vMoment = Ogre::Vector3::ZERO;
+	float fMass = 0.0f;
+	for (int nOctant = 0; nOctant < 8; ++nOctant)
+	{
+		root.nChildren[nOctant] = -1;
+		if (subtreeRoots[nOctant] < 0)
+			continue;
+
+		int32_t nOffset = static_cast<int32_t>(m_Nodes.size());
+		for (Node& node : subtrees[nOctant])
+		{
+			for (int32_t& nChild : node.nChildren)
+			{
+				if (nChild >= 0)
+					nChild += nOffset;
+			}
+		}
+		m_Nodes.insert(m_Nodes.end(), subtrees[nOctant].begin(), subtrees[nOctant].end());
+
+		root.nChildren[nOctant] = subtreeRoots[nOctant] + nOffset;
+		const Node& child = m_Nodes[root.nChildren[nOctant]];
+		vMoment += child.vCenterOfMass * child.fMass;
+		fMass += child.fMass;
+	}
+	root.fMass = fMass;
+	root.vCenterOfMass = fMass > 0.0f ? vMoment / fMass : vCenter;
+	m_Nodes[0] = root;
+}
+
+Ogre::Vector3 NBodySolver::AccelerationAt(uint32_t nBody, const std::vector<Ogre::Vector3>& positions,
+	const std::vector<float>& masses) const
+{
+	const Ogre::Vector3& vPos = positions[nBody];
+	float fSofteningSq = m_fSoftening * m_fSoftening;
+	float fThetaSq = m_fTheta * m_fTheta;
+
+	Ogre::Vector3 vAcceleration = Ogre::Vector3::ZERO;
+	auto pull = [&](const Ogre::Vector3& vSource, float fMass)
+	{
+		Ogre::Vector3 vDelta = vSource - vPos;
+		float fDistanceSq = vDelta.squaredLength() + fSofteningSq;
+		float fInvDistance = 1.0f / std::sqrt(fDistanceSq);
+		vAcceleration += vDelta * (m_fGravConst * fMass * fInvDistance * fInvDistance * fInvDistance);
+	};
+
+	int32_t stack[8 * NBODY_MAX_DEPTH + 8];
+	int nStackSize = 0;
+	stack[nStackSize++] = 0;
+
+	while (nStackSize > 0)
+	{
+		const Node& node = m_Nodes[stack[--nStackSize]];
+
+		if (node.bLeaf)
+		{
+			for (uint32_t i = node.nFirst; i < node.nFirst + node.nCount; ++i)
+			{
+				uint32_t nOther = m_Order[i];
+				if (nOther != nBody)
+					pull(positions[nOther], masses[nOther]);
+			}
+			continue;
+		}
+
+		// Far enough cell acts as a single body in its center of mass
+		float fSize = 2.0f * node.fHalfSize;
+		float fDistanceSq = node.vCenterOfMass.squaredDistance(vPos);
+		if (fSize * fSize < fThetaSq * fDistanceSq)
+		{
+			pull(node.vCenterOfMass, node.fMass);
+			continue;
+		}
+
+		for (int32_t nChild : node.nChildren)
+		{
+			if (nChild >= 0)
+				stack[nStackSize++] = nChild;
+		}
+	}
+
+	return vAcceleration;
+}
+
+void register_ecs_gravity_systems(flecs::world* ecs, EcsScheduler* pScheduler)
+{
+	// Reads all bodies before writing any of them, so it owns the whole step.
+	// Integrates Position of bodies itself, IntegrateVelocity skips them.
+	auto nbodyGravity = ecs->system<NBodySolverPtr>("NBodyGravity")
+		.kind(0)
+		.each([&](flecs::entity e, NBodySolverPtr& solver)
+			{
+				solver.ptr->Step(e.delta_time());
+			});
+	pScheduler->AddSystem(EcsPhase::Physics, nbodyGravity)
+		.Reads<Mass>()
+		.Writes<Position>()
+		.Writes<Velocity>()
+		.Writes<NBodySolverPtr>();
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include "flecs.h"
+#include "ecsScheduler.h"
+#include "ecsPhys.h"
+#include <OgreVector3.h>
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <thread>
+
+// Entities with Position and Mass attract each other.
+// Only those that also have Velocity are moved, the rest are fixed attractors.
+struct Mass
+{
+	float val;
+};
+
+enum EIntegrator : uint32_t
+{
+	eINT_SymplecticEuler = 0,	// kick then drift, first order
+	eINT_Leapfrog,				// drift-kick-drift velocity Verlet, second order, one force evaluation
+	eINT_Yoshida4,				// fourth order, three force evaluations
+
+	eINT_Max
+};
+
+// Mutual gravity of all Mass entities. Up to a few thousand bodies every pair is
+// summed by a tiled SIMD kernel, bigger sets go through a Barnes-Hut octree rebuilt every step.
+class NBodySolver
+{
+public:
+	NBodySolver(flecs::world* ecs, uint32_t nThreadCount = std::thread::hardware_concurrency());
+	~NBodySolver();
+	NBodySolver(const NBodySolver&) = delete;
+	NBodySolver& operator=(const NBodySolver&) = delete;
+
+	void SetGravConst(float fGravConst);
+	// Cell is treated as a point mass when its size / distance is below this
+	void SetOpeningAngle(float fTheta);
+	// Plummer softening length, keeps close encounters finite
+	void SetSoftening(float fSoftening);
+	// Body count below which exact pairwise sum is used
+	void SetExactThreshold(uint32_t nExactThreshold);
+
+	void SetIntegrator(EIntegrator eIntegrator);
+	EIntegrator GetIntegrator() const;
+
+	// Gathers bodies from ecs and advances their Position and Velocity by dt
+	void Step(float dt);
+
+	// Bodies with movable[i] == 0 attract others but stay in place
+	void Integrate(std::vector<Ogre::Vector3>& positions, std::vector<Ogre::Vector3>& velocities,
+		const std::vector<float>& masses, const std::vector<uint8_t>& movable, float dt);
+	// Kinetic plus softened potential energy, to measure integrator drift
+	double ComputeTotalEnergy(const std::vector<Ogre::Vector3>& positions, const std::vector<Ogre::Vector3>& velocities,
+		const std::vector<float>& masses) const;
+
+	void ComputeAccelerations(const std::vector<Ogre::Vector3>& positions, const std::vector<float>& masses,
+		std::vector<Ogre::Vector3>& accelerations);
+	void ComputeExact(const std::vector<Ogre::Vector3>& positions, const std::vector<float>& masses,
+		std::vector<Ogre::Vector3>& accelerations);
+	void ComputeBarnesHut(const std::vector<Ogre::Vector3>& positions, const std::vector<float>& masses,
+		std::vector<Ogre::Vector3>& accelerations);
+
+private:
+	struct Node
+	{
+		Ogre::Vector3 vCenterOfMass;
+		float fMass;
+		Ogre::Vector3 vCenter;
+		float fHalfSize;
+		int32_t nChildren[8];
+		// Bodies of the whole subtree are m_Order[nFirst .. nFirst + nCount)
+		uint32_t nFirst;
+		uint32_t nCount;
+		bool bLeaf;
+	};
+
+	flecs::world* m_pEcs;
+	flecs::query<Position, const Mass, Velocity*> m_bodyQuery;
+	uint32_t m_nThreadCount;
+
+	float m_fGravConst;
+	float m_fTheta;
+	float m_fSoftening;
+	uint32_t m_nExactThreshold;
+	EIntegrator m_eIntegrator;
+
+	std::vector<Ogre::Vector3> m_Positions;
+	std::vector<Ogre::Vector3> m_Velocities;
+	std::vector<float> m_Masses;
+	std::vector<uint8_t> m_Movable;
+	std::vector<Ogre::Vector3> m_Accelerations;
+	std::vector<Position*> m_PositionPtrs;
+	std::vector<Velocity*> m_VelocityPtrs;
+
+	// Structure of arrays copy for the all-pairs kernel, padded to whole tiles
+	struct SoABuffer
+	{
+		std::vector<float> x, y, z, m;
+	};
+	SoABuffer m_SoA;
+	std::vector<SoABuffer> m_ThreadAccelerations;
+	std::vector<std::pair<uint32_t, uint32_t>> m_TilePairs;
+
+	std::vector<Node> m_Nodes;
+	std::vector<uint32_t> m_Order;
+
+	void Drift(std::vector<Ogre::Vector3>& positions, const std::vector<Ogre::Vector3>& velocities,
+		const std::vector<uint8_t>& movable, float dt) const;
+	void Kick(const std::vector<Ogre::Vector3>& positions, std::vector<Ogre::Vector3>& velocities,
+		const std::vector<float>& masses, const std::vector<uint8_t>& movable, float dt);
+
+	void ComputeTilePair(uint32_t nTileI, uint32_t nTileJ, uint32_t nCount, SoABuffer& accelerations) const;
+
+	void BuildTree(const std::vector<Ogre::Vector3>& positions, const std::vector<float>& masses);
+	int32_t BuildNode(std::vector<Node>& nodes, std::vector<uint32_t>& scratch,
+		const std::vector<Ogre::Vector3>& positions, const std::vector<float>& masses,
+		uint32_t nFirst, uint32_t nCount, const Ogre::Vector3& vCenter, float fHalfSize, uint32_t nDepth);
+	void PartitionOctants(const std::vector<Ogre::Vector3>& positions, std::vector<uint32_t>& scratch,
+		uint32_t nFirst, uint32_t nCount, const Ogre::Vector3& vCenter, uint32_t octantStart[9]);
+	Ogre::Vector3 AccelerationAt(uint32_t nBody, const std::vector<Ogre::Vector3>& positions,
+		const std::vector<float>& masses) const;
+};
+
+struct NBodySolverPtr
+{
+	NBodySolver* ptr;
+};
+
+void register_ecs_gravity_systems(flecs::world* ecs, EcsScheduler* pScheduler);
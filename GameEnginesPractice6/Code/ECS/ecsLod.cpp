@@ -0,0 +1,145 @@
+#include "ecsLod.h"
+
+#include <algorithm>
+
+UpdateLod MakeUpdateLod(uint8_t nMinBucket, uint8_t nMaxBucket)
+{
+	UpdateLod lod = {};
+	lod.nMinBucket = nMinBucket;
+	lod.nMaxBucket = std::max(nMinBucket, nMaxBucket);
+	lod.nBucket = nMinBucket;
+	return lod;
+}
+
+UpdateLodScheduler::UpdateLodScheduler(flecs::world* ecs) :
+	m_pEcs(ecs),
+	m_fHysteresis(0.1f),
+	m_nFrame(0),
+	m_NextSlot(),
+	m_EntityCounts(),
+	m_nTickCount(0)
+{
+	m_lodQuery = m_pEcs->query<UpdateLod, const Position>();
+	m_cameraQuery = m_pEcs->query<const CameraPosition>();
+}
+
+UpdateLodScheduler::~UpdateLodScheduler()
+{
+
+}
+
+void UpdateLodScheduler::SetBucketDistances(const std::vector<float>& distances)
+{
+	m_Distances.assign(distances.begin(), distances.begin() + std::min<size_t>(distances.size(), MaxBuckets - 1));
+	UpdateBorders();
+}
+
+void UpdateLodScheduler::SetHysteresis(float fHysteresis)
+{
+	m_fHysteresis = std::min(std::max(fHysteresis, 0.0f), 0.9f);
+	UpdateBorders();
+}
+
+void UpdateLodScheduler::UpdateBorders()
+{
+	m_UpBorders.resize(m_Distances.size());
+	m_DownBorders.resize(m_Distances.size());
+	for (size_t i = 0; i < m_Distances.size(); ++i)
+	{
+		float fUp = m_Distances[i] * (1.0f + m_fHysteresis);
+		float fDown = m_Distances[i] * (1.0f - m_fHysteresis);
+		m_UpBorders[i] = fUp * fUp;
+		m_DownBorders[i] = fDown * fDown;
+	}
+}
+
+uint32_t UpdateLodScheduler::GetBucketCount() const
+{
+	return static_cast<uint32_t>(m_Distances.size() + 1);
+}
+
+uint32_t UpdateLodScheduler::GetEntityCount(uint32_t nBucket) const
+{
+	return nBucket < MaxBuckets ? m_EntityCounts[nBucket] : 0;
+}
+
+uint32_t UpdateLodScheduler::GetTickCount() const
+{
+	return m_nTickCount;
+}
+
+// Moving further away has to pass the widened border, coming closer the narrowed one
+uint8_t UpdateLodScheduler::SelectBucket(const UpdateLod& lod, float fDistanceSq) const
+{
+	uint8_t nBucket = lod.nBucket;
+
+	while (nBucket < m_UpBorders.size() && fDistanceSq > m_UpBorders[nBucket])
+		++nBucket;
+	while (nBucket > 0 && nBucket <= m_DownBorders.size() && fDistanceSq < m_DownBorders[nBucket - 1])
+		--nBucket;
+
+	return std::min(std::max(nBucket, lod.nMinBucket), lod.nMaxBucket);
+}
+
+void UpdateLodScheduler::Update(float dt)
+{
+	// Without camera there is nothing to be far from, everyone goes to lowest allowed bucket
+	bool bHasCamera = false;
+	Ogre::Vector3 vCamera = Ogre::Vector3::ZERO;
+	m_cameraQuery.each([&](const CameraPosition& cameraPos)
+		{
+			if (!bHasCamera)
+				vCamera = cameraPos;
+			bHasCamera = true;
+		});
+
+	std::fill(std::begin(m_EntityCounts), std::end(m_EntityCounts), 0u);
+	m_nTickCount = 0;
+
+	m_lodQuery.iter([&](flecs::iter& it, UpdateLod* lods, const Position* positions)
+		{
+			for (auto i : it)
+			{
+				UpdateLod& lod = lods[i];
+
+				uint8_t nBucket = bHasCamera ? SelectBucket(lod, vCamera.squaredDistance(positions[i])) : lod.nMinBucket;
+				nBucket = std::min<uint8_t>(nBucket, MaxBuckets - 1);
+				if (nBucket != lod.nBucket || lod.nSlot == 0)
+				{
+					// Slot 0 marks an entity never scheduled, real slots start from 1
+					lod.nBucket = nBucket;
+					lod.nSlot = ++m_NextSlot[nBucket];
+				}
+
+				++m_EntityCounts[nBucket];
+				lod.fAccumulatedTime += dt;
+
+				uint32_t nPeriodMask = (1u << nBucket) - 1;
+				lod.bTick = ((m_nFrame + lod.nSlot) & nPeriodMask) == 0;
+				if (lod.bTick)
+				{
+					lod.fTickTime = lod.fAccumulatedTime;
+					lod.fAccumulatedTime = 0.0f;
+					++m_nTickCount;
+				}
+			}
+		});
+
+	++m_nFrame;
+}
+
+void register_ecs_lod_systems(flecs::world* ecs, EcsScheduler* pScheduler)
+{
+	// Camera is the one scripts moved last frame, scripts run after this
+	auto lodUpdate = ecs->system<UpdateLodSchedulerPtr>("UpdateLodAssign")
+		.kind(0)
+		.each([&](flecs::entity e, UpdateLodSchedulerPtr& lodScheduler)
+			{
+				lodScheduler.ptr->Update(e.delta_time());
+			});
+	pScheduler->AddSystem(EcsPhase::Input, lodUpdate)
+		.Reads<Position>()
+		.Reads<CameraPosition>()
+		.Writes<UpdateLod>()
+		.Writes<UpdateLodSchedulerPtr>();
+}
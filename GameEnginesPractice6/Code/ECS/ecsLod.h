@@ -0,0 +1,77 @@
+#pragma once
+#include "flecs.h"
+#include "ecsScheduler.h"
+#include "ecsPhys.h"
+#include "ecsControl.h"
+
+#include <vector>
+#include <cstdint>
+
+// Entity in bucket k is updated every 2^k frames.
+// Bucket is picked by distance to camera, clamped to [nMinBucket, nMaxBucket],
+// so priority is expressed by the clamp: nMaxBucket 0 means every frame.
+struct UpdateLod
+{
+	uint8_t nMinBucket;
+	uint8_t nMaxBucket;
+	uint8_t nBucket;
+	// Updated this frame, fTickTime is the time since previous update
+	bool bTick;
+	uint32_t nSlot;
+	float fAccumulatedTime;
+	float fTickTime;
+};
+
+UpdateLod MakeUpdateLod(uint8_t nMinBucket, uint8_t nMaxBucket);
+
+// Assigns UpdateLod buckets by distance of Position to the CameraPosition entity
+// and decides which entities update this frame. Entities of a bucket are given
+// round robin slots, so every frame updates the same share of each bucket.
+class UpdateLodScheduler
+{
+public:
+	static const uint32_t MaxBuckets = 8;
+
+	UpdateLodScheduler(flecs::world* ecs);
+	~UpdateLodScheduler();
+	UpdateLodScheduler(const UpdateLodScheduler&) = delete;
+	UpdateLodScheduler& operator=(const UpdateLodScheduler&) = delete;
+
+	// distances[k] is where bucket k + 1 starts, ascending
+	void SetBucketDistances(const std::vector<float>& distances);
+	// Fraction of a bucket border entity has to pass to change bucket, stops flicker on borders
+	void SetHysteresis(float fHysteresis);
+
+	void Update(float dt);
+
+	uint32_t GetBucketCount() const;
+	uint32_t GetEntityCount(uint32_t nBucket) const;
+	// Entities updated by the last Update
+	uint32_t GetTickCount() const;
+
+private:
+	flecs::world* m_pEcs;
+	flecs::query<UpdateLod, const Position> m_lodQuery;
+	flecs::query<const CameraPosition> m_cameraQuery;
+
+	// Squared bucket borders, already widened or narrowed by hysteresis
+	std::vector<float> m_UpBorders;
+	std::vector<float> m_DownBorders;
+	std::vector<float> m_Distances;
+	float m_fHysteresis;
+
+	uint32_t m_nFrame;
+	uint32_t m_NextSlot[MaxBuckets];
+	uint32_t m_EntityCounts[MaxBuckets];
+	uint32_t m_nTickCount;
+
+	void UpdateBorders();
+	uint8_t SelectBucket(const UpdateLod& lod, float fDistanceSq) const;
+};
+
+struct UpdateLodSchedulerPtr
+{
+	UpdateLodScheduler* ptr;
+};
+
+void register_ecs_lod_systems(flecs::world* ecs, EcsScheduler* pScheduler);
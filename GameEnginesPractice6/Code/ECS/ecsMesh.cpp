@@ -6,25 +6,30 @@
 #include "../RenderEngine.h"
 #include "../ScriptSystem/ScriptNode.h"
 
-void register_ecs_mesh_systems(flecs::world* ecs)
+void register_ecs_mesh_systems(flecs::world* ecs, EcsScheduler* pScheduler)
 {
-	ecs->system<RenderNodeComponent, const CameraPosition>()
+	auto cameraSync = ecs->system<RenderNodeComponent, const CameraPosition>("CameraSync")
+		.kind(0)
 		.each([&](RenderNodeComponent& renderNode, const CameraPosition& cameraPos)
 			{
 				renderNode.ptr->SetCameraPosition(cameraPos);
 				renderNode.ptr->EnableCamera();
 			});
+	pScheduler->AddSystem(EcsPhase::TransformSync, cameraSync)
+		.Reads<CameraPosition>()
+		.Writes<RenderNodeComponent>();
 
-	ecs->system<RenderNodeComponent, const Position>()
-		.each([&](RenderNodeComponent& renderNode, const Position& pos)
+	// One flat pass over world transforms, hierarchy is already resolved by TransformPropagate
+	auto renderTransformSync = ecs->system<RenderNodeComponent, const Position, Orientation*>("RenderTransformSync")
+		.kind(0)
+		.each([&](RenderNodeComponent& renderNode, const Position& pos, Orientation* pOrient)
 			{
 				renderNode.ptr->SetPosition(pos);
+				if (pOrient)
+					renderNode.ptr->SetOrientation(*pOrient);
 			});
-
-	ecs->system<RenderNodeComponent, const Orientation>()
-		.each([&](RenderNodeComponent& renderNode, const Orientation& orient)
-			{
-				renderNode.ptr->SetOrientation(orient);
-			});
+	pScheduler->AddSystem(EcsPhase::TransformSync, renderTransformSync)
+		.Reads<Position>()
+		.Reads<Orientation>()
+		.Writes<RenderNodeComponent>();
 }
-
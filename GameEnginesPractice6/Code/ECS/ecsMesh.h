@@ -1,5 +1,6 @@
 #pragma once
 #include "flecs.h"
+#include "ecsScheduler.h"
 #include "OgreString.h"
 
 struct RenderNodeComponent
@@ -12,5 +13,5 @@ struct EntityIndex
 	uint32_t idx;
 };
 
-void register_ecs_mesh_systems(flecs::world* ecs);
+void register_ecs_mesh_systems(flecs::world* ecs, EcsScheduler* pScheduler);
 
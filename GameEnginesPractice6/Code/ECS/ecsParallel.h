@@ -0,0 +1,28 @@
+#pragma once
+#include "../JobSystem/JobSystem.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// Splits [0, nCount) into contiguous ranges, at most nThreadCount of them, runs them
+// as jobs and waits for all of them. func gets (range index, begin, end).
+// Without a job system ranges run one after another on calling thread.
+template <typename Func>
+void parallel_for(size_t nCount, size_t nMinPerThread, uint32_t nThreadCount, Func&& func)
+{
+	if (JobSystem* pJobSystem = JobSystem::Get())
+	{
+		pJobSystem->ParallelFor(nCount, nMinPerThread, nThreadCount, func);
+		return;
+	}
+
+	size_t nMaxThreads = std::max<size_t>(nCount / std::max<size_t>(nMinPerThread, 1), 1);
+	nThreadCount = static_cast<uint32_t>(std::min<size_t>(std::max(nThreadCount, 1u), nMaxThreads));
+	size_t nPerThread = (nCount + nThreadCount - 1) / nThreadCount;
+
+	for (uint32_t nThread = 0; nThread < nThreadCount; ++nThread)
+	{
+		size_t nBegin = std::min(nThread * nPerThread, nCount);
+		func(nThread, nBegin, std::min(nBegin + nPerThread, nCount));
+	}
+}
@@ -1,14 +1,11 @@
 #include "ecsPhys.h"
-#include <stdlib.h>
+#include "ecsGravity.h"
+#include "ecsDeterminism.h"
 
-static float rand_flt(float from, float to)
+void register_ecs_phys_systems(flecs::world* ecs, EcsScheduler* pScheduler, DeterministicSimulation* pSimulation)
 {
-	return from + (float(rand()) / RAND_MAX) * (to - from);
-}
-
-void register_ecs_phys_systems(flecs::world* ecs)
-{
-	ecs->system<Velocity, const Gravity, BouncePlane*, Position*>()
+	auto gravity = ecs->system<Velocity, const Gravity, BouncePlane*, Position*>("ApplyGravity")
+		.kind(0)
 		.each([&](flecs::entity e, Velocity& vel, const Gravity& grav, BouncePlane* plane, Position* pos)
 			{
 				if (plane && pos)
@@ -20,9 +17,15 @@ void register_ecs_phys_systems(flecs::world* ecs)
 				}
 				vel += grav * e.delta_time();
 			});
+	pScheduler->AddSystem(EcsPhase::Physics, gravity)
+		.Reads<Gravity>()
+		.Reads<BouncePlane>()
+		.Reads<Position>()
+		.Writes<Velocity>();
 
 
-	ecs->system<Velocity, Position, const BouncePlane, const Bounciness>()
+	auto bounce = ecs->system<Velocity, Position, const BouncePlane, const Bounciness>("Bounce")
+		.kind(0)
 		.each([&](Velocity& vel, Position& pos, const BouncePlane& plane, const Bounciness& bounciness)
 			{
 				Ogre::Vector3 planeNorm(plane.x, plane.y, plane.z);
@@ -33,28 +36,49 @@ void register_ecs_phys_systems(flecs::world* ecs)
 					vel -= (1.f + bounciness.val) * planeNorm * planeNorm.dotProduct(vel);
 				}
 			});
+	pScheduler->AddSystem(EcsPhase::Physics, bounce)
+		.Reads<BouncePlane>()
+		.Reads<Bounciness>()
+		.Writes<Velocity>()
+		.Writes<Position>();
 
 
-	ecs->system<Velocity, const FrictionAmount>()
+	auto friction = ecs->system<Velocity, const FrictionAmount>("ApplyFriction")
+		.kind(0)
 		.each([&](flecs::entity e, Velocity& vel, const FrictionAmount& friction)
 			{
 				vel -= vel * friction.val * e.delta_time();
 			});
+	pScheduler->AddSystem(EcsPhase::Physics, friction)
+		.Reads<FrictionAmount>()
+		.Writes<Velocity>();
 
 
-	ecs->system<Position, const Velocity>()
+	// Bodies under mutual gravity are integrated by NBodySolver
+	auto integrate = ecs->system<Position, const Velocity>("IntegrateVelocity")
+		.term<Mass>().oper(flecs::Not)
+		.kind(0)
 		.each([&](flecs::entity e, Position& pos, const Velocity& vel)
 			{
 				pos += vel * e.delta_time();
 			});
+	pScheduler->AddSystem(EcsPhase::Physics, integrate)
+		.Reads<Velocity>()
+		.Writes<Position>();
 
 
-	ecs->system<Position, const ShiverAmount>()
-		.each([&](flecs::entity e, Position& pos, const ShiverAmount& shiver)
+	// Random values depend only on seed, entity and tick, not on iteration order
+	auto shiver = ecs->system<Position, const ShiverAmount>("ApplyShiver")
+		.kind(0)
+		.each([pSimulation](flecs::entity e, Position& pos, const ShiverAmount& shiver)
 			{
-				pos.x += rand_flt(-shiver.val, shiver.val);
-				pos.y += rand_flt(-shiver.val, shiver.val);
-				pos.z += rand_flt(-shiver.val, shiver.val);
+				pos.x += pSimulation->RandomFloat(e.id(), 0, -shiver.val, shiver.val);
+				pos.y += pSimulation->RandomFloat(e.id(), 1, -shiver.val, shiver.val);
+				pos.z += pSimulation->RandomFloat(e.id(), 2, -shiver.val, shiver.val);
 			});
+	pScheduler->AddSystem(EcsPhase::Physics, shiver)
+		.Reads<ShiverAmount>()
+		.Reads<DeterministicSimulationPtr>()
+		.Writes<Position>();
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "flecs.h"
+#include "ecsScheduler.h"
 #include <OgreVector3.h>
 
 struct Position : public Ogre::Vector3
@@ -44,5 +45,5 @@ struct FrictionAmount
 
 typedef float Speed;
 
-void register_ecs_phys_systems(flecs::world* ecs);
+void register_ecs_phys_systems(flecs::world* ecs, EcsScheduler* pScheduler, class DeterministicSimulation* pSimulation);
 
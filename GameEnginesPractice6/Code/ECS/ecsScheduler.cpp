@@ -0,0 +1,226 @@
+#include "ecsScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+
+const char* GetEcsPhaseName(EcsPhase ePhase)
+{
+	switch (ePhase)
+	{
+	case EcsPhase::Input: return "Input";
+	case EcsPhase::Script: return "Script";
+	case EcsPhase::Physics: return "Physics";
+	case EcsPhase::TransformSync: return "TransformSync";
+	case EcsPhase::RenderSubmit: return "RenderSubmit";
+	default: return "Unknown";
+	}
+}
+
+EcsSystemAccess::EcsSystemAccess(flecs::world* ecs) :
+	m_pEcs(ecs),
+	m_bMainThread(false)
+{
+
+}
+
+EcsSystemAccess& EcsSystemAccess::MainThread()
+{
+	m_bMainThread = true;
+	return *this;
+}
+
+bool EcsSystemAccess::IsMainThread() const
+{
+	return m_bMainThread;
+}
+
+bool EcsSystemAccess::IsExclusive() const
+{
+	return m_Reads.empty() && m_Writes.empty();
+}
+
+bool EcsSystemAccess::WritesAnyOf(const std::vector<flecs::id_t>& ids) const
+{
+	for (flecs::id_t id : m_Writes)
+	{
+		if (std::find(ids.begin(), ids.end(), id) != ids.end())
+			return true;
+	}
+
+	return false;
+}
+
+bool EcsSystemAccess::ConflictsWith(const EcsSystemAccess& other) const
+{
+	if (IsExclusive() || other.IsExclusive())
+		return true;
+
+	return WritesAnyOf(other.m_Reads) || WritesAnyOf(other.m_Writes) || other.WritesAnyOf(m_Reads);
+}
+
+EcsScheduler::EcsScheduler(flecs::world* ecs, JobSystem* pJobSystem) :
+	m_pEcs(ecs),
+	m_pJobSystem(pJobSystem),
+	m_bBatchesDirty(false),
+	m_fFixedTimestep(0.0f),
+	m_bStatisticsEnabled(false)
+{
+	// Stage per worker, a system job uses the stage of the worker it landed on
+	m_pEcs->set_stages(m_pJobSystem ? m_pJobSystem->GetWorkerCount() : 1);
+}
+
+EcsScheduler::~EcsScheduler()
+{
+
+}
+
+EcsSystemAccess& EcsScheduler::AddSystem(EcsPhase ePhase, flecs::entity_t system)
+{
+	m_bBatchesDirty = true;
+
+	const char* szName = ecs_get_name(m_pEcs->c_ptr(), system);
+	std::string strName = szName ? szName : "system_" + std::to_string(system);
+	uint32_t nStatsIdx = m_Statistics.AddSystem(strName, GetEcsPhaseName(ePhase));
+
+	std::vector<SystemEntry>& systems = m_Systems[static_cast<size_t>(ePhase)];
+	systems.push_back(SystemEntry{ system, EcsSystemAccess(m_pEcs), nStatsIdx });
+	return systems.back().access;
+}
+
+void EcsScheduler::SetFixedTimestep(float fDeltaTime)
+{
+	m_fFixedTimestep = fDeltaTime;
+}
+
+float EcsScheduler::GetFixedTimestep() const
+{
+	return m_fFixedTimestep;
+}
+
+void EcsScheduler::EnableStatistics(bool bEnable)
+{
+	m_bStatisticsEnabled = bEnable;
+}
+
+EcsStatistics* EcsScheduler::GetStatistics()
+{
+	return &m_Statistics;
+}
+
+// System goes to the batch right after the last batch holding a conflicting system,
+// so conflicting systems keep their registration order
+void EcsScheduler::BuildBatches()
+{
+	for (size_t nPhase = 0; nPhase < static_cast<size_t>(EcsPhase::Count); ++nPhase)
+	{
+		const std::vector<SystemEntry>& systems = m_Systems[nPhase];
+		std::vector<TBatch>& batches = m_Batches[nPhase];
+		std::vector<size_t> levels(systems.size(), 0);
+
+		batches.clear();
+		for (size_t i = 0; i < systems.size(); ++i)
+		{
+			for (size_t j = 0; j < i; ++j)
+			{
+				if (systems[i].access.ConflictsWith(systems[j].access))
+					levels[i] = std::max(levels[i], levels[j] + 1);
+			}
+
+			if (batches.size() <= levels[i])
+				batches.resize(levels[i] + 1);
+			batches[levels[i]].push_back(&systems[i]);
+		}
+	}
+
+	m_bBatchesDirty = false;
+}
+
+void EcsScheduler::Progress()
+{
+	if (m_bBatchesDirty)
+		BuildBatches();
+
+	float dt = m_pEcs->frame_begin(m_fFixedTimestep);
+
+	for (const std::vector<TBatch>& batches : m_Batches)
+	{
+		// Deferred operations are merged after every phase, so next phase sees them
+		m_pEcs->staging_begin();
+
+		for (const TBatch& batch : batches)
+			RunBatch(batch, dt);
+
+		m_pEcs->staging_end();
+	}
+
+	m_pEcs->frame_end();
+
+	if (m_bStatisticsEnabled)
+		m_Statistics.EndFrame(dt);
+}
+
+void EcsScheduler::RunBatch(const TBatch& batch, float dt)
+{
+	if (batch.size() == 1 || !m_pJobSystem || m_pJobSystem->GetWorkerCount() == 1)
+	{
+		flecs::world_t* stage = ecs_get_stage(m_pEcs->c_ptr(), 0);
+		for (const SystemEntry* pEntry : batch)
+			RunSystem(stage, *pEntry, dt);
+		return;
+	}
+
+	BatchJobData data = { this, &batch, dt };
+	JobCounter counter;
+
+	m_BatchJobs.clear();
+	for (size_t nSystem = 0; nSystem < batch.size(); ++nSystem)
+	{
+		Job job = { &EcsScheduler::RunSystemJob, &data, nSystem, nSystem + 1, &counter };
+		if (batch[nSystem]->access.IsMainThread())
+			m_pJobSystem->SubmitMainThread(job);
+		else
+			m_BatchJobs.push_back(job);
+	}
+
+	// Main thread runs its own jobs first, then helps with the rest while it waits
+	m_pJobSystem->Submit(m_BatchJobs.data(), static_cast<uint32_t>(m_BatchJobs.size()));
+	m_pJobSystem->Wait(&counter);
+}
+
+void EcsScheduler::RunSystemJob(void* pData, size_t nBegin, size_t nEnd)
+{
+	BatchJobData* pBatchData = static_cast<BatchJobData*>(pData);
+	EcsScheduler* pScheduler = pBatchData->pScheduler;
+
+	// System jobs sit in worker deques or main thread queue only, which other threads never take from
+	uint32_t nStage = pScheduler->m_pJobSystem->GetWorkerIndex();
+	flecs::world_t* stage = ecs_get_stage(pScheduler->m_pEcs->c_ptr(), nStage);
+
+	for (size_t nSystem = nBegin; nSystem < nEnd; ++nSystem)
+		pScheduler->RunSystem(stage, *(*pBatchData->pBatch)[nSystem], pBatchData->dt);
+}
+
+void EcsScheduler::RunSystem(flecs::world_t* stage, const SystemEntry& entry, float dt)
+{
+	if (!m_bStatisticsEnabled)
+	{
+		ecs_run(stage, entry.system, dt, nullptr);
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	ecs_run(stage, entry.system, dt, nullptr);
+	std::chrono::duration<float, std::milli> time = std::chrono::steady_clock::now() - start;
+
+	// Same walk over matched tables the system just did, without invoking it
+	uint32_t nEntities = 0;
+	uint32_t nTables = 0;
+	ecs_iter_t it = ecs_query_iter(stage, ecs_system_get_query(stage, entry.system));
+	while (ecs_query_next(&it))
+	{
+		nEntities += it.count;
+		++nTables;
+	}
+
+	m_Statistics.Record(entry.nStatsIdx, time.count(), nEntities, nTables);
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "flecs.h"
+#include "ecsStatistics.h"
+#include "../JobSystem/JobSystem.h"
+
+#include <vector>
+
+// Phases are executed in this order every frame
+enum class EcsPhase : uint32_t
+{
+	Input = 0,
+	Script,
+	Physics,
+	TransformSync,
+	RenderSubmit,
+	Count
+};
+
+const char* GetEcsPhaseName(EcsPhase ePhase);
+
+// Components that system reads and writes.
+// System without declared access is treated as exclusive
+class EcsSystemAccess
+{
+public:
+	EcsSystemAccess(flecs::world* ecs);
+
+	template <typename T>
+	EcsSystemAccess& Reads()
+	{
+		m_Reads.push_back(m_pEcs->id<T>());
+		return *this;
+	}
+
+	template <typename T>
+	EcsSystemAccess& Writes()
+	{
+		m_Writes.push_back(m_pEcs->id<T>());
+		return *this;
+	}
+
+	// System runs only on main thread, for state that isn't thread safe (main lua state)
+	EcsSystemAccess& MainThread();
+	bool IsMainThread() const;
+
+	bool ConflictsWith(const EcsSystemAccess& other) const;
+
+private:
+	flecs::world* m_pEcs;
+
+	std::vector<flecs::id_t> m_Reads;
+	std::vector<flecs::id_t> m_Writes;
+	bool m_bMainThread;
+
+	bool IsExclusive() const;
+	bool WritesAnyOf(const std::vector<flecs::id_t>& ids) const;
+};
+
+// Runs manual (kind(0)) systems phase by phase.
+// Inside of a phase systems are grouped into batches of non-conflicting systems,
+// each batch is executed concurrently as jobs, every job system worker using its own flecs stage.
+// Progress must be called on main thread. Batch of one system runs inline on it, in a larger
+// batch MainThread systems are submitted as main thread jobs, which main thread runs while
+// it waits for the batch. Without job system everything runs on calling thread.
+class EcsScheduler
+{
+public:
+	EcsScheduler(flecs::world* ecs, JobSystem* pJobSystem = nullptr);
+	~EcsScheduler();
+	EcsScheduler(const EcsScheduler&) = delete;
+	EcsScheduler& operator=(const EcsScheduler&) = delete;
+
+	// Returned reference is valid until next AddSystem call
+	EcsSystemAccess& AddSystem(EcsPhase ePhase, flecs::entity_t system);
+
+	void Progress();
+
+	// Systems get exactly fDeltaTime every frame instead of measured time, 0 goes back to measuring
+	void SetFixedTimestep(float fDeltaTime);
+	float GetFixedTimestep() const;
+
+	// Off by default, counting walks every system's query once more per frame
+	void EnableStatistics(bool bEnable);
+	EcsStatistics* GetStatistics();
+
+private:
+	struct SystemEntry
+	{
+		flecs::entity_t system;
+		EcsSystemAccess access;
+		uint32_t nStatsIdx;
+	};
+
+	typedef std::vector<const SystemEntry*> TBatch;
+
+	struct BatchJobData
+	{
+		EcsScheduler* pScheduler;
+		const TBatch* pBatch;
+		float dt;
+	};
+
+	flecs::world* m_pEcs;
+	JobSystem* m_pJobSystem;
+
+	std::vector<SystemEntry> m_Systems[static_cast<size_t>(EcsPhase::Count)];
+	std::vector<TBatch> m_Batches[static_cast<size_t>(EcsPhase::Count)];
+	bool m_bBatchesDirty;
+	float m_fFixedTimestep;
+
+	EcsStatistics m_Statistics;
+	bool m_bStatisticsEnabled;
+
+	std::vector<Job> m_BatchJobs;
+
+	void BuildBatches();
+	void RunBatch(const TBatch& batch, float dt);
+	void RunSystem(flecs::world_t* stage, const SystemEntry& entry, float dt);
+
+	static void RunSystemJob(void* pData, size_t nBegin, size_t nEnd);
+};
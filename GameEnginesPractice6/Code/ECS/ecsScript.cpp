@@ -2,14 +2,87 @@
 #include "ecsSystems.h"
 #include "ecsScript.h"
 #include "ecsPhys.h"
+#include "ecsLod.h"
+#include "ecsControl.h"
+#include "ecsSpatial.h"
+#include "../ScriptSystem/ScriptSystem.h"
 
-void register_ecs_script_systems(flecs::world* ecs)
+void register_ecs_script_systems(flecs::world* ecs, EcsScheduler* pScheduler, ScriptSystem* pScriptSystem)
 {
 	static auto scriptSystemQuery = ecs->query<ScriptSystemPtr>();
 
-	ecs->system<ScriptNodeComponent, const Position>()
-		.each([&](flecs::entity e, ScriptNodeComponent& scriptNode, const Position& pos)
+	// Main lua state isn't thread safe, systems running it stay on main thread.
+	// Entities with UpdateLod skip frames and get all the time they skipped on their turn.
+	// Scripts with OnUpdateBatch and thread safe scripts are only queued here and updated
+	// by ScriptUpdateBatch and ScriptUpdateParallel.
+	// Scripts write their own Position, Orientation, Velocity and CameraPosition through Entity.Components
+	auto scriptUpdate = ecs->system<ScriptNodeComponent, const Position, UpdateLod*>("ScriptUpdate")
+		.kind(0)
+		.each([pScriptSystem](flecs::entity e, ScriptNodeComponent& scriptNode, const Position& pos, UpdateLod* lod)
 			{
-				scriptNode.ptr->Update(e.delta_time());
+				if (lod && !lod->bTick)
+					return;
+
+				float dt = lod ? lod->fTickTime : e.delta_time();
+				if (!pScriptSystem->QueueUpdate(scriptNode.ptr, dt))
+					scriptNode.ptr->Update(dt);
+			});
+	pScheduler->AddSystem(EcsPhase::Script, scriptUpdate)
+		.MainThread()
+		.Reads<InputHandlerPtr>()
+		.Reads<SpatialIndexPtr>()
+		.Reads<UpdateLod>()
+		.Writes<ScriptNodeComponent>()
+		.Writes<ScriptSystemPtr>()
+		.Writes<Position>()
+		.Writes<Orientation>()
+		.Writes<Velocity>()
+		.Writes<CameraPosition>();
+
+	auto scriptUpdateBatch = ecs->system<ScriptSystemPtr>("ScriptUpdateBatch")
+		.kind(0)
+		.each([](flecs::entity e, ScriptSystemPtr& scriptSystem)
+			{
+				scriptSystem.ptr->RunBatchUpdates(e.delta_time());
+			});
+	pScheduler->AddSystem(EcsPhase::Script, scriptUpdateBatch)
+		.MainThread()
+		.Reads<InputHandlerPtr>()
+		.Reads<SpatialIndexPtr>()
+		.Writes<ScriptNodeComponent>()
+		.Writes<ScriptSystemPtr>()
+		.Writes<Position>()
+		.Writes<Orientation>()
+		.Writes<Velocity>()
+		.Writes<CameraPosition>();
+
+	// Worker states run concurrently inside this one system, each writes only its own entities
+	auto scriptUpdateParallel = ecs->system<ScriptSystemPtr>("ScriptUpdateParallel")
+		.kind(0)
+		.each([](flecs::entity e, ScriptSystemPtr& scriptSystem)
+			{
+				scriptSystem.ptr->RunParallelUpdates(e.delta_time());
+			});
+	pScheduler->AddSystem(EcsPhase::Script, scriptUpdateParallel)
+		.Reads<InputHandlerPtr>()
+		.Reads<SpatialIndexPtr>()
+		.Writes<ScriptNodeComponent>()
+		.Writes<ScriptSystemPtr>()
+		.Writes<Position>()
+		.Writes<Orientation>()
+		.Writes<Velocity>()
+		.Writes<CameraPosition>();
+
+	// Writes scripts made to other entities, after every script of the frame ran
+	auto scriptCommands = ecs->system<ScriptSystemPtr>("ScriptCommands")
+		.kind(0)
+		.each([](flecs::entity e, ScriptSystemPtr& scriptSystem)
+			{
+				scriptSystem.ptr->ApplyCommands(e.world().c_ptr());
 			});
-}
\ No newline at end of file
+	pScheduler->AddSystem(EcsPhase::Script, scriptCommands)
+		.Writes<ScriptSystemPtr>()
+		.Writes<Position>()
+		.Writes<Orientation>()
+		.Writes<Velocity>();
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "flecs.h"
+#include "ecsScheduler.h"
 #include "../ScriptSystem/ScriptNode.h"
 
 struct ScriptNodeComponent
@@ -7,4 +8,4 @@ struct ScriptNodeComponent
 	class ScriptNode* ptr;
 };
 
-void register_ecs_script_systems(flecs::world* ecs);
\ No newline at end of file
+void register_ecs_script_systems(flecs::world* ecs, EcsScheduler* pScheduler, class ScriptSystem* pScriptSystem);
\ No newline at end of file
@@ -0,0 +1,285 @@
+#include "ecsSnapshot.h"
+
+#include <algorithm>
+#include <cstring>
+
+// Granularity of delta snapshots, small enough to skip untouched ranges of a column
+static const uint32_t SNAPSHOT_CHUNK_SIZE = 4096;
+
+// Keeps entity ids of every column aligned
+static size_t AlignOffset(size_t nOffset)
+{
+	return (nOffset + alignof(flecs::entity_t) - 1) & ~(alignof(flecs::entity_t) - 1);
+}
+
+EcsSnapshotter::EcsSnapshotter(flecs::world* ecs) :
+	m_pEcs(ecs)
+{
+
+}
+
+EcsSnapshotter::~EcsSnapshotter()
+{
+	for (EcsSnapshot* pSnapshot : m_Snapshots)
+		delete pSnapshot;
+}
+
+uint32_t EcsSnapshotter::GetPooledCount() const
+{
+	return static_cast<uint32_t>(m_FreeSnapshots.size());
+}
+
+EcsSnapshot* EcsSnapshotter::Acquire()
+{
+	EcsSnapshot* pSnapshot = nullptr;
+	if (!m_FreeSnapshots.empty())
+	{
+		pSnapshot = m_FreeSnapshots.back();
+		m_FreeSnapshots.pop_back();
+	}
+	else
+	{
+		pSnapshot = new EcsSnapshot();
+		m_Snapshots.push_back(pSnapshot);
+	}
+
+	pSnapshot->m_nRefCount = 1;
+	return pSnapshot;
+}
+
+void EcsSnapshotter::Release(EcsSnapshot* pSnapshot)
+{
+	if (!pSnapshot || pSnapshot->m_nRefCount == 0)
+		return;
+
+	if (--pSnapshot->m_nRefCount > 0)
+		return;
+
+	if (pSnapshot->m_pBase)
+		Release(pSnapshot->m_pBase);
+
+	// Buffers keep their capacity for the next capture
+	pSnapshot->m_pBase = nullptr;
+	pSnapshot->m_Chunks.clear();
+	m_FreeSnapshots.push_back(pSnapshot);
+}
+
+void EcsSnapshotter::GatherLiveColumns()
+{
+	m_LiveColumns.clear();
+
+	for (uint32_t nComponent = 0; nComponent < m_Components.size(); ++nComponent)
+	{
+		const Component& component = m_Components[nComponent];
+
+		ecs_iter_t it = ecs_query_iter(m_pEcs->c_ptr(), component.query.c_ptr());
+		while (ecs_query_next(&it))
+		{
+			// Values inherited from prefabs belong to the prefab
+			if (!ecs_term_is_owned(&it, 1))
+				continue;
+
+			LiveColumn column;
+			column.nComponent = nComponent;
+			column.pData = ecs_term_w_size(&it, component.nSize, 1);
+			column.pEntities = it.entities;
+			column.nCount = static_cast<uint32_t>(it.count);
+			m_LiveColumns.push_back(column);
+		}
+	}
+}
+
+bool EcsSnapshotter::MatchesLive(const EcsSnapshot& snapshot) const
+{
+	if (snapshot.m_Columns.size() != m_LiveColumns.size())
+		return false;
+
+	for (size_t i = 0; i < m_LiveColumns.size(); ++i)
+	{
+		const EcsSnapshot::Column& column = snapshot.m_Columns[i];
+		const LiveColumn& live = m_LiveColumns[i];
+
+		if (column.nComponent != live.nComponent || column.nCount != live.nCount)
+			return false;
+
+		if (memcmp(snapshot.m_Data.data() + column.nEntitiesOffset, live.pEntities, live.nCount * sizeof(flecs::entity_t)) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+EcsSnapshot* EcsSnapshotter::Capture()
+{
+	GatherLiveColumns();
+
+	size_t nTotalSize = 0;
+	for (const LiveColumn& live : m_LiveColumns)
+		nTotalSize += AlignOffset(live.nCount * (sizeof(flecs::entity_t) + m_Components[live.nComponent].nSize));
+
+	EcsSnapshot* pSnapshot = Acquire();
+	pSnapshot->m_Data.resize(nTotalSize);
+	pSnapshot->m_Columns.clear();
+
+	size_t nOffset = 0;
+	for (const LiveColumn& live : m_LiveColumns)
+	{
+		size_t nEntitiesSize = live.nCount * sizeof(flecs::entity_t);
+		size_t nDataSize = live.nCount * m_Components[live.nComponent].nSize;
+
+		EcsSnapshot::Column column;
+		column.nComponent = live.nComponent;
+		column.nCount = live.nCount;
+		column.nEntitiesOffset = nOffset;
+		column.nDataOffset = nOffset + nEntitiesSize;
+		pSnapshot->m_Columns.push_back(column);
+
+		memcpy(pSnapshot->m_Data.data() + column.nEntitiesOffset, live.pEntities, nEntitiesSize);
+		memcpy(pSnapshot->m_Data.data() + column.nDataOffset, live.pData, nDataSize);
+		nOffset += AlignOffset(nEntitiesSize + nDataSize);
+	}
+
+	return pSnapshot;
+}
+
+EcsSnapshot* EcsSnapshotter::CaptureDelta(EcsSnapshot* pBase)
+{
+	// Deltas always refer to a full snapshot, never to another delta
+	EcsSnapshot* pFull = pBase->m_pBase ? pBase->m_pBase : pBase;
+
+	GatherLiveColumns();
+	if (!MatchesLive(*pFull))
+		return Capture();
+
+	EcsSnapshot* pSnapshot = Acquire();
+	pSnapshot->m_pBase = pFull;
+	++pFull->m_nRefCount;
+	pSnapshot->m_Data.clear();
+	pSnapshot->m_Columns.clear();
+	pSnapshot->m_Chunks.clear();
+
+	for (uint32_t nColumn = 0; nColumn < m_LiveColumns.size(); ++nColumn)
+	{
+		const LiveColumn& live = m_LiveColumns[nColumn];
+		const uint8_t* pLive = static_cast<const uint8_t*>(live.pData);
+		const uint8_t* pSaved = pFull->m_Data.data() + pFull->m_Columns[nColumn].nDataOffset;
+		uint32_t nDataSize = static_cast<uint32_t>(live.nCount * m_Components[live.nComponent].nSize);
+
+		for (uint32_t nOffset = 0; nOffset < nDataSize; nOffset += SNAPSHOT_CHUNK_SIZE)
+		{
+			uint32_t nSize = std::min(SNAPSHOT_CHUNK_SIZE, nDataSize - nOffset);
+			if (memcmp(pLive + nOffset, pSaved + nOffset, nSize) == 0)
+				continue;
+
+			EcsSnapshot::Chunk chunk;
+			chunk.nColumn = nColumn;
+			chunk.nOffset = nOffset;
+			chunk.nSize = nSize;
+			chunk.nDataOffset = pSnapshot->m_Data.size();
+			pSnapshot->m_Chunks.push_back(chunk);
+			pSnapshot->m_Data.insert(pSnapshot->m_Data.end(), pLive + nOffset, pLive + nOffset + nSize);
+		}
+	}
+
+	return pSnapshot;
+}
+
+void EcsSnapshotter::Restore(const EcsSnapshot* pSnapshot)
+{
+	const EcsSnapshot* pFull = pSnapshot->m_pBase ? pSnapshot->m_pBase : pSnapshot;
+
+	GatherLiveColumns();
+	if (MatchesLive(*pFull))
+	{
+		// Same entities in the same rows, columns are copied back as they are
+		for (size_t i = 0; i < m_LiveColumns.size(); ++i)
+		{
+			const LiveColumn& live = m_LiveColumns[i];
+			memcpy(live.pData, pFull->m_Data.data() + pFull->m_Columns[i].nDataOffset,
+				live.nCount * m_Components[live.nComponent].nSize);
+		}
+
+		for (const EcsSnapshot::Chunk& chunk : pSnapshot->m_Chunks)
+		{
+			uint8_t* pLive = static_cast<uint8_t*>(m_LiveColumns[chunk.nColumn].pData);
+			memcpy(pLive + chunk.nOffset, pSnapshot->m_Data.data() + chunk.nDataOffset, chunk.nSize);
+		}
+		return;
+	}
+
+	if (pSnapshot->m_Chunks.empty())
+	{
+		RestoreSlow(*pFull, pFull->m_Data.data());
+		return;
+	}
+
+	// Delta on top of its base first, then entity by entity
+	m_Scratch.assign(pFull->m_Data.begin(), pFull->m_Data.end());
+	for (const EcsSnapshot::Chunk& chunk : pSnapshot->m_Chunks)
+	{
+		size_t nColumnOffset = pFull->m_Columns[chunk.nColumn].nDataOffset;
+		memcpy(m_Scratch.data() + nColumnOffset + chunk.nOffset, pSnapshot->m_Data.data() + chunk.nDataOffset, chunk.nSize);
+	}
+	RestoreSlow(*pFull, m_Scratch.data());
+}
+
+// Columns still holding the same entities are copied whole, values of entities
+// that moved between tables are found by id. Entities that are gone are skipped.
+void EcsSnapshotter::RestoreSlow(const EcsSnapshot& layout, const uint8_t* pData)
+{
+	std::vector<uint8_t> liveMatched(m_LiveColumns.size(), 0);
+
+	for (uint32_t nComponent = 0; nComponent < m_Components.size(); ++nComponent)
+	{
+		size_t nSize = m_Components[nComponent].nSize;
+		m_EntityValues.clear();
+
+		for (const EcsSnapshot::Column& column : layout.m_Columns)
+		{
+			if (column.nComponent != nComponent)
+				continue;
+
+			const flecs::entity_t* pEntities = reinterpret_cast<const flecs::entity_t*>(pData + column.nEntitiesOffset);
+			const uint8_t* pValues = pData + column.nDataOffset;
+
+			bool bCopied = false;
+			for (size_t nLive = 0; nLive < m_LiveColumns.size() && !bCopied; ++nLive)
+			{
+				const LiveColumn& live = m_LiveColumns[nLive];
+				if (liveMatched[nLive] || live.nComponent != nComponent || live.nCount != column.nCount ||
+					memcmp(live.pEntities, pEntities, live.nCount * sizeof(flecs::entity_t)) != 0)
+				{
+					continue;
+				}
+
+				memcpy(live.pData, pValues, live.nCount * nSize);
+				liveMatched[nLive] = 1;
+				bCopied = true;
+			}
+
+			if (bCopied)
+				continue;
+
+			for (uint32_t i = 0; i < column.nCount; ++i)
+				m_EntityValues[pEntities[i]] = pValues + i * nSize;
+		}
+
+		if (m_EntityValues.empty())
+			continue;
+
+		for (size_t nLive = 0; nLive < m_LiveColumns.size(); ++nLive)
+		{
+			const LiveColumn& live = m_LiveColumns[nLive];
+			if (liveMatched[nLive] || live.nComponent != nComponent)
+				continue;
+
+			uint8_t* pLive = static_cast<uint8_t*>(live.pData);
+			for (uint32_t i = 0; i < live.nCount; ++i)
+			{
+				auto value = m_EntityValues.find(live.pEntities[i]);
+				if (value != m_EntityValues.end())
+					memcpy(pLive + i * nSize, value->second, nSize);
+			}
+		}
+	}
+}
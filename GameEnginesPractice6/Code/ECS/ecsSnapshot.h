@@ -0,0 +1,117 @@
+#pragma once
+#include "flecs.h"
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// Copy of registered component columns. Full snapshots keep every column,
+// delta snapshots keep only the chunks that differ from their full base.
+class EcsSnapshot
+{
+public:
+	bool IsDelta() const { return m_pBase != nullptr; }
+	// Bytes held by this snapshot itself, base not included
+	size_t GetDataSize() const { return m_Data.size(); }
+	uint32_t GetChangedChunkCount() const { return static_cast<uint32_t>(m_Chunks.size()); }
+
+private:
+	friend class EcsSnapshotter;
+
+	// One table column of one component: entity ids, then nCount values
+	struct Column
+	{
+		uint32_t nComponent;
+		uint32_t nCount;
+		size_t nEntitiesOffset;
+		size_t nDataOffset;
+	};
+
+	// Delta only: bytes [nOffset, nOffset + nSize) of column nColumn live at m_Data[nDataOffset]
+	struct Chunk
+	{
+		uint32_t nColumn;
+		uint32_t nOffset;
+		uint32_t nSize;
+		size_t nDataOffset;
+	};
+
+	std::vector<uint8_t> m_Data;
+	std::vector<Column> m_Columns;
+	std::vector<Chunk> m_Chunks;
+
+	EcsSnapshot* m_pBase = nullptr;
+	uint32_t m_nRefCount = 0;
+};
+
+// Saves and restores registered components of the whole world, e.g. for rollback or replays.
+// Snapshots come from a pool and keep their buffers, so steady state capture doesn't allocate.
+// Restore writes values back into live columns with memcpy while the set of entities
+// is the same as at capture. Otherwise unchanged columns are still copied whole and
+// the rest is matched by entity id; created and destroyed entities are not rolled back.
+// Call outside of ecs progress.
+class EcsSnapshotter
+{
+public:
+	EcsSnapshotter(flecs::world* ecs);
+	~EcsSnapshotter();
+	EcsSnapshotter(const EcsSnapshotter&) = delete;
+	EcsSnapshotter& operator=(const EcsSnapshotter&) = delete;
+
+	template <typename T>
+	void AddComponent()
+	{
+		Component component;
+		component.id = m_pEcs->id<T>();
+		component.nSize = sizeof(T);
+		component.query = m_pEcs->query_builder<>()
+			.term<T>()
+			.build();
+		m_Components.push_back(component);
+	}
+
+	EcsSnapshot* Capture();
+	// Falls back to a full snapshot when entities changed since pBase
+	EcsSnapshot* CaptureDelta(EcsSnapshot* pBase);
+	void Restore(const EcsSnapshot* pSnapshot);
+	// Snapshot goes back to pool once no delta depends on it
+	void Release(EcsSnapshot* pSnapshot);
+
+	uint32_t GetPooledCount() const;
+
+private:
+	struct Component
+	{
+		flecs::id_t id;
+		size_t nSize;
+		flecs::query<> query;
+	};
+
+	// Live column matched to a snapshot column
+	struct LiveColumn
+	{
+		uint32_t nComponent;
+		void* pData;
+		const flecs::entity_t* pEntities;
+		uint32_t nCount;
+	};
+
+	flecs::world* m_pEcs;
+	std::vector<Component> m_Components;
+	std::vector<EcsSnapshot*> m_Snapshots;
+	std::vector<EcsSnapshot*> m_FreeSnapshots;
+
+	std::vector<LiveColumn> m_LiveColumns;
+	std::vector<uint8_t> m_Scratch;
+	std::unordered_map<flecs::entity_t, const uint8_t*> m_EntityValues;
+
+	EcsSnapshot* Acquire();
+	void GatherLiveColumns();
+	bool MatchesLive(const EcsSnapshot& snapshot) const;
+	void RestoreSlow(const EcsSnapshot& layout, const uint8_t* pData);
+};
+
+struct EcsSnapshotterPtr
+{
+	EcsSnapshotter* ptr;
+};
@@ -0,0 +1,473 @@
+#include "ecsSpatial.h"
+#include "ecsPhys.h"
+#include "ecsParallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+// 21 bits per axis, coordinates are biased to be unsigned
+static const int32_t CELL_COORD_BIAS = 1 << 20;
+static const uint64_t CELL_COORD_MASK = (1ull << 21) - 1;
+
+// Below this many queries threads cost more than they save
+static const size_t SPATIAL_BATCH_MIN_PER_THREAD = 64;
+
+SpatialIndex::SpatialIndex(float fCellSize) :
+	m_fCellSize(fCellSize),
+	m_fInvCellSize(1.0f / fCellSize),
+	m_nEntityCount(0),
+	m_nUpdate(0),
+	m_nMovedCount(0),
+	m_nLastMovedCount(0)
+{
+
+}
+
+SpatialIndex::~SpatialIndex()
+{
+	Clear();
+}
+
+void SpatialIndex::Clear()
+{
+	m_Cells.clear();
+	m_Proxies.clear();
+	m_TableCopies.clear();
+	m_nEntityCount = 0;
+}
+
+uint32_t SpatialIndex::GetEntityCount() const
+{
+	return m_nEntityCount;
+}
+
+float SpatialIndex::GetCellSize() const
+{
+	return m_fCellSize;
+}
+
+SpatialIndex::CellCoord SpatialIndex::GetCellCoord(const Ogre::Vector3& vPosition) const
+{
+	return CellCoord{
+		static_cast<int32_t>(std::floor(vPosition.x * m_fInvCellSize)),
+		static_cast<int32_t>(std::floor(vPosition.y * m_fInvCellSize)),
+		static_cast<int32_t>(std::floor(vPosition.z * m_fInvCellSize)) };
+}
+
+uint64_t SpatialIndex::GetCellKey(const CellCoord& coord)
+{
+	return (static_cast<uint64_t>(coord.x + CELL_COORD_BIAS) & CELL_COORD_MASK) |
+		((static_cast<uint64_t>(coord.y + CELL_COORD_BIAS) & CELL_COORD_MASK) << 21) |
+		((static_cast<uint64_t>(coord.z + CELL_COORD_BIAS) & CELL_COORD_MASK) << 42);
+}
+
+const SpatialIndex::Cell* SpatialIndex::FindCell(const CellCoord& coord) const
+{
+	auto it = m_Cells.find(GetCellKey(coord));
+	return it != m_Cells.end() ? &it->second : nullptr;
+}
+
+void SpatialIndex::Insert(Proxy& proxy, flecs::entity_t entity, const Ogre::Vector3& vPosition, uint64_t nCellKey)
+{
+	Cell& cell = m_Cells[nCellKey];
+
+	proxy.entity = entity;
+	proxy.nCellKey = nCellKey;
+	proxy.pCell = &cell;
+	proxy.nSlot = static_cast<uint32_t>(cell.entries.size());
+
+	cell.entries.push_back(Entry{ entity, vPosition });
+}
+
+void SpatialIndex::Erase(Proxy& proxy)
+{
+	std::vector<Entry>& entries = proxy.pCell->entries;
+
+	// Swap with the last one and point its proxy to the new slot
+	if (proxy.nSlot != entries.size() - 1)
+	{
+		entries[proxy.nSlot] = entries.back();
+		m_Proxies[static_cast<uint32_t>(entries[proxy.nSlot].entity)].nSlot = proxy.nSlot;
+	}
+	entries.pop_back();
+
+	if (entries.empty())
+		m_Cells.erase(proxy.nCellKey);
+
+	proxy.entity = 0;
+	proxy.pCell = nullptr;
+}
+
+void SpatialIndex::Update(flecs::entity_t entity, const Ogre::Vector3& vPosition)
+{
+	uint32_t nIndex = static_cast<uint32_t>(entity);
+	if (nIndex >= m_Proxies.size())
+		m_Proxies.resize(std::max<size_t>(nIndex + 1, m_Proxies.size() * 2), Proxy{ 0, 0, nullptr, 0 });
+
+	Proxy& proxy = m_Proxies[nIndex];
+	uint64_t nCellKey = GetCellKey(GetCellCoord(vPosition));
+
+	if (proxy.entity == entity)
+	{
+		if (proxy.nCellKey == nCellKey)
+		{
+			proxy.pCell->entries[proxy.nSlot].vPosition = vPosition;
+			return;
+		}
+
+		Erase(proxy);
+		Insert(proxy, entity, vPosition, nCellKey);
+		return;
+	}
+
+	// Index was recycled by flecs, previous owner is gone
+	if (proxy.entity != 0)
+	{
+		Erase(proxy);
+		--m_nEntityCount;
+	}
+
+	Insert(proxy, entity, vPosition, nCellKey);
+	++m_nEntityCount;
+}
+
+void SpatialIndex::Remove(flecs::entity_t entity)
+{
+	uint32_t nIndex = static_cast<uint32_t>(entity);
+	if (nIndex >= m_Proxies.size() || m_Proxies[nIndex].entity != entity)
+		return;
+
+	Erase(m_Proxies[nIndex]);
+	--m_nEntityCount;
+}
+
+void SpatialIndex::UpdateTable(const ecs_table_t* pTable, const flecs::entity_t* pEntities, const Ogre::Vector3* pPositions, uint32_t nCount)
+{
+	TableCopy& copy = m_TableCopies[pTable];
+	copy.nUpdate = m_nUpdate;
+
+	uint32_t nCopied = static_cast<uint32_t>(std::min<size_t>(copy.entities.size(), nCount));
+	if (nCopied == nCount && nCount == copy.entities.size() &&
+		memcmp(copy.entities.data(), pEntities, nCount * sizeof(flecs::entity_t)) == 0 &&
+		memcmp(copy.positions.data(), pPositions, nCount * sizeof(Ogre::Vector3)) == 0)
+		return;
+
+	for (uint32_t i = 0; i < nCount; ++i)
+	{
+		if (i < nCopied && copy.entities[i] == pEntities[i] && copy.positions[i] == pPositions[i])
+			continue;
+
+		Update(pEntities[i], pPositions[i]);
+		++m_nMovedCount;
+	}
+
+	copy.entities.assign(pEntities, pEntities + nCount);
+	copy.positions.assign(pPositions, pPositions + nCount);
+}
+
+void SpatialIndex::EndUpdate()
+{
+	for (auto it = m_TableCopies.begin(); it != m_TableCopies.end(); )
+	{
+		if (it->second.nUpdate != m_nUpdate)
+			it = m_TableCopies.erase(it);
+		else
+			++it;
+	}
+
+	++m_nUpdate;
+	m_nLastMovedCount = m_nMovedCount;
+	m_nMovedCount = 0;
+}
+
+void SpatialIndex::ForgetTable(const ecs_table_t* pTable)
+{
+	m_TableCopies.erase(pTable);
+}
+
+uint32_t SpatialIndex::GetMovedCount() const
+{
+	return m_nLastMovedCount;
+}
+
+void SpatialIndex::QueryRadius(const Ogre::Vector3& vCenter, float fRadius, std::vector<flecs::entity_t>& result) const
+{
+	CellCoord minCoord = GetCellCoord(vCenter - Ogre::Vector3(fRadius));
+	CellCoord maxCoord = GetCellCoord(vCenter + Ogre::Vector3(fRadius));
+	float fRadiusSq = fRadius * fRadius;
+
+	for (int32_t z = minCoord.z; z <= maxCoord.z; ++z)
+		for (int32_t y = minCoord.y; y <= maxCoord.y; ++y)
+			for (int32_t x = minCoord.x; x <= maxCoord.x; ++x)
+			{
+				const Cell* pCell = FindCell(CellCoord{ x, y, z });
+				if (!pCell)
+					continue;
+
+				for (const Entry& entry : pCell->entries)
+				{
+					if (entry.vPosition.squaredDistance(vCenter) <= fRadiusSq)
+						result.push_back(entry.entity);
+				}
+			}
+}
+
+void SpatialIndex::QueryAABB(const Ogre::Vector3& vMin, const Ogre::Vector3& vMax, std::vector<flecs::entity_t>& result) const
+{
+	CellCoord minCoord = GetCellCoord(vMin);
+	CellCoord maxCoord = GetCellCoord(vMax);
+
+	for (int32_t z = minCoord.z; z <= maxCoord.z; ++z)
+		for (int32_t y = minCoord.y; y <= maxCoord.y; ++y)
+			for (int32_t x = minCoord.x; x <= maxCoord.x; ++x)
+			{
+				const Cell* pCell = FindCell(CellCoord{ x, y, z });
+				if (!pCell)
+					continue;
+
+				for (const Entry& entry : pCell->entries)
+				{
+					const Ogre::Vector3& vPos = entry.vPosition;
+					if (vPos.x >= vMin.x && vPos.y >= vMin.y && vPos.z >= vMin.z &&
+						vPos.x <= vMax.x && vPos.y <= vMax.y && vPos.z <= vMax.z)
+						result.push_back(entry.entity);
+				}
+			}
+}
+
+void SpatialIndex::QueryNearest(const Ogre::Vector3& vCenter, uint32_t nCount, float fMaxDistance, std::vector<SpatialHit>& result) const
+{
+	if (nCount == 0 || m_nEntityCount == 0)
+		return;
+
+	// Max heap on squared distance, top is the worst of the best
+	std::vector<SpatialHit> best;
+	best.reserve(nCount);
+	auto closer = [](const SpatialHit& a, const SpatialHit& b) { return a.fDistance < b.fDistance; };
+
+	float fMaxDistanceSq = fMaxDistance * fMaxDistance;
+	CellCoord center = GetCellCoord(vCenter);
+	int32_t nMaxRing = static_cast<int32_t>(std::ceil(fMaxDistance * m_fInvCellSize)) + 1;
+	uint32_t nVisited = 0;
+
+	auto visitCell = [&](int32_t x, int32_t y, int32_t z)
+	{
+		const Cell* pCell = FindCell(CellCoord{ x, y, z });
+		if (!pCell)
+			return;
+
+		nVisited += static_cast<uint32_t>(pCell->entries.size());
+		for (const Entry& entry : pCell->entries)
+		{
+			float fDistanceSq = entry.vPosition.squaredDistance(vCenter);
+			if (fDistanceSq > fMaxDistanceSq)
+				continue;
+
+			if (best.size() < nCount)
+			{
+				best.push_back(SpatialHit{ entry.entity, fDistanceSq });
+				std::push_heap(best.begin(), best.end(), closer);
+			}
+			else if (fDistanceSq < best.front().fDistance)
+			{
+				std::pop_heap(best.begin(), best.end(), closer);
+				best.back() = SpatialHit{ entry.entity, fDistanceSq };
+				std::push_heap(best.begin(), best.end(), closer);
+			}
+		}
+	};
+
+	// Walk shells of cells around the center one. Anything outside of ring R
+	// is at least R cells away, so once the k-th hit is closer than that we are done.
+	for (int32_t nRing = 0; nRing <= nMaxRing; ++nRing)
+	{
+		for (int32_t dz = -nRing; dz <= nRing; ++dz)
+			for (int32_t dy = -nRing; dy <= nRing; ++dy)
+			{
+				bool bFace = std::abs(dz) == nRing || std::abs(dy) == nRing;
+				int32_t nStepX = bFace ? 1 : std::max(2 * nRing, 1);
+				for (int32_t dx = -nRing; dx <= nRing; dx += nStepX)
+					visitCell(center.x + dx, center.y + dy, center.z + dz);
+			}
+
+		float fRingDistance = nRing * m_fCellSize;
+		if (best.size() == nCount && best.front().fDistance <= fRingDistance * fRingDistance)
+			break;
+		if (nVisited >= m_nEntityCount)
+			break;
+	}
+
+	std::sort_heap(best.begin(), best.end(), closer);
+	for (SpatialHit& hit : best)
+	{
+		hit.fDistance = std::sqrt(hit.fDistance);
+		result.push_back(hit);
+	}
+}
+
+bool SpatialIndex::Raycast(const Ogre::Vector3& vOrigin, const Ogre::Vector3& vDirection, float fMaxDistance, float fEntityRadius, SpatialHit& hit) const
+{
+	const float fInfinity = std::numeric_limits<float>::infinity();
+
+	CellCoord cell = GetCellCoord(vOrigin);
+	int32_t step[3];
+	float tMax[3];
+	float tDelta[3];
+	int32_t* coord[3] = { &cell.x, &cell.y, &cell.z };
+
+	// Amanatides-Woo grid traversal
+	for (int i = 0; i < 3; ++i)
+	{
+		float fDir = vDirection[i];
+		if (fDir > 0.0f)
+		{
+			step[i] = 1;
+			tMax[i] = ((*coord[i] + 1) * m_fCellSize - vOrigin[i]) / fDir;
+			tDelta[i] = m_fCellSize / fDir;
+		}
+		else if (fDir < 0.0f)
+		{
+			step[i] = -1;
+			tMax[i] = (*coord[i] * m_fCellSize - vOrigin[i]) / fDir;
+			tDelta[i] = -m_fCellSize / fDir;
+		}
+		else
+		{
+			step[i] = 0;
+			tMax[i] = fInfinity;
+			tDelta[i] = fInfinity;
+		}
+	}
+
+	float fRadiusSq = fEntityRadius * fEntityRadius;
+	float fBest = fInfinity;
+	flecs::entity_t bestEntity = 0;
+
+	// A sphere touching the ray inside a traversed cell has its center in that cell
+	// or in one of its neighbours, as long as entity radius is not above cell size
+	int32_t nNeighbours = fEntityRadius > 0.0f ? 1 : 0;
+
+	auto testCell = [&](const CellCoord& coord)
+	{
+		const Cell* pCell = FindCell(coord);
+		if (!pCell)
+			return;
+
+		for (const Entry& entry : pCell->entries)
+		{
+			Ogre::Vector3 vToCenter = entry.vPosition - vOrigin;
+			float tClosest = vToCenter.dotProduct(vDirection);
+			float fDistanceSq = vToCenter.squaredLength() - tClosest * tClosest;
+			if (fDistanceSq > fRadiusSq)
+				continue;
+
+			float tHalfChord = std::sqrt(fRadiusSq - fDistanceSq);
+			float t = tClosest - tHalfChord;
+			if (t < 0.0f)
+				t = tClosest + tHalfChord;
+
+			if (t >= 0.0f && t <= fMaxDistance && t < fBest)
+			{
+				fBest = t;
+				bestEntity = entry.entity;
+			}
+		}
+	};
+
+	float tEnter = 0.0f;
+	while (tEnter <= fMaxDistance)
+	{
+		for (int32_t dz = -nNeighbours; dz <= nNeighbours; ++dz)
+			for (int32_t dy = -nNeighbours; dy <= nNeighbours; ++dy)
+				for (int32_t dx = -nNeighbours; dx <= nNeighbours; ++dx)
+					testCell(CellCoord{ cell.x + dx, cell.y + dy, cell.z + dz });
+
+		int nAxis = tMax[0] < tMax[1] ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+		float tExit = tMax[nAxis];
+		if (tExit == fInfinity || (bestEntity != 0 && fBest <= tExit))
+			break;
+
+		*coord[nAxis] += step[nAxis];
+		tMax[nAxis] += tDelta[nAxis];
+		tEnter = tExit;
+	}
+
+	if (bestEntity == 0)
+		return false;
+
+	hit.entity = bestEntity;
+	hit.fDistance = fBest;
+	return true;
+}
+
+void SpatialIndex::QueryRadiusBatch(const std::vector<SpatialRadiusQuery>& queries, std::vector<flecs::entity_t>& results,
+	std::vector<uint32_t>& offsets, uint32_t nThreadCount) const
+{
+	results.clear();
+	offsets.assign(queries.size() + 1, 0);
+
+	if (nThreadCount == 0)
+		nThreadCount = JobSystem::Get() ? JobSystem::Get()->GetWorkerCount() : 1;
+	size_t nMaxThreads = std::max<size_t>(queries.size() / SPATIAL_BATCH_MIN_PER_THREAD, 1);
+	nThreadCount = static_cast<uint32_t>(std::min<size_t>(nThreadCount, nMaxThreads));
+
+	// Every job takes a contiguous range of queries into its own buffer,
+	// buffers are concatenated in order afterwards
+	std::vector<std::vector<flecs::entity_t>> threadResults(nThreadCount);
+
+	parallel_for(queries.size(), SPATIAL_BATCH_MIN_PER_THREAD, nThreadCount,
+		[&](uint32_t nThread, size_t nBegin, size_t nEnd)
+		{
+			std::vector<flecs::entity_t>& local = threadResults[nThread];
+
+			for (size_t i = nBegin; i < nEnd; ++i)
+			{
+				size_t nBefore = local.size();
+				QueryRadius(queries[i].vCenter, queries[i].fRadius, local);
+				offsets[i + 1] = static_cast<uint32_t>(local.size() - nBefore);
+			}
+		});
+
+	// Counts to offsets
+	for (size_t i = 0; i < queries.size(); ++i)
+		offsets[i + 1] += offsets[i];
+
+	results.reserve(offsets.back());
+	for (const std::vector<flecs::entity_t>& local : threadResults)
+		results.insert(results.end(), local.begin(), local.end());
+}
+
+void register_ecs_spatial_systems(flecs::world* ecs, EcsScheduler* pScheduler, SpatialIndex* pSpatialIndex)
+{
+	// Runs after physics settled positions, so queries during next frame see this frame's state
+	auto spatialUpdate = ecs->system<const Position>("SpatialIndexUpdate")
+		.kind(0)
+		.iter([pSpatialIndex](flecs::iter& it, const Position* positions)
+			{
+				const ecs_iter_t* pIter = it.c_ptr();
+				pSpatialIndex->UpdateTable(pIter->table, pIter->entities, positions, static_cast<uint32_t>(it.count()));
+			});
+	pScheduler->AddSystem(EcsPhase::TransformSync, spatialUpdate)
+		.Reads<Position>()
+		.Writes<SpatialIndexPtr>();
+
+	auto spatialEndUpdate = ecs->system<SpatialIndexPtr>("SpatialIndexEndUpdate")
+		.kind(0)
+		.each([](SpatialIndexPtr& spatialIndex)
+			{
+				spatialIndex.ptr->EndUpdate();
+			});
+	pScheduler->AddSystem(EcsPhase::TransformSync, spatialEndUpdate)
+		.Writes<SpatialIndexPtr>();
+
+	// Rows of the table shift once the entity leaves it
+	ecs->trigger<const Position>("SpatialIndexRemove")
+		.event(flecs::OnRemove)
+		.each([pSpatialIndex](flecs::entity e, const Position&)
+			{
+				pSpatialIndex->Remove(e.id());
+				pSpatialIndex->ForgetTable(ecs_get_table(e.world().c_ptr(), e.id()));
+			});
+}
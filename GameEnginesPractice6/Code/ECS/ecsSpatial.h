@@ -0,0 +1,127 @@
+#pragma once
+#include "flecs.h"
+#include "ecsScheduler.h"
+#include <OgreVector3.h>
+
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+struct SpatialRadiusQuery
+{
+	Ogre::Vector3 vCenter;
+	float fRadius;
+};
+
+struct SpatialHit
+{
+	flecs::entity_t entity;
+	float fDistance;
+};
+
+// Hashed uniform grid over Position. Entities are points, kept in the cell
+// their position falls into and moved between cells only when they cross a border.
+// Updated by SpatialIndexUpdate system at TransformSync, queries see positions of that moment.
+// Only entities that moved since the previous update touch the grid, see UpdateTable.
+// Queries are const and can run from any number of threads as long as no update runs.
+class SpatialIndex
+{
+public:
+	SpatialIndex(float fCellSize = 10.0f);
+	~SpatialIndex();
+	SpatialIndex(const SpatialIndex&) = delete;
+	SpatialIndex& operator=(const SpatialIndex&) = delete;
+
+	void Update(flecs::entity_t entity, const Ogre::Vector3& vPosition);
+	void Remove(flecs::entity_t entity);
+	void Clear();
+
+	// Rows of one table. flecs doesn't report writes made in place, so the column is compared
+	// with its copy from the previous update: an unchanged table costs one memcmp and only
+	// rows whose entity or position differ are passed to Update.
+	void UpdateTable(const ecs_table_t* pTable, const flecs::entity_t* pEntities, const Ogre::Vector3* pPositions, uint32_t nCount);
+	// After the last UpdateTable of an update, drops copies of tables that weren't updated
+	void EndUpdate();
+	// Next UpdateTable of the table checks every row, call when an entity leaves it
+	void ForgetTable(const ecs_table_t* pTable);
+	// Rows UpdateTable passed to Update during the last update
+	uint32_t GetMovedCount() const;
+
+	uint32_t GetEntityCount() const;
+	float GetCellSize() const;
+
+	// Results are appended, nothing is cleared
+	void QueryRadius(const Ogre::Vector3& vCenter, float fRadius, std::vector<flecs::entity_t>& result) const;
+	void QueryAABB(const Ogre::Vector3& vMin, const Ogre::Vector3& vMax, std::vector<flecs::entity_t>& result) const;
+	// Closest first, at most nCount entities not further than fMaxDistance
+	void QueryNearest(const Ogre::Vector3& vCenter, uint32_t nCount, float fMaxDistance, std::vector<SpatialHit>& result) const;
+	// First entity whose sphere of fEntityRadius is hit. Direction must be normalized,
+	// radius must not exceed cell size.
+	bool Raycast(const Ogre::Vector3& vOrigin, const Ogre::Vector3& vDirection, float fMaxDistance, float fEntityRadius, SpatialHit& hit) const;
+
+	// Results of query i are results[offsets[i] .. offsets[i + 1]).
+	// Large batches are split into nThreadCount jobs, 0 means one per job system worker.
+	void QueryRadiusBatch(const std::vector<SpatialRadiusQuery>& queries, std::vector<flecs::entity_t>& results,
+		std::vector<uint32_t>& offsets, uint32_t nThreadCount = 0) const;
+
+private:
+	struct Entry
+	{
+		flecs::entity_t entity;
+		Ogre::Vector3 vPosition;
+	};
+
+	struct Cell
+	{
+		std::vector<Entry> entries;
+	};
+
+	// Where entity sits in the grid, indexed by flecs entity index (lower 32 bits of id).
+	// unordered_map nodes never move, so cell pointers survive rehashing.
+	struct Proxy
+	{
+		flecs::entity_t entity;
+		uint64_t nCellKey;
+		Cell* pCell;
+		uint32_t nSlot;
+	};
+
+	struct CellCoord
+	{
+		int32_t x, y, z;
+	};
+
+	// Entities and positions of a table as of its last UpdateTable
+	struct TableCopy
+	{
+		std::vector<flecs::entity_t> entities;
+		std::vector<Ogre::Vector3> positions;
+		uint32_t nUpdate;
+	};
+
+	float m_fCellSize;
+	float m_fInvCellSize;
+	uint32_t m_nEntityCount;
+
+	std::unordered_map<uint64_t, Cell> m_Cells;
+	std::vector<Proxy> m_Proxies;
+
+	std::unordered_map<const ecs_table_t*, TableCopy> m_TableCopies;
+	uint32_t m_nUpdate;
+	uint32_t m_nMovedCount;
+	uint32_t m_nLastMovedCount;
+
+	CellCoord GetCellCoord(const Ogre::Vector3& vPosition) const;
+	static uint64_t GetCellKey(const CellCoord& coord);
+	const Cell* FindCell(const CellCoord& coord) const;
+
+	void Insert(Proxy& proxy, flecs::entity_t entity, const Ogre::Vector3& vPosition, uint64_t nCellKey);
+	void Erase(Proxy& proxy);
+};
+
+struct SpatialIndexPtr
+{
+	SpatialIndex* ptr;
+};
+
+void register_ecs_spatial_systems(flecs::world* ecs, EcsScheduler* pScheduler, SpatialIndex* pSpatialIndex);
@@ -5,14 +5,18 @@
 #include "flecs.h"
 #include "../Input/InputHandler.h"
 
-void register_ecs_static_systems(flecs::world* ecs)
+void register_ecs_static_systems(flecs::world* ecs, EcsScheduler* pScheduler)
 {
 	static auto renderSystemQuery = ecs->query<RenderNode>();
 
-	ecs->system<const Static, RenderNodeComponent, ScriptNodeComponent>()
+	auto staticSync = ecs->system<const Static, RenderNodeComponent, ScriptNodeComponent>("StaticSync")
+		.kind(0)
 		.each([&](flecs::entity e, const Static&, RenderNodeComponent& renderNode, ScriptNodeComponent& scriptNode)
 			{
 				renderNode.ptr->SetStatic(scriptNode.ptr->GetIsStatic());
 			});
+	pScheduler->AddSystem(EcsPhase::RenderSubmit, staticSync)
+		.Reads<Static>()
+		.Writes<ScriptNodeComponent>()
+		.Writes<RenderNodeComponent>();
 }
-
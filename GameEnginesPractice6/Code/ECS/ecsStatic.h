@@ -1,7 +1,8 @@
 #pragma once
 #include "flecs.h"
+#include "ecsScheduler.h"
 
 struct Static {};
 
-void register_ecs_static_systems(flecs::world* ecs);
+void register_ecs_static_systems(flecs::world* ecs, EcsScheduler* pScheduler);
 
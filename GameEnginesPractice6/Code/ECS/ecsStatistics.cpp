@@ -0,0 +1,180 @@
+#include "ecsStatistics.h"
+
+#include <algorithm>
+#include <fstream>
+
+EcsStatistics::EcsStatistics(uint32_t nWindowSize) :
+	m_nWindowSize(std::max(nWindowSize, 1u)),
+	m_nFrame(0),
+	m_fDumpPeriod(0.0f),
+	m_fTimeSinceDump(0.0f)
+{
+	m_SortBuffer.reserve(m_nWindowSize);
+}
+
+EcsStatistics::~EcsStatistics()
+{
+
+}
+
+uint32_t EcsStatistics::AddSystem(const std::string& strName, const std::string& strPhase)
+{
+	EcsSystemStats stats = {};
+	stats.strName = strName;
+	stats.strPhase = strPhase;
+	m_SystemStats.push_back(stats);
+
+	TimeWindow window;
+	window.samples.resize(m_nWindowSize, 0.0f);
+	window.nNext = 0;
+	window.nCount = 0;
+	window.bRanThisFrame = false;
+	m_Windows.push_back(window);
+
+	return static_cast<uint32_t>(m_SystemStats.size() - 1);
+}
+
+void EcsStatistics::Record(uint32_t nSystem, float fTimeMs, uint32_t nEntities, uint32_t nTables)
+{
+	EcsSystemStats& stats = m_SystemStats[nSystem];
+	stats.fTimeMs = fTimeMs;
+	stats.nEntities = nEntities;
+	stats.nTables = nTables;
+	++stats.nFramesRun;
+
+	m_Windows[nSystem].bRanThisFrame = true;
+}
+
+void EcsStatistics::UpdateWindow(uint32_t nSystem)
+{
+	EcsSystemStats& stats = m_SystemStats[nSystem];
+	TimeWindow& window = m_Windows[nSystem];
+
+	window.samples[window.nNext] = stats.fTimeMs;
+	window.nNext = (window.nNext + 1) % m_nWindowSize;
+	window.nCount = std::min(window.nCount + 1, m_nWindowSize);
+
+	m_SortBuffer.assign(window.samples.begin(), window.samples.begin() + window.nCount);
+
+	float fSum = 0.0f;
+	for (float fSample : m_SortBuffer)
+		fSum += fSample;
+
+	size_t nP99 = (m_SortBuffer.size() * 99) / 100;
+	std::nth_element(m_SortBuffer.begin(), m_SortBuffer.begin() + nP99, m_SortBuffer.end());
+
+	stats.fP99TimeMs = m_SortBuffer[nP99];
+	stats.fMinTimeMs = *std::min_element(m_SortBuffer.begin(), m_SortBuffer.begin() + nP99 + 1);
+	stats.fAvgTimeMs = fSum / m_SortBuffer.size();
+}
+
+void EcsStatistics::EndFrame(float dt)
+{
+	for (uint32_t nSystem = 0; nSystem < m_SystemStats.size(); ++nSystem)
+	{
+		// Systems skipped this frame (timers, rates) don't pollute the window
+		if (!m_Windows[nSystem].bRanThisFrame)
+			continue;
+
+		UpdateWindow(nSystem);
+		m_Windows[nSystem].bRanThisFrame = false;
+	}
+
+	++m_nFrame;
+
+	if (m_strDumpPath.empty())
+		return;
+
+	m_fTimeSinceDump += dt;
+	if (m_fTimeSinceDump >= m_fDumpPeriod)
+	{
+		m_fTimeSinceDump = 0.0f;
+		Dump(m_strDumpPath);
+	}
+}
+
+const std::vector<EcsSystemStats>& EcsStatistics::GetSystemStats() const
+{
+	return m_SystemStats;
+}
+
+void EcsStatistics::EnableDump(const std::string& strPath, float fPeriod)
+{
+	m_strDumpPath = strPath;
+	m_fDumpPeriod = fPeriod;
+	m_fTimeSinceDump = 0.0f;
+}
+
+void EcsStatistics::DisableDump()
+{
+	m_strDumpPath.clear();
+}
+
+bool EcsStatistics::Dump(const std::string& strPath) const
+{
+	const std::string strJsonExt = ".json";
+	if (strPath.size() >= strJsonExt.size() &&
+		strPath.compare(strPath.size() - strJsonExt.size(), strJsonExt.size(), strJsonExt) == 0)
+	{
+		return DumpJSON(strPath);
+	}
+
+	return DumpCSV(strPath);
+}
+
+bool EcsStatistics::DumpCSV(const std::string& strPath) const
+{
+	std::ifstream existing(strPath);
+	bool bWriteHeader = !existing.good();
+	existing.close();
+
+	std::ofstream file(strPath, std::ios::app);
+	if (!file.is_open())
+		return false;
+
+	if (bWriteHeader)
+		file << "frame,phase,system,time_ms,min_ms,avg_ms,p99_ms,entities,tables\n";
+
+	for (const EcsSystemStats& stats : m_SystemStats)
+	{
+		file << m_nFrame << ','
+			<< stats.strPhase << ','
+			<< stats.strName << ','
+			<< stats.fTimeMs << ','
+			<< stats.fMinTimeMs << ','
+			<< stats.fAvgTimeMs << ','
+			<< stats.fP99TimeMs << ','
+			<< stats.nEntities << ','
+			<< stats.nTables << '\n';
+	}
+
+	return true;
+}
+
+bool EcsStatistics::DumpJSON(const std::string& strPath) const
+{
+	std::ofstream file(strPath, std::ios::app);
+	if (!file.is_open())
+		return false;
+
+	file << "{\"frame\":" << m_nFrame << ",\"systems\":[";
+	for (size_t i = 0; i < m_SystemStats.size(); ++i)
+	{
+		const EcsSystemStats& stats = m_SystemStats[i];
+		if (i > 0)
+			file << ',';
+
+		file << "{\"phase\":\"" << stats.strPhase << '"'
+			<< ",\"system\":\"" << stats.strName << '"'
+			<< ",\"time_ms\":" << stats.fTimeMs
+			<< ",\"min_ms\":" << stats.fMinTimeMs
+			<< ",\"avg_ms\":" << stats.fAvgTimeMs
+			<< ",\"p99_ms\":" << stats.fP99TimeMs
+			<< ",\"entities\":" << stats.nEntities
+			<< ",\"tables\":" << stats.nTables
+			<< '}';
+	}
+	file << "]}\n";
+
+	return true;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "flecs.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+struct EcsSystemStats
+{
+	std::string strName;
+	std::string strPhase;
+
+	// Last frame
+	float fTimeMs;
+	uint32_t nEntities;
+	uint32_t nTables;
+
+	// Over the rolling window
+	float fMinTimeMs;
+	float fAvgTimeMs;
+	float fP99TimeMs;
+
+	uint64_t nFramesRun;
+};
+
+// Per-system timing and throughput, collected by EcsScheduler.
+// Record is called from worker threads, but every system only from one thread per frame.
+class EcsStatistics
+{
+public:
+	EcsStatistics(uint32_t nWindowSize = 240);
+	~EcsStatistics();
+	EcsStatistics(const EcsStatistics&) = delete;
+	EcsStatistics& operator=(const EcsStatistics&) = delete;
+
+	uint32_t AddSystem(const std::string& strName, const std::string& strPhase);
+	void Record(uint32_t nSystem, float fTimeMs, uint32_t nEntities, uint32_t nTables);
+	void EndFrame(float dt);
+
+	const std::vector<EcsSystemStats>& GetSystemStats() const;
+
+	// Format is taken from extension: ".json" writes one json object per line, anything else is csv
+	void EnableDump(const std::string& strPath, float fPeriod);
+	void DisableDump();
+	bool Dump(const std::string& strPath) const;
+
+private:
+	struct TimeWindow
+	{
+		std::vector<float> samples;
+		uint32_t nNext;
+		uint32_t nCount;
+		bool bRanThisFrame;
+	};
+
+	uint32_t m_nWindowSize;
+	uint64_t m_nFrame;
+
+	std::vector<EcsSystemStats> m_SystemStats;
+	std::vector<TimeWindow> m_Windows;
+	std::vector<float> m_SortBuffer;
+
+	std::string m_strDumpPath;
+	float m_fDumpPeriod;
+	float m_fTimeSinceDump;
+
+	void UpdateWindow(uint32_t nSystem);
+	bool DumpCSV(const std::string& strPath) const;
+	bool DumpJSON(const std::string& strPath) const;
+};
@@ -0,0 +1,331 @@
+#include "ecsTransform.h"
+#include "ecsParallel.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+// Spawning threads only pays off for wide levels
+static const size_t TRANSFORM_MIN_NODES_PER_THREAD = 2048;
+
+TransformHierarchy::TransformHierarchy(flecs::world* ecs, uint32_t nThreadCount) :
+	m_pEcs(ecs),
+	m_nThreadCount(std::max(nThreadCount, 1u)),
+	m_nAttachedCount(0),
+	m_nDirtyCount(0)
+{
+	m_nodeQuery = m_pEcs->query_builder<const LocalPosition, LocalOrientation*, Position, Orientation*>()
+		.term<AttachedTo>(flecs::Wildcard)
+		.build();
+
+	m_LevelOffsets.push_back(0);
+}
+
+TransformHierarchy::~TransformHierarchy()
+{
+
+}
+
+uint32_t TransformHierarchy::GetNodeCount() const
+{
+	return static_cast<uint32_t>(m_Nodes.size());
+}
+
+uint32_t TransformHierarchy::GetLevelCount() const
+{
+	return static_cast<uint32_t>(m_LevelOffsets.size() - 1);
+}
+
+uint32_t TransformHierarchy::GetDirtyCount() const
+{
+	return m_nDirtyCount;
+}
+
+void TransformHierarchy::Update()
+{
+	std::fill(m_Dirty.begin(), m_Dirty.end(), 0);
+
+	if (!Gather())
+	{
+		Rebuild();
+		Gather();
+	}
+
+	if (m_Nodes.empty())
+	{
+		m_nDirtyCount = 0;
+		return;
+	}
+
+	UpdateRoots();
+	Propagate();
+	Scatter();
+}
+
+int32_t TransformHierarchy::FindNode(flecs::entity_t entity) const
+{
+	uint32_t nIndex = static_cast<uint32_t>(entity);
+	if (nIndex >= m_NodeOfEntity.size())
+		return -1;
+
+	// Index may have been recycled by a newer generation
+	int32_t nNode = m_NodeOfEntity[nIndex];
+	if (nNode < 0 || m_Nodes[nNode].entity != entity)
+		return -1;
+
+	return nNode;
+}
+
+bool TransformHierarchy::Gather()
+{
+	bool bValid = true;
+	uint32_t nSeen = 0;
+
+	m_nodeQuery.iter([&](flecs::iter& it, const LocalPosition* localPos, LocalOrientation* localOrient, Position*, Orientation*)
+		{
+			if (!bValid)
+				return;
+
+			// All entities of a table share the parent, AttachedTo is the 5th term
+			flecs::entity_t parent = it.term_id(5).object().id();
+
+			for (auto i : it)
+			{
+				int32_t nNode = FindNode(it.entity(i).id());
+				if (nNode < 0 || m_Nodes[nNode].parent != parent)
+				{
+					bValid = false;
+					return;
+				}
+				++nSeen;
+
+				Ogre::Quaternion localOrientation = localOrient ? Ogre::Quaternion(localOrient[i]) : Ogre::Quaternion::IDENTITY;
+				if (m_LocalPositions[nNode] != localPos[i] || m_LocalOrientations[nNode] != localOrientation)
+				{
+					m_LocalPositions[nNode] = localPos[i];
+					m_LocalOrientations[nNode] = localOrientation;
+					m_Dirty[nNode] = 1;
+				}
+			}
+		});
+
+	return bValid && nSeen == m_nAttachedCount;
+}
+
+void TransformHierarchy::Rebuild()
+{
+	struct Link
+	{
+		flecs::entity_t entity;
+		flecs::entity_t parent;
+	};
+
+	std::vector<Link> links;
+	m_nodeQuery.iter([&](flecs::iter& it, const LocalPosition*, LocalOrientation*, Position*, Orientation*)
+		{
+			flecs::entity_t parent = it.term_id(5).object().id();
+			for (auto i : it)
+				links.push_back(Link{ it.entity(i).id(), parent });
+		});
+
+	std::unordered_map<flecs::entity_t, uint32_t> linkOf;
+	linkOf.reserve(links.size());
+	for (uint32_t i = 0; i < links.size(); ++i)
+		linkOf[links[i].entity] = i;
+
+	// Depth of every attached entity, walking up parent chains once.
+	// An entity closing a cycle is cut from its parent and becomes a root.
+	std::vector<int32_t> depth(links.size(), -1);
+	std::vector<uint8_t> onPath(links.size(), 0);
+	std::vector<uint8_t> cut(links.size(), 0);
+	std::vector<uint32_t> path;
+	for (uint32_t nLink = 0; nLink < links.size(); ++nLink)
+	{
+		if (depth[nLink] >= 0)
+			continue;
+
+		path.clear();
+		int32_t nBaseDepth = 0;
+		uint32_t j = nLink;
+		while (true)
+		{
+			if (depth[j] >= 0)
+			{
+				nBaseDepth = depth[j];
+				break;
+			}
+			if (onPath[j])
+			{
+				cut[j] = 1;
+				depth[j] = 0;
+				break;
+			}
+
+			onPath[j] = 1;
+			path.push_back(j);
+
+			auto parentLink = linkOf.find(links[j].parent);
+			if (parentLink == linkOf.end())
+				break;
+			j = parentLink->second;
+		}
+
+		int32_t nDepth = nBaseDepth;
+		for (auto it = path.rbegin(); it != path.rend(); ++it)
+		{
+			onPath[*it] = 0;
+			nDepth = cut[*it] ? 0 : nDepth + 1;
+			depth[*it] = nDepth;
+		}
+	}
+
+	// Roots are parents that aren't attached themselves plus cut entities
+	std::vector<flecs::entity_t> roots;
+	for (uint32_t nLink = 0; nLink < links.size(); ++nLink)
+	{
+		if (linkOf.find(links[nLink].parent) == linkOf.end())
+			roots.push_back(links[nLink].parent);
+	}
+	std::sort(roots.begin(), roots.end());
+	roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+	// Ordered by depth, then by id to keep the layout stable between rebuilds
+	std::vector<uint32_t> order(links.size());
+	for (uint32_t nLink = 0; nLink < links.size(); ++nLink)
+		order[nLink] = nLink;
+	std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+		{
+			return depth[a] != depth[b] ? depth[a] < depth[b] : links[a].entity < links[b].entity;
+		});
+
+	m_Nodes.clear();
+	m_LevelOffsets.clear();
+	std::fill(m_NodeOfEntity.begin(), m_NodeOfEntity.end(), -1);
+
+	auto addNode = [&](flecs::entity_t entity, flecs::entity_t parent, int32_t nParent)
+	{
+		uint32_t nIndex = static_cast<uint32_t>(entity);
+		if (nIndex >= m_NodeOfEntity.size())
+			m_NodeOfEntity.resize(nIndex + 1, -1);
+		m_NodeOfEntity[nIndex] = static_cast<int32_t>(m_Nodes.size());
+		m_Nodes.push_back(Node{ entity, parent, nParent });
+	};
+
+	m_LevelOffsets.push_back(0);
+	for (flecs::entity_t root : roots)
+		addNode(root, 0, -1);
+
+	int32_t nCurrentDepth = 0;
+	for (uint32_t nLink : order)
+	{
+		if (depth[nLink] != nCurrentDepth)
+		{
+			nCurrentDepth = depth[nLink];
+			m_LevelOffsets.push_back(static_cast<uint32_t>(m_Nodes.size()));
+		}
+
+		// Parents are on previous levels and already have their node
+		int32_t nParent = cut[nLink] ? -1 : FindNode(links[nLink].parent);
+		addNode(links[nLink].entity, links[nLink].parent, nParent);
+	}
+	m_LevelOffsets.push_back(static_cast<uint32_t>(m_Nodes.size()));
+
+	m_nAttachedCount = static_cast<uint32_t>(links.size());
+
+	size_t nNodeCount = m_Nodes.size();
+	m_LocalPositions.assign(nNodeCount, Ogre::Vector3::ZERO);
+	m_LocalOrientations.assign(nNodeCount, Ogre::Quaternion::IDENTITY);
+	m_WorldPositions.assign(nNodeCount, Ogre::Vector3::ZERO);
+	m_WorldOrientations.assign(nNodeCount, Ogre::Quaternion::IDENTITY);
+	// Everything is recomputed after a rebuild
+	m_Dirty.assign(nNodeCount, 1);
+}
+
+void TransformHierarchy::UpdateRoots()
+{
+	for (uint32_t nNode = m_LevelOffsets[0]; nNode < m_LevelOffsets[1]; ++nNode)
+	{
+		flecs::entity root(m_pEcs->c_ptr(), m_Nodes[nNode].entity);
+		if (!root.is_alive())
+			continue;
+
+		const Position* pPosition = root.get<Position>();
+		const Orientation* pOrientation = root.get<Orientation>();
+		Ogre::Vector3 vPosition = pPosition ? Ogre::Vector3(*pPosition) : Ogre::Vector3::ZERO;
+		Ogre::Quaternion orientation = pOrientation ? Ogre::Quaternion(*pOrientation) : Ogre::Quaternion::IDENTITY;
+
+		if (m_WorldPositions[nNode] != vPosition || m_WorldOrientations[nNode] != orientation)
+		{
+			m_WorldPositions[nNode] = vPosition;
+			m_WorldOrientations[nNode] = orientation;
+			m_Dirty[nNode] = 1;
+		}
+	}
+}
+
+void TransformHierarchy::Propagate()
+{
+	// Level by level, a level only reads results of the previous one
+	for (size_t nLevel = 1; nLevel + 1 < m_LevelOffsets.size(); ++nLevel)
+	{
+		uint32_t nFirst = m_LevelOffsets[nLevel];
+		uint32_t nCount = m_LevelOffsets[nLevel + 1] - nFirst;
+
+		parallel_for(nCount, TRANSFORM_MIN_NODES_PER_THREAD, m_nThreadCount, [&](uint32_t, size_t nBegin, size_t nEnd)
+			{
+				for (size_t i = nBegin; i < nEnd; ++i)
+				{
+					uint32_t nNode = nFirst + static_cast<uint32_t>(i);
+					int32_t nParent = m_Nodes[nNode].nParent;
+
+					m_Dirty[nNode] |= m_Dirty[nParent];
+					if (!m_Dirty[nNode])
+						continue;
+
+					const Ogre::Quaternion& parentOrientation = m_WorldOrientations[nParent];
+					m_WorldPositions[nNode] = m_WorldPositions[nParent] + parentOrientation * m_LocalPositions[nNode];
+					m_WorldOrientations[nNode] = parentOrientation * m_LocalOrientations[nNode];
+				}
+			});
+	}
+}
+
+void TransformHierarchy::Scatter()
+{
+	uint32_t nFirstAttached = m_LevelOffsets.size() > 1 ? m_LevelOffsets[1] : 0;
+	uint32_t nDirtyCount = 0;
+
+	m_nodeQuery.iter([&](flecs::iter& it, const LocalPosition*, LocalOrientation*, Position* pos, Orientation* orient)
+		{
+			for (auto i : it)
+			{
+				int32_t nNode = FindNode(it.entity(i).id());
+				// Cut entities are roots, they keep their own transform
+				if (nNode < static_cast<int32_t>(nFirstAttached) || m_Nodes[nNode].nParent < 0 || !m_Dirty[nNode])
+					continue;
+
+				static_cast<Ogre::Vector3&>(pos[i]) = m_WorldPositions[nNode];
+				if (orient)
+					static_cast<Ogre::Quaternion&>(orient[i]) = m_WorldOrientations[nNode];
+				++nDirtyCount;
+			}
+		});
+
+	m_nDirtyCount = nDirtyCount;
+}
+
+void register_ecs_transform_systems(flecs::world* ecs, EcsScheduler* pScheduler)
+{
+	// Runs before render and spatial sync, after everything that moves roots
+	auto transformPropagate = ecs->system<TransformHierarchyPtr>("TransformPropagate")
+		.kind(0)
+		.each([&](TransformHierarchyPtr& hierarchy)
+			{
+				hierarchy.ptr->Update();
+			});
+	pScheduler->AddSystem(EcsPhase::TransformSync, transformPropagate)
+		.Reads<LocalPosition>()
+		.Reads<LocalOrientation>()
+		.Writes<Position>()
+		.Writes<Orientation>()
+		.Writes<TransformHierarchyPtr>();
+}
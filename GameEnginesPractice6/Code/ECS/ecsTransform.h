@@ -0,0 +1,91 @@
+#pragma once
+#include "flecs.h"
+#include "ecsScheduler.h"
+#include "ecsPhys.h"
+#include <OgreVector3.h>
+#include <OgreQuaternion.h>
+
+#include <vector>
+#include <cstdint>
+#include <thread>
+
+// Relation, child.add<AttachedTo>(parent). Not ChildOf on purpose:
+// destroying a parent must not delete children behind EntityManager's back,
+// they are detached instead and keep their last world transform.
+struct AttachedTo {};
+
+// Transform relative to the parent. Position and Orientation of an attached
+// entity are world space results owned by TransformHierarchy, nobody else should write them.
+struct LocalPosition : public Ogre::Vector3
+{
+	using Ogre::Vector3::Vector3;
+};
+
+struct LocalOrientation : public Ogre::Quaternion
+{
+	using Ogre::Quaternion::Quaternion;
+};
+
+// Computes world Position/Orientation of attached entities.
+// Nodes are kept flat, sorted by depth, so parents are always resolved before children
+// and every level is processed in parallel. Only nodes whose local transform or
+// any ancestor changed are recomputed and written back.
+class TransformHierarchy
+{
+public:
+	TransformHierarchy(flecs::world* ecs, uint32_t nThreadCount = std::thread::hardware_concurrency());
+	~TransformHierarchy();
+	TransformHierarchy(const TransformHierarchy&) = delete;
+	TransformHierarchy& operator=(const TransformHierarchy&) = delete;
+
+	void Update();
+
+	uint32_t GetNodeCount() const;
+	uint32_t GetLevelCount() const;
+	// Nodes recomputed by the last update
+	uint32_t GetDirtyCount() const;
+
+private:
+	struct Node
+	{
+		flecs::entity_t entity;
+		// Object of AttachedTo, 0 for roots that aren't attached
+		flecs::entity_t parent;
+		// Index of parent node, -1 for roots
+		int32_t nParent;
+	};
+
+	flecs::world* m_pEcs;
+	flecs::query<const LocalPosition, LocalOrientation*, Position, Orientation*> m_nodeQuery;
+	uint32_t m_nThreadCount;
+
+	// Level 0 holds roots: parents that aren't attached to anything themselves.
+	// Nodes of level i are m_Nodes[m_LevelOffsets[i] .. m_LevelOffsets[i + 1])
+	std::vector<Node> m_Nodes;
+	std::vector<uint32_t> m_LevelOffsets;
+	// Node of an entity by flecs entity index (lower 32 bits of id), -1 if none
+	std::vector<int32_t> m_NodeOfEntity;
+	uint32_t m_nAttachedCount;
+	uint32_t m_nDirtyCount;
+
+	std::vector<Ogre::Vector3> m_LocalPositions;
+	std::vector<Ogre::Quaternion> m_LocalOrientations;
+	std::vector<Ogre::Vector3> m_WorldPositions;
+	std::vector<Ogre::Quaternion> m_WorldOrientations;
+	std::vector<uint8_t> m_Dirty;
+
+	int32_t FindNode(flecs::entity_t entity) const;
+	// Returns false if the set of attached entities or their parents changed
+	bool Gather();
+	void Rebuild();
+	void UpdateRoots();
+	void Propagate();
+	void Scatter();
+};
+
+struct TransformHierarchyPtr
+{
+	TransformHierarchy* ptr;
+};
+
+void register_ecs_transform_systems(flecs::world* ecs, EcsScheduler* pScheduler);
@@ -1,77 +1,362 @@
 #include "EntityManager.h"
+#include "ECS/ecsTransform.h"
+
+#include <windows.h>
+
+// Script that is missing or doesn't compile leaves nothing to drive the entity
+static void LogScriptFailure(const std::string& strScriptName)
+{
+	OutputDebugStringA(("EntityManager: can't create script " + strScriptName + ", entity skipped\n").c_str());
+}
 
 EntityManager::EntityManager(RenderEngine* pRenderEngine, ScriptSystem* pScriptSystem, flecs::world* ecs) :
 	m_pRenderEngine(pRenderEngine),
 	m_pEcs(ecs),
-	m_pScriptSystem(pScriptSystem)
+	m_pScriptSystem(pScriptSystem),
+	m_nRetireFrame(0)
 {
-
+	m_pRenderNodePool = new RenderNodePool();
 }
 
 EntityManager::~EntityManager()
 {
-	m_entityQueue.clear();
+	m_Entities.clear();
+	m_DenseHandles.clear();
+	m_Slots.clear();
+	m_FreeSlots.clear();
+	SAFE_DELETE(m_pRenderNodePool);
+}
+
+EntityHandle EntityManager::AllocateSlot()
+{
+	uint32_t nIndex;
+	if (!m_FreeSlots.empty())
+	{
+		nIndex = m_FreeSlots.back();
+		m_FreeSlots.pop_back();
+	}
+	else
+	{
+		nIndex = static_cast<uint32_t>(m_Slots.size());
+
+		EntitySlot slot = {};
+		slot.nGeneration = 1;
+		m_Slots.push_back(slot);
+	}
+
+	return EntityHandle{ nIndex, m_Slots[nIndex].nGeneration };
 }
 
-void EntityManager::CreateEntity(std::string strScriptName)
+void EntityManager::FillSlot(EntityHandle handle, flecs::entity ecsEntity, RenderNode* pRenderNode, ScriptNode* pScriptNode)
+{
+	EntitySlot& slot = m_Slots[handle.idx];
+	slot.nDenseIndex = static_cast<uint32_t>(m_Entities.size());
+	slot.bAlive = true;
+	slot.bPendingDestroy = false;
+
+	Entity entity = {};
+	entity.pRenderNode = pRenderNode;
+	entity.pScriptNode = pScriptNode;
+	entity.idx = handle.idx;
+	entity.ecsEntity = ecsEntity;
+
+	m_Entities.push_back(entity);
+	m_DenseHandles.push_back(handle);
+}
+
+EntityHandle EntityManager::CreateEntity(std::string strScriptName)
 {
 	flecs::entity newEntity = m_pEcs->entity();
-	uint32_t nIndex = GetNewIndex();
 
 	ScriptNode* pScriptNode = m_pScriptSystem->CreateScriptNode(strScriptName, newEntity);
+	if (!pScriptNode)
+	{
+		LogScriptFailure(strScriptName);
+		newEntity.destruct();
+		return INVALID_ENTITY_HANDLE;
+	}
+
+	EntityHandle handle = AllocateSlot();
 
 	Ogre::String strMeshName = pScriptNode->GetMeshName();
-	RenderNode* pRenderNode = new RenderNode(nIndex, strMeshName);
+	RenderNode* pRenderNode = m_pRenderNodePool->Allocate(handle.idx, strMeshName);
 
-	newEntity.set(EntityIndex{ nIndex })
+	newEntity.set(EntityIndex{ handle.idx })
 		.set(RenderNodeComponent{ pRenderNode })
 		.set(ScriptNodeComponent{ pScriptNode });
 
 	m_pRenderEngine->GetRT()->RC_CreateSceneNode(pRenderNode);
 
-	Entity entity;
-	entity.pRenderNode = pRenderNode;
-	entity.pScriptNode = pScriptNode;
+	FillSlot(handle, newEntity, pRenderNode, pScriptNode);
 
-	entity.idx = nIndex;
-	
-	m_entityQueue[nIndex] = entity;
+	return handle;
 }
 
 
-void EntityManager::CreateEntity(const EntityInfo &fromSave)
+EntityHandle EntityManager::CreateEntity(const EntityInfo &fromSave)
 {
 	flecs::entity newEntity = m_pEcs->entity();
-	uint32_t nIndex = GetNewIndex();
 
 	ScriptNode* pScriptNode = m_pScriptSystem->CreateScriptNode(fromSave.scriptName, newEntity);
+	if (!pScriptNode)
+	{
+		LogScriptFailure(fromSave.scriptName);
+		newEntity.destruct();
+		return INVALID_ENTITY_HANDLE;
+	}
 	pScriptNode->SetPosition(fromSave.position);
 
+	EntityHandle handle = AllocateSlot();
+
 	Ogre::String strMeshName = fromSave.meshName;
-	RenderNode* pRenderNode = new RenderNode(nIndex, strMeshName);
+	RenderNode* pRenderNode = m_pRenderNodePool->Allocate(handle.idx, strMeshName);
 
-	newEntity.set(EntityIndex{ nIndex })
+	newEntity.set(EntityIndex{ handle.idx })
 		.set(RenderNodeComponent{ pRenderNode })
 		.set(ScriptNodeComponent{ pScriptNode });
 
 	m_pRenderEngine->GetRT()->RC_CreateSceneNode(pRenderNode);
 
-	Entity entity;
-	entity.pRenderNode = pRenderNode;
-	entity.pScriptNode = pScriptNode;
-	//entity.position = fromSave.position;
-	//entity.rotation = fromSave.rotation;
-	entity.idx = nIndex;
+	FillSlot(handle, newEntity, pRenderNode, pScriptNode);
 
-	m_entityQueue[nIndex] = entity;
+	return handle;
 }
 
-uint32_t EntityManager::GetNewIndex() const
+// Every component and tag of the instance is overridden, so entities created from
+// the prefab own their copies and land in the table ScriptNode::Init would move them to
+flecs::entity EntityManager::CreateScriptPrefab(flecs::entity instance)
 {
-	return m_entityQueue.size();
+	flecs::world_t* world = m_pEcs->c_ptr();
+	flecs::entity prefab = m_pEcs->prefab();
+
+	ecs_type_t type = ecs_get_type(world, instance.id());
+	const flecs::id_t* pIds = ecs_vector_first(type, flecs::id_t);
+	int32_t nIdCount = ecs_vector_count(type);
+	for (int32_t i = 0; i < nIdCount; ++i)
+	{
+		// Name is a pair, instances keep their own
+		flecs::id_t id = pIds[i];
+		if (id & ECS_ROLE_MASK)
+			continue;
+
+		ecs_add_id(world, prefab.id(), ECS_OVERRIDE | id);
+
+		const EcsComponent* pComponent = ecs_get(world, id, EcsComponent);
+		if (pComponent && pComponent->size > 0)
+			ecs_set_id(world, prefab.id(), id, pComponent->size, ecs_get_id(world, instance.id(), id));
+	}
+
+	return prefab;
+}
+
+void EntityManager::CreateEntities(uint32_t nCount, const EntityInfo& prototype, std::vector<EntityHandle>* pHandles)
+{
+	if (nCount == 0)
+		return;
+
+	if (pHandles)
+		pHandles->reserve(pHandles->size() + nCount);
+
+	auto scriptPrefab = m_ScriptPrefabs.find(prototype.scriptName);
+	if (scriptPrefab == m_ScriptPrefabs.end())
+	{
+		// What Init adds depends on the script, so its first instance is created on its own
+		// and the components it ended up with make the prefab for the rest
+		EntityHandle handle = CreateEntity(prototype);
+		if (handle == INVALID_ENTITY_HANDLE)
+			return;
+
+		if (pHandles)
+			pHandles->push_back(handle);
+
+		flecs::entity prefab = CreateScriptPrefab(GetEntity(handle)->ecsEntity);
+		scriptPrefab = m_ScriptPrefabs.emplace(prototype.scriptName, prefab).first;
+		if (--nCount == 0)
+			return;
+	}
+
+	const ecs_world_info_t* pWorldInfo = ecs_get_world_info(m_pEcs->c_ptr());
+	m_pEcs->dim(static_cast<int32_t>(pWorldInfo->last_id + nCount));
+	if (m_FreeSlots.size() < nCount)
+		m_Slots.reserve(m_Slots.size() + nCount - m_FreeSlots.size());
+	m_Entities.reserve(m_Entities.size() + nCount);
+	m_DenseHandles.reserve(m_DenseHandles.size() + nCount);
+	m_pRenderNodePool->Reserve(nCount);
+	m_SpawnedRenderNodes.clear();
+	m_SpawnedRenderNodes.reserve(nCount);
+
+	const flecs::entity_t* pEntityIds = ecs_bulk_new_w_id(m_pEcs->c_ptr(),
+		ecs_pair(EcsIsA, scriptPrefab->second.id()), static_cast<int32_t>(nCount));
+
+	// Ids point into flecs internal storage, copy them before touching the world again
+	std::vector<flecs::entity_t> entityIds(pEntityIds, pEntityIds + nCount);
+
+	Ogre::String strMeshName = prototype.meshName;
+	for (uint32_t i = 0; i < nCount; ++i)
+	{
+		flecs::entity newEntity = m_pEcs->entity(entityIds[i]);
+
+		ScriptNode* pScriptNode = m_pScriptSystem->CreateScriptNode(prototype.scriptName, newEntity);
+		if (!pScriptNode)
+		{
+			// Same script for the rest, none of them would get one either
+			LogScriptFailure(prototype.scriptName);
+			for (uint32_t j = i; j < nCount; ++j)
+				m_pEcs->entity(entityIds[j]).destruct();
+			break;
+		}
+		pScriptNode->SetPosition(prototype.position);
+
+		EntityHandle handle = AllocateSlot();
+
+		RenderNode* pRenderNode = m_pRenderNodePool->Allocate(handle.idx, strMeshName);
+
+		// Components already exist, these are writes in place
+		newEntity.set(EntityIndex{ handle.idx })
+			.set(RenderNodeComponent{ pRenderNode })
+			.set(ScriptNodeComponent{ pScriptNode });
+
+		m_SpawnedRenderNodes.push_back(pRenderNode);
+
+		FillSlot(handle, newEntity, pRenderNode, pScriptNode);
+
+		if (pHandles)
+			pHandles->push_back(handle);
+	}
+
+	m_pRenderEngine->GetRT()->RC_CreateSceneNodes(m_SpawnedRenderNodes.data(), static_cast<uint32_t>(m_SpawnedRenderNodes.size()));
 }
 
-std::unordered_map<uint32_t, Entity> EntityManager::GetEntityQueue() const
+void EntityManager::DestroyEntity(EntityHandle handle)
 {
-	return m_entityQueue;
+	std::scoped_lock<std::mutex> lock(m_DestroyMutex);
+
+	if (!IsAlive(handle) || m_Slots[handle.idx].bPendingDestroy)
+		return;
+
+	m_Slots[handle.idx].bPendingDestroy = true;
+	m_PendingDestroy.push_back(handle);
+}
+
+bool EntityManager::IsAlive(EntityHandle handle) const
+{
+	return handle.idx < m_Slots.size() &&
+		m_Slots[handle.idx].bAlive &&
+		m_Slots[handle.idx].nGeneration == handle.generation;
+}
+
+bool EntityManager::AttachEntity(EntityHandle child, EntityHandle parent,
+	const Ogre::Vector3& vLocalPosition, const Ogre::Quaternion& localOrientation)
+{
+	if (child == parent || !IsAlive(child) || !IsAlive(parent))
+		return false;
+
+	DetachEntity(child);
+
+	flecs::entity childEntity = m_Entities[m_Slots[child.idx].nDenseIndex].ecsEntity;
+	flecs::entity parentEntity = m_Entities[m_Slots[parent.idx].nDenseIndex].ecsEntity;
+
+	childEntity.add<AttachedTo>(parentEntity)
+		.set(LocalPosition{ vLocalPosition.x, vLocalPosition.y, vLocalPosition.z })
+		.set(LocalOrientation{ localOrientation.w, localOrientation.x, localOrientation.y, localOrientation.z })
+		.add<Position>()
+		.add<Orientation>();
+
+	return true;
+}
+
+void EntityManager::DetachEntity(EntityHandle child)
+{
+	if (!IsAlive(child))
+		return;
+
+	flecs::entity childEntity = m_Entities[m_Slots[child.idx].nDenseIndex].ecsEntity;
+	flecs::entity oldParent = childEntity.get_object(m_pEcs->id<AttachedTo>());
+	if (oldParent)
+		childEntity.remove<AttachedTo>(oldParent);
+
+	childEntity.remove<LocalPosition>()
+		.remove<LocalOrientation>();
+}
+
+Entity* EntityManager::GetEntity(EntityHandle handle)
+{
+	if (!IsAlive(handle))
+		return nullptr;
+
+	return &m_Entities[m_Slots[handle.idx].nDenseIndex];
+}
+
+uint32_t EntityManager::GetEntityCount() const
+{
+	return static_cast<uint32_t>(m_Entities.size());
+}
+
+EntitySpan<Entity> EntityManager::GetEntities() const
+{
+	return EntitySpan<Entity>{ m_Entities.data(), m_Entities.size() };
+}
+
+EntitySpan<EntityHandle> EntityManager::GetEntityHandles() const
+{
+	return EntitySpan<EntityHandle>{ m_DenseHandles.data(), m_DenseHandles.size() };
+}
+
+void EntityManager::Update()
+{
+	// Nodes destroyed RENDER_NODE_RETIRE_FRAMES ago are no longer touched by render thread
+	m_nRetireFrame = (m_nRetireFrame + 1) % RENDER_NODE_RETIRE_FRAMES;
+	std::vector<RenderNode*>& retired = m_RetiredRenderNodes[m_nRetireFrame];
+	for (RenderNode* pRenderNode : retired)
+		m_pRenderNodePool->Free(pRenderNode);
+	retired.clear();
+
+	DestroyPendingEntities();
+}
+
+void EntityManager::DestroyPendingEntities()
+{
+	{
+		std::scoped_lock<std::mutex> lock(m_DestroyMutex);
+		m_DestroyBuffer.swap(m_PendingDestroy);
+	}
+
+	if (m_DestroyBuffer.empty())
+		return;
+
+	std::vector<RenderNode*>& retired = m_RetiredRenderNodes[m_nRetireFrame];
+	size_t nFirstRetired = retired.size();
+
+	for (const EntityHandle& handle : m_DestroyBuffer)
+	{
+		EntitySlot& slot = m_Slots[handle.idx];
+		Entity& entity = m_Entities[slot.nDenseIndex];
+
+		entity.ecsEntity.destruct();
+		m_pScriptSystem->ReleaseScriptNode(entity.pScriptNode);
+		retired.push_back(entity.pRenderNode);
+
+		// Swap with the last one to keep storage dense
+		uint32_t nLast = static_cast<uint32_t>(m_Entities.size() - 1);
+		if (slot.nDenseIndex != nLast)
+		{
+			m_Entities[slot.nDenseIndex] = m_Entities[nLast];
+			m_DenseHandles[slot.nDenseIndex] = m_DenseHandles[nLast];
+			m_Slots[m_DenseHandles[nLast].idx].nDenseIndex = slot.nDenseIndex;
+		}
+		m_Entities.pop_back();
+		m_DenseHandles.pop_back();
+
+		slot.bAlive = false;
+		slot.bPendingDestroy = false;
+		// Skip 0 on wrap around, it marks invalid handles
+		if (++slot.nGeneration == 0)
+			slot.nGeneration = 1;
+
+		m_FreeSlots.push_back(handle.idx);
+	}
+	m_DestroyBuffer.clear();
+
+	m_pRenderEngine->GetRT()->RC_DestroySceneNodes(retired.data() + nFirstRetired,
+		static_cast<uint32_t>(retired.size() - nFirstRetired));
 }
\ No newline at end of file
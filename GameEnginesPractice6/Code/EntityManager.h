@@ -2,8 +2,13 @@
 
 #include "ScriptSystem/ScriptSystem.h"
 #include "LoadingSystem/LoadingSystem.h"
+#include "RenderNodePool.h"
 #include "string.h"
 
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
 struct EntityInfo
 {
 	std::string meshName;
@@ -19,6 +24,35 @@ struct Entity
 	Ogre::Vector3 position;
 	Ogre::Quaternion rotation;
 	int idx;
+	flecs::entity ecsEntity;
+};
+
+// Slot index plus generation of that slot. Handle goes stale once its
+// entity is destroyed, even if the slot is reused by a new entity.
+struct EntityHandle
+{
+	uint32_t idx;
+	uint32_t generation;
+
+	bool operator==(const EntityHandle& other) const { return idx == other.idx && generation == other.generation; }
+	bool operator!=(const EntityHandle& other) const { return !(*this == other); }
+};
+
+// Generation 0 is never issued
+const EntityHandle INVALID_ENTITY_HANDLE = { 0, 0 };
+
+// Non owning view over contiguous storage. Invalidated by entity creation and destruction.
+template <typename T>
+struct EntitySpan
+{
+	const T* pData;
+	size_t nSize;
+
+	const T* begin() const { return pData; }
+	const T* end() const { return pData + nSize; }
+	size_t size() const { return nSize; }
+	bool empty() const { return nSize == 0; }
+	const T& operator[](size_t i) const { return pData[i]; }
 };
 
 
@@ -30,18 +64,79 @@ public:
 	EntityManager(const EntityManager&) = delete;
 	EntityManager& operator=(const EntityManager&) = delete;
 
-	void CreateEntity(std::string strScriptName);
-	void CreateEntity(const EntityInfo &fromSave);
+	// INVALID_ENTITY_HANDLE and nothing created if the script can't be loaded
+	EntityHandle CreateEntity(std::string strScriptName);
+	EntityHandle CreateEntity(const EntityInfo &fromSave);
+	// Spawns nCount copies of prototype with one flecs bulk creation and one render command.
+	// First spawn of a script creates one instance on its own and keeps its components
+	// as a prefab, later instances start in the table Init would move them to.
+	// Handles of created entities are appended to pHandles
+	void CreateEntities(uint32_t nCount, const EntityInfo& prototype, std::vector<EntityHandle>* pHandles = nullptr);
 
-	std::unordered_map<uint32_t, Entity> GetEntityQueue() const;
+	// Only queues the entity, it is removed on next Update. Safe to call from systems.
+	void DestroyEntity(EntityHandle handle);
+	bool IsAlive(EntityHandle handle) const;
+
+	// Child follows parent with the given local offset, replacing its previous parent.
+	// Destroying parent detaches the child where it stands. Call outside of ecs progress.
+	bool AttachEntity(EntityHandle child, EntityHandle parent,
+		const Ogre::Vector3& vLocalPosition, const Ogre::Quaternion& localOrientation = Ogre::Quaternion::IDENTITY);
+	void DetachEntity(EntityHandle child);
+	// Pointer is valid until next entity creation or destruction
+	Entity* GetEntity(EntityHandle handle);
+	uint32_t GetEntityCount() const;
+
+	// Live entities are kept dense, handles[i] belongs to entities[i]
+	EntitySpan<Entity> GetEntities() const;
+	EntitySpan<EntityHandle> GetEntityHandles() const;
+
+	template <typename Func>
+	void ForEachEntity(Func&& func) const
+	{
+		for (size_t i = 0; i < m_Entities.size(); ++i)
+			func(m_DenseHandles[i], m_Entities[i]);
+	}
+
+	// Call once per frame outside of ecs progress
+	void Update();
 
 private:
 	ScriptSystem* m_pScriptSystem;
 	RenderEngine* m_pRenderEngine;
 	LoadingSystem* m_pLoadingSystem;
 	flecs::world* m_pEcs;
+	RenderNodePool* m_pRenderNodePool;
+	// By script name, see CreateEntities
+	std::unordered_map<std::string, flecs::entity> m_ScriptPrefabs;
+
+	std::vector<RenderNode*> m_SpawnedRenderNodes;
+
+	struct EntitySlot
+	{
+		uint32_t nDenseIndex;
+		uint32_t nGeneration;
+		bool bAlive;
+		bool bPendingDestroy;
+	};
+
+	std::vector<EntitySlot> m_Slots;
+	std::vector<uint32_t> m_FreeSlots;
+
+	std::vector<Entity> m_Entities;
+	std::vector<EntityHandle> m_DenseHandles;
+
+	std::mutex m_DestroyMutex;
+	std::vector<EntityHandle> m_PendingDestroy;
+	std::vector<EntityHandle> m_DestroyBuffer;
 
-	std::unordered_map<uint32_t, Entity> m_entityQueue;
+	// Render thread runs one frame behind, so destroyed render nodes wait
+	// until it surely executed their destroy command before going back to pool
+	static const uint32_t RENDER_NODE_RETIRE_FRAMES = 2;
+	std::vector<RenderNode*> m_RetiredRenderNodes[RENDER_NODE_RETIRE_FRAMES];
+	uint32_t m_nRetireFrame;
 
-	uint32_t GetNewIndex() const;
+	flecs::entity CreateScriptPrefab(flecs::entity instance);
+	EntityHandle AllocateSlot();
+	void FillSlot(EntityHandle handle, flecs::entity ecsEntity, RenderNode* pRenderNode, ScriptNode* pScriptNode);
+	void DestroyPendingEntities();
 };
\ No newline at end of file
@@ -16,6 +16,10 @@ FileSystem::FileSystem()
 	m_strSavesRoot = m_strMediaRoot;
 	m_strSavesRoot.append("Saves");
 	m_strSavesRoot.push_back(cNativeSlash);
+
+	m_strScriptCacheRoot = m_strMediaRoot;
+	m_strScriptCacheRoot.append("ScriptCache");
+	m_strScriptCacheRoot.push_back(cNativeSlash);
 }
 
 FileSystem::~FileSystem()
@@ -35,4 +39,9 @@ const std::string& FileSystem::GetScriptsRoot()
 const std::string& FileSystem::GetSavesRoot()
 {
 	return m_strSavesRoot;
+}
+
+const std::string& FileSystem::GetScriptCacheRoot()
+{
+	return m_strScriptCacheRoot;
 }
\ No newline at end of file
@@ -25,11 +25,13 @@ public:
 	const std::string& GetMediaRoot();
 	const std::string& GetScriptsRoot();
 	const std::string& GetSavesRoot();
+	const std::string& GetScriptCacheRoot();
 
 private:
 	std::string m_strMediaRoot;
 	std::string m_strScriptsRoot;
 	std::string m_strSavesRoot;
+	std::string m_strScriptCacheRoot;
 
 	Lock m_RWLock;
 };
\ No newline at end of file
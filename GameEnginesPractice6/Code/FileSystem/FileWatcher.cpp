@@ -0,0 +1,203 @@
+#include "FileWatcher.h"
+
+#if defined(_WINDOWS)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FileWatcher::FileWatcher(JobSystem* pJobSystem, const std::string& strDirectory, TFileChanged pCallback, void* pUserData) :
+	m_pJobSystem(pJobSystem),
+	m_strDirectory(strDirectory),
+	m_pCallback(pCallback),
+	m_pUserData(pUserData),
+	m_bWatching(false)
+{
+#if defined(_WINDOWS)
+	m_hDirectory = INVALID_HANDLE_VALUE;
+	m_hStopEvent = nullptr;
+#else
+	m_nNotifyFd = -1;
+	m_StopPipe[0] = m_StopPipe[1] = -1;
+#endif
+
+	if (!m_pJobSystem || !Open())
+	{
+		Close();
+		return;
+	}
+
+	m_bWatching = true;
+	m_pJobSystem->SubmitBlocking(Job{ &FileWatcher::RunWatchLoop, this, 0, 0, &m_WatchCounter });
+}
+
+FileWatcher::~FileWatcher()
+{
+	if (m_bWatching)
+	{
+#if defined(_WINDOWS)
+		SetEvent(m_hStopEvent);
+#else
+		char cStop = 0;
+		while (write(m_StopPipe[1], &cStop, 1) < 0 && errno == EINTR)
+			;
+#endif
+		m_pJobSystem->Wait(&m_WatchCounter);
+	}
+
+	Close();
+}
+
+bool FileWatcher::IsWatching() const
+{
+	return m_bWatching;
+}
+
+void FileWatcher::RunWatchLoop(void* pData, size_t, size_t)
+{
+	static_cast<FileWatcher*>(pData)->WatchLoop();
+}
+
+#if defined(_WINDOWS)
+
+bool FileWatcher::Open()
+{
+	m_hDirectory = CreateFileA(m_strDirectory.c_str(), FILE_LIST_DIRECTORY,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+		FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+	if (m_hDirectory == INVALID_HANDLE_VALUE)
+		return false;
+
+	m_hStopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+	return m_hStopEvent != nullptr;
+}
+
+void FileWatcher::Close()
+{
+	if (m_hDirectory != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hDirectory);
+	if (m_hStopEvent)
+		CloseHandle(m_hStopEvent);
+
+	m_hDirectory = INVALID_HANDLE_VALUE;
+	m_hStopEvent = nullptr;
+}
+
+void FileWatcher::WatchLoop()
+{
+	alignas(DWORD) char buffer[16 * 1024];
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+	HANDLE handles[2] = { overlapped.hEvent, m_hStopEvent };
+
+	while (true)
+	{
+		ResetEvent(overlapped.hEvent);
+		if (!ReadDirectoryChangesW(m_hDirectory, buffer, sizeof(buffer), FALSE,
+			FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, nullptr, &overlapped, nullptr))
+			break;
+
+		DWORD nBytes = 0;
+		if (WaitForMultipleObjects(2, handles, FALSE, INFINITE) != WAIT_OBJECT_0 ||
+			!GetOverlappedResult(m_hDirectory, &overlapped, &nBytes, FALSE))
+		{
+			CancelIo(m_hDirectory);
+			GetOverlappedResult(m_hDirectory, &overlapped, &nBytes, TRUE);
+			break;
+		}
+
+		// Zero bytes means the buffer overflowed and changes were lost
+		if (nBytes == 0)
+			continue;
+
+		const char* pEntry = buffer;
+		while (true)
+		{
+			const FILE_NOTIFY_INFORMATION* pInfo = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(pEntry);
+			if (pInfo->Action == FILE_ACTION_MODIFIED || pInfo->Action == FILE_ACTION_ADDED ||
+				pInfo->Action == FILE_ACTION_RENAMED_NEW_NAME)
+			{
+				int nNameLength = static_cast<int>(pInfo->FileNameLength / sizeof(WCHAR));
+				int nSize = WideCharToMultiByte(CP_UTF8, 0, pInfo->FileName, nNameLength, nullptr, 0, nullptr, nullptr);
+				std::string strFileName(nSize, '\0');
+				WideCharToMultiByte(CP_UTF8, 0, pInfo->FileName, nNameLength, &strFileName[0], nSize, nullptr, nullptr);
+				m_pCallback(m_pUserData, strFileName);
+			}
+
+			if (pInfo->NextEntryOffset == 0)
+				break;
+			pEntry += pInfo->NextEntryOffset;
+		}
+	}
+
+	CloseHandle(overlapped.hEvent);
+}
+
+#else
+
+bool FileWatcher::Open()
+{
+	m_nNotifyFd = inotify_init1(IN_CLOEXEC);
+	if (m_nNotifyFd < 0)
+		return false;
+
+	// Editors either rewrite the file or write a new one and rename it over the old one
+	if (inotify_add_watch(m_nNotifyFd, m_strDirectory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+		return false;
+
+	return pipe(m_StopPipe) == 0;
+}
+
+void FileWatcher::Close()
+{
+	if (m_nNotifyFd >= 0)
+		close(m_nNotifyFd);
+	for (int& nFd : m_StopPipe)
+	{
+		if (nFd >= 0)
+			close(nFd);
+		nFd = -1;
+	}
+
+	m_nNotifyFd = -1;
+}
+
+void FileWatcher::WatchLoop()
+{
+	alignas(inotify_event) char buffer[16 * 1024];
+	pollfd fds[2] = { { m_nNotifyFd, POLLIN, 0 }, { m_StopPipe[0], POLLIN, 0 } };
+
+	while (true)
+	{
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+
+		if (fds[1].revents)
+			break;
+
+		ssize_t nBytes = read(m_nNotifyFd, buffer, sizeof(buffer));
+		if (nBytes <= 0)
+		{
+			if (nBytes < 0 && errno == EINTR)
+				continue;
+			break;
+		}
+
+		for (ssize_t nOffset = 0; nOffset < nBytes;)
+		{
+			const inotify_event* pEvent = reinterpret_cast<const inotify_event*>(buffer + nOffset);
+			if (pEvent->len > 0 && !(pEvent->mask & IN_ISDIR))
+				m_pCallback(m_pUserData, pEvent->name);
+			nOffset += sizeof(inotify_event) + pEvent->len;
+		}
+	}
+}
+
+#endif
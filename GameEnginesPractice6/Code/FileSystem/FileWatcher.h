@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+
+#include "../JobSystem/JobSystem.h"
+
+// Called on the watcher thread with the name of a file inside the watched directory
+typedef void (*TFileChanged)(void* pUserData, const std::string& strFileName);
+
+// Reports files written or moved into a directory, subdirectories are not watched.
+// Runs as a blocking job that sleeps in the OS (inotify, ReadDirectoryChangesW)
+// until something changes, so nothing is polled while files stay the same.
+class FileWatcher
+{
+public:
+	FileWatcher(JobSystem* pJobSystem, const std::string& strDirectory, TFileChanged pCallback, void* pUserData);
+	// Stops and waits for the watcher job, callback is not called after it
+	~FileWatcher();
+	FileWatcher(const FileWatcher&) = delete;
+	FileWatcher& operator=(const FileWatcher&) = delete;
+
+	// False if the directory can't be watched or there is no job system to run on
+	bool IsWatching() const;
+
+private:
+	JobSystem* m_pJobSystem;
+	std::string m_strDirectory;
+	TFileChanged m_pCallback;
+	void* m_pUserData;
+
+	JobCounter m_WatchCounter;
+	bool m_bWatching;
+
+#if defined(_WINDOWS)
+	void* m_hDirectory;
+	void* m_hStopEvent;
+#else
+	int m_nNotifyFd;
+	int m_StopPipe[2];
+#endif
+
+	static void RunWatchLoop(void* pData, size_t, size_t);
+	bool Open();
+	void Close();
+	void WatchLoop();
+};
@@ -3,38 +3,152 @@
 #include "ECS/ecsSystems.h"
 #include "ECS/ecsPhys.h"
 #include "ECS/ecsControl.h"
+#include "ECS/ecsScript.h"
+#include "ECS/ecsStatic.h"
+#include "ECS/ecsAllocator.h"
 #include <stdlib.h>
+#include <time.h>
 
 Game::Game()
 {
+	uint32_t nWorkerCount = JOB_SYSTEM_WORKER_COUNT ? JOB_SYSTEM_WORKER_COUNT : std::thread::hardware_concurrency();
+#ifdef ECS_POOL_ALLOCATOR
+	// flecs reads os api once, before the first world exists
+	EcsAllocator::Install();
+#endif
+	m_pJobSystem = new JobSystem(nWorkerCount);
+	m_pJobSystem->InstallEcsThreadHooks();
 	m_pEcs = new flecs::world();
+	m_pEcsScheduler = new EcsScheduler(m_pEcs, m_pJobSystem);
+	m_pSpatialIndex = new SpatialIndex(SPATIAL_INDEX_CELL_SIZE);
+#ifdef DETERMINISTIC_MODE
+	// Per thread partial sums are reduced in thread order, same split gives same bits
+	m_pNBodySolver = new NBodySolver(m_pEcs, DETERMINISTIC_THREAD_COUNT);
+	m_pDeterministicSimulation = new DeterministicSimulation(m_pEcs, DETERMINISTIC_SEED);
+#else
+	m_pNBodySolver = new NBodySolver(m_pEcs);
+	m_pDeterministicSimulation = new DeterministicSimulation(m_pEcs, static_cast<uint64_t>(time(nullptr)));
+#endif
+	m_pTransformHierarchy = new TransformHierarchy(m_pEcs);
+	m_pSnapshotter = new EcsSnapshotter(m_pEcs);
+	m_pUpdateLodScheduler = new UpdateLodScheduler(m_pEcs);
 	m_pFileSystem = new FileSystem();
 	m_pResourceManager = new ResourceManager(m_pFileSystem->GetMediaRoot());
 	m_pInputHandler = new InputHandler(m_pFileSystem->GetMediaRoot());
 	m_pRenderEngine = new RenderEngine(m_pResourceManager);
-	m_pScriptSystem = new ScriptSystem(m_pInputHandler, m_pFileSystem->GetScriptsRoot());
+#if !defined(SCRIPT_PARALLEL_UPDATE)
+	uint32_t nScriptStateCount = 0;
+#elif defined(DETERMINISTIC_MODE)
+	// Scripts are spread over states in creation order and their commands applied
+	// in state order, same state count gives same results
+	uint32_t nScriptStateCount = DETERMINISTIC_THREAD_COUNT;
+#else
+	uint32_t nScriptStateCount = SCRIPT_WORKER_STATES ? SCRIPT_WORKER_STATES : nWorkerCount;
+#endif
+	m_pScriptSystem = new ScriptSystem(m_pInputHandler, m_pFileSystem->GetScriptsRoot(), m_pFileSystem->GetScriptCacheRoot(), nScriptStateCount);
+	m_pScriptSystem->SetSpatialIndex(m_pSpatialIndex);
 	m_pEntityManager = new EntityManager(m_pRenderEngine, m_pScriptSystem, m_pEcs);
 	m_pLoadingSystem = new LoadingSystem(m_pEntityManager, m_pFileSystem->GetSavesRoot());
 
 	m_Timer.Start();
 
+	m_pEcs->entity("jobSystem")
+		.set(JobSystemPtr{ m_pJobSystem });
 	m_pEcs->entity("inputHandler")
 		.set(InputHandlerPtr{ m_pInputHandler });
 	m_pEcs->entity("scriptSystem")
 		.set(ScriptSystemPtr{ m_pScriptSystem });
+	m_pEcs->entity("spatialIndex")
+		.set(SpatialIndexPtr{ m_pSpatialIndex });
+	m_pEcs->entity("nbodySolver")
+		.set(NBodySolverPtr{ m_pNBodySolver });
+	m_pEcs->entity("transformHierarchy")
+		.set(TransformHierarchyPtr{ m_pTransformHierarchy });
+	m_pEcs->entity("deterministicSimulation")
+		.set(DeterministicSimulationPtr{ m_pDeterministicSimulation });
+	m_pEcs->entity("snapshotter")
+		.set(EcsSnapshotterPtr{ m_pSnapshotter });
+	m_pEcs->entity("updateLodScheduler")
+		.set(UpdateLodSchedulerPtr{ m_pUpdateLodScheduler });
+
+	std::vector<float> lodDistances;
+	for (uint32_t nBucket = 1; nBucket < UPDATE_LOD_BUCKET_COUNT; ++nBucket)
+		lodDistances.push_back(UPDATE_LOD_BASE_DISTANCE * (1 << (nBucket - 1)));
+	m_pUpdateLodScheduler->SetBucketDistances(lodDistances);
+
+	// Simulation state saved for rollback and replays
+	m_pSnapshotter->AddComponent<Position>();
+	m_pSnapshotter->AddComponent<Orientation>();
+	m_pSnapshotter->AddComponent<Velocity>();
+	m_pSnapshotter->AddComponent<LocalPosition>();
+	m_pSnapshotter->AddComponent<LocalOrientation>();
+	m_pSnapshotter->AddComponent<CameraPosition>();
 
 	m_pLoadingSystem->LoadFromXML("initialScene.xml");
 
-	register_ecs_mesh_systems(m_pEcs);
-	register_ecs_control_systems(m_pEcs);
-	register_ecs_phys_systems(m_pEcs);
-	register_ecs_script_systems(m_pEcs);
-	register_ecs_static_systems(m_pEcs);
+	const ScriptCacheStats& scriptStats = m_pScriptSystem->GetCacheStats();
+	char szScriptStats[256];
+	snprintf(szScriptStats, sizeof(szScriptStats),
+		"Scripts: %u compiled in %.2f ms, %u loaded from bytecode cache in %.2f ms, %u instanced from memory, %.2f ms of parsing saved\n",
+		scriptStats.nCompiled, scriptStats.fCompileTime, scriptStats.nCacheHits, scriptStats.fCacheLoadTime,
+		scriptStats.nMemoryHits, scriptStats.fParseTimeSaved);
+	OutputDebugStringA(szScriptStats);
+
+	// Phases are ordered by scheduler, but inside of a phase
+	// conflicting systems run in registration order
+	register_ecs_lod_systems(m_pEcs, m_pEcsScheduler);
+	register_ecs_script_systems(m_pEcs, m_pEcsScheduler, m_pScriptSystem);
+	register_ecs_control_systems(m_pEcs, m_pEcsScheduler);
+	register_ecs_gravity_systems(m_pEcs, m_pEcsScheduler);
+	register_ecs_phys_systems(m_pEcs, m_pEcsScheduler, m_pDeterministicSimulation);
+	register_ecs_transform_systems(m_pEcs, m_pEcsScheduler);
+	register_ecs_mesh_systems(m_pEcs, m_pEcsScheduler);
+	register_ecs_spatial_systems(m_pEcs, m_pEcsScheduler, m_pSpatialIndex);
+	register_ecs_static_systems(m_pEcs, m_pEcsScheduler);
+
+#ifdef DETERMINISTIC_MODE
+	m_pEcsScheduler->SetFixedTimestep(DETERMINISTIC_TIMESTEP);
+
+	m_pDeterministicSimulation->AddChecksumComponent<Position>("Position");
+	m_pDeterministicSimulation->AddChecksumComponent<Orientation>("Orientation");
+	m_pDeterministicSimulation->AddChecksumComponent<Velocity>("Velocity");
+	m_pDeterministicSimulation->AddChecksumComponent<Mass>("Mass");
+	m_pDeterministicSimulation->AddChecksumComponent<LocalPosition>("LocalPosition");
+	m_pDeterministicSimulation->AddChecksumComponent<LocalOrientation>("LocalOrientation");
+	m_pDeterministicSimulation->AddChecksumComponent<CameraPosition>("CameraPosition");
+	m_pDeterministicSimulation->EnableChecksumLog(DETERMINISTIC_CHECKSUM_LOG, DETERMINISTIC_TIMESTEP);
+#endif
+
+#ifdef ECS_ALLOCATOR_DUMP_PATH
+	EcsAllocator::EnableDump(ECS_ALLOCATOR_DUMP_PATH, ECS_ALLOCATOR_DUMP_PERIOD);
+#endif
+
+#ifdef SCRIPT_ALLOCATOR_DUMP_PATH
+	m_pScriptSystem->GetAllocator()->EnableDump(SCRIPT_ALLOCATOR_DUMP_PATH, SCRIPT_ALLOCATOR_DUMP_PERIOD);
+#endif
+
+#ifdef ECS_STATS_DUMP_PATH
+	m_pEcsScheduler->EnableStatistics(true);
+	m_pEcsScheduler->GetStatistics()->EnableDump(ECS_STATS_DUMP_PATH, ECS_STATS_DUMP_PERIOD);
+#endif
+
+#ifdef SCRIPT_PROFILER
+	m_pScriptSystem->EnableProfiler(SCRIPT_PROFILER_INSTRUCTION_PERIOD);
+	m_pScriptSystem->GetProfiler()->EnableDump(SCRIPT_PROFILER_DUMP_PATH, SCRIPT_PROFILER_DUMP_PERIOD, SCRIPT_PROFILER_TOP_COUNT);
+#endif
 }
 
 Game::~Game()
 {
+	SAFE_DELETE(m_pEcsScheduler);
+	SAFE_DELETE(m_pNBodySolver);
+	SAFE_DELETE(m_pTransformHierarchy);
+	SAFE_DELETE(m_pDeterministicSimulation);
+	SAFE_DELETE(m_pSnapshotter);
+	SAFE_DELETE(m_pUpdateLodScheduler);
 	SAFE_DELETE(m_pEcs);
+	// Removal trigger fires while world is destroyed
+	SAFE_DELETE(m_pSpatialIndex);
 	SAFE_DELETE(m_pFileSystem);
 	SAFE_DELETE(m_pResourceManager);
 	SAFE_DELETE(m_pInputHandler);
@@ -42,6 +156,7 @@ Game::~Game()
 	SAFE_DELETE(m_pScriptSystem);
 	SAFE_DELETE(m_pEntityManager);
 	SAFE_DELETE(m_pLoadingSystem);
+	SAFE_DELETE(m_pJobSystem);
 }
 
 void Game::Run()
@@ -54,9 +169,6 @@ void Game::Run()
 
 		m_Timer.Tick();
 
-		if (m_pInputHandler)
-			m_pInputHandler->Update();
-
 		if (!Update())
 			break;
 
@@ -66,6 +178,15 @@ void Game::Run()
 
 bool Game::Update()
 {
-	m_pEcs->progress();
+	m_pScriptSystem->ApplyScriptReloads();
+	m_pEcsScheduler->Progress();
+	m_pJobSystem->RunMainThreadJobs();
+	m_pEntityManager->Update();
+	m_pDeterministicSimulation->EndTick();
+	EcsAllocator::EndFrame(m_Timer.DeltaTime());
+	m_pScriptSystem->GetAllocator()->EndFrame(m_Timer.DeltaTime());
+#ifdef SCRIPT_PROFILER
+	m_pScriptSystem->GetProfiler()->EndFrame(m_Timer.DeltaTime());
+#endif
 	return true;
 }
@@ -8,6 +8,14 @@
 #include "EntityManager.h"
 #include "GameTimer.h"
 #include "flecs.h"
+#include "JobSystem/JobSystem.h"
+#include "ECS/ecsScheduler.h"
+#include "ECS/ecsSpatial.h"
+#include "ECS/ecsGravity.h"
+#include "ECS/ecsTransform.h"
+#include "ECS/ecsDeterminism.h"
+#include "ECS/ecsSnapshot.h"
+#include "ECS/ecsLod.h"
 #include "LoadingSystem/LoadingSystem.h"
 
 class Game
@@ -23,7 +31,15 @@ public:
 
 private:
 	GameTimer m_Timer;
+	JobSystem* m_pJobSystem;
 	flecs::world* m_pEcs;
+	EcsScheduler* m_pEcsScheduler;
+	SpatialIndex* m_pSpatialIndex;
+	NBodySolver* m_pNBodySolver;
+	TransformHierarchy* m_pTransformHierarchy;
+	DeterministicSimulation* m_pDeterministicSimulation;
+	EcsSnapshotter* m_pSnapshotter;
+	UpdateLodScheduler* m_pUpdateLodScheduler;
 
 	RenderEngine* m_pRenderEngine;
 	FileSystem* m_pFileSystem;
@@ -0,0 +1,390 @@
+#include "JobSystem.h"
+
+#include "flecs.h"
+
+static JobSystem* g_pJobSystem = nullptr;
+
+// Worker index is only meaningful for the job system that set it
+thread_local JobSystem* t_pWorkerOwner = nullptr;
+thread_local uint32_t t_nWorkerIndex = JobSystem::InvalidWorker;
+thread_local uint32_t t_nStealSeed = 0;
+
+JobCounter::JobCounter() :
+	m_nValue(0)
+{
+
+}
+
+JobCounter::~JobCounter()
+{
+
+}
+
+bool JobCounter::IsDone() const
+{
+	return m_nValue.load(std::memory_order_acquire) == 0;
+}
+
+uint32_t JobCounter::GetValue() const
+{
+	return m_nValue.load(std::memory_order_acquire);
+}
+
+JobSystem::JobSystem(uint32_t nWorkerCount) :
+	m_nWorkerCount(std::max(nWorkerCount, 1u)),
+	m_nQueuedJobs(0),
+	m_nQueuedMainThreadJobs(0),
+	m_nSleeping(0),
+	m_bQuit(false),
+	m_nIdleBlockingThreads(0)
+{
+	m_Queues.reset(new WorkerQueue[m_nWorkerCount]);
+
+	t_pWorkerOwner = this;
+	t_nWorkerIndex = 0;
+	t_nStealSeed = 1;
+
+	for (uint32_t nWorker = 1; nWorker < m_nWorkerCount; ++nWorker)
+		m_Workers.emplace_back(&JobSystem::WorkerLoop, this, nWorker);
+
+	g_pJobSystem = this;
+}
+
+JobSystem::~JobSystem()
+{
+	if (g_pJobSystem == this)
+		g_pJobSystem = nullptr;
+
+	{
+		std::scoped_lock<std::mutex> lock(m_SleepMutex);
+		m_bQuit = true;
+	}
+	m_WakeCond.notify_all();
+
+	for (std::thread& worker : m_Workers)
+		worker.join();
+
+	{
+		std::scoped_lock<std::mutex> lock(m_BlockingMutex);
+	}
+	m_BlockingCond.notify_all();
+
+	for (std::thread& thread : m_BlockingThreads)
+		thread.join();
+
+	if (t_pWorkerOwner == this)
+	{
+		t_pWorkerOwner = nullptr;
+		t_nWorkerIndex = InvalidWorker;
+	}
+}
+
+JobSystem* JobSystem::Get()
+{
+	return g_pJobSystem;
+}
+
+uint32_t JobSystem::GetWorkerCount() const
+{
+	return m_nWorkerCount;
+}
+
+uint32_t JobSystem::GetWorkerIndex() const
+{
+	return t_pWorkerOwner == this ? t_nWorkerIndex : InvalidWorker;
+}
+
+bool JobSystem::IsMainThread() const
+{
+	return GetWorkerIndex() == 0;
+}
+
+void JobSystem::Submit(const Job& job)
+{
+	Submit(&job, 1);
+}
+
+void JobSystem::Submit(const Job* pJobs, uint32_t nCount)
+{
+	for (uint32_t i = 0; i < nCount; ++i)
+	{
+		if (pJobs[i].pCounter)
+			pJobs[i].pCounter->m_nValue.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	Push(GetWorkerIndex(), pJobs, nCount);
+}
+
+void JobSystem::SubmitMainThread(const Job& job)
+{
+	if (job.pCounter)
+		job.pCounter->m_nValue.fetch_add(1, std::memory_order_relaxed);
+
+	m_nQueuedMainThreadJobs.fetch_add(1);
+	{
+		std::scoped_lock<std::mutex> lock(m_MainThreadQueue.mutex);
+		m_MainThreadQueue.jobs.push_back(job);
+	}
+	Wake(true);
+}
+
+void JobSystem::SubmitBlocking(const Job& job)
+{
+	if (job.pCounter)
+		job.pCounter->m_nValue.fetch_add(1, std::memory_order_relaxed);
+
+	std::scoped_lock<std::mutex> lock(m_BlockingMutex);
+	m_BlockingJobs.push_back(job);
+
+	if (m_nIdleBlockingThreads < m_BlockingJobs.size())
+		m_BlockingThreads.emplace_back(&JobSystem::BlockingLoop, this);
+	else
+		m_BlockingCond.notify_one();
+}
+
+void JobSystem::Wait(JobCounter* pCounter)
+{
+	uint32_t nWorker = GetWorkerIndex();
+
+	while (!pCounter->IsDone())
+	{
+		if (TryRunJob(nWorker))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		++m_nSleeping;
+		// Other threads can't run worker jobs, they only wait for the counter
+		m_WakeCond.wait(lock, [&]()
+		{
+			return pCounter->IsDone() ||
+				(nWorker < m_nWorkerCount && m_nQueuedJobs.load() > 0) ||
+				(nWorker == 0 && m_nQueuedMainThreadJobs.load() > 0);
+		});
+		--m_nSleeping;
+	}
+}
+
+void JobSystem::RunMainThreadJobs()
+{
+	Job job;
+	while (m_nQueuedMainThreadJobs.load() > 0 && PopFront(m_MainThreadQueue, job))
+	{
+		m_nQueuedMainThreadJobs.fetch_sub(1);
+		Execute(job);
+	}
+}
+
+void JobSystem::WorkerLoop(uint32_t nWorker)
+{
+	t_pWorkerOwner = this;
+	t_nWorkerIndex = nWorker;
+	t_nStealSeed = nWorker * 0x9E3779B9u + 1;
+
+	while (true)
+	{
+		if (TryRunJob(nWorker))
+			continue;
+
+		std::unique_lock<std::mutex> lock(m_SleepMutex);
+		++m_nSleeping;
+		m_WakeCond.wait(lock, [&]() { return m_bQuit.load() || m_nQueuedJobs.load() > 0; });
+		--m_nSleeping;
+
+		if (m_bQuit)
+			return;
+	}
+}
+
+void JobSystem::BlockingLoop()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_BlockingMutex);
+			++m_nIdleBlockingThreads;
+			m_BlockingCond.wait(lock, [&]() { return m_bQuit.load() || !m_BlockingJobs.empty(); });
+			--m_nIdleBlockingThreads;
+
+			if (m_BlockingJobs.empty())
+				return;
+
+			job = m_BlockingJobs.front();
+			m_BlockingJobs.pop_front();
+		}
+
+		Execute(job);
+	}
+}
+
+void JobSystem::Push(uint32_t nWorker, const Job* pJobs, uint32_t nCount)
+{
+	if (nCount == 0)
+		return;
+
+	// Counted before queued, so it never drops below zero when a thief is fast
+	m_nQueuedJobs.fetch_add(nCount);
+
+	WorkerQueue& queue = nWorker < m_nWorkerCount ? m_Queues[nWorker] : m_SharedQueue;
+	{
+		std::scoped_lock<std::mutex> lock(queue.mutex);
+		queue.jobs.insert(queue.jobs.end(), pJobs, pJobs + nCount);
+	}
+	Wake(nCount > 1);
+}
+
+// Own jobs newest first, they are hot in cache. Foreign threads only take shared jobs,
+// jobs in worker deques may rely on running on a worker (flecs stage per worker)
+bool JobSystem::TryRunJob(uint32_t nWorker)
+{
+	Job job;
+
+	if (nWorker == 0 && m_nQueuedMainThreadJobs.load() > 0 && PopFront(m_MainThreadQueue, job))
+	{
+		m_nQueuedMainThreadJobs.fetch_sub(1);
+		Execute(job);
+		return true;
+	}
+
+	if (m_nQueuedJobs.load() == 0)
+		return false;
+
+	bool bFound = false;
+	if (nWorker < m_nWorkerCount)
+		bFound = Pop(nWorker, job) || PopFront(m_SharedQueue, job) || Steal(nWorker, job);
+	else
+		bFound = PopFront(m_SharedQueue, job);
+
+	if (!bFound)
+		return false;
+
+	m_nQueuedJobs.fetch_sub(1);
+	Execute(job);
+	return true;
+}
+
+bool JobSystem::Pop(uint32_t nWorker, Job& job)
+{
+	WorkerQueue& queue = m_Queues[nWorker];
+	std::scoped_lock<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty())
+		return false;
+
+	job = queue.jobs.back();
+	queue.jobs.pop_back();
+	return true;
+}
+
+// Victims are visited from a random one so thieves don't all hit the same deque
+bool JobSystem::Steal(uint32_t nWorker, Job& job)
+{
+	t_nStealSeed ^= t_nStealSeed << 13;
+	t_nStealSeed ^= t_nStealSeed >> 17;
+	t_nStealSeed ^= t_nStealSeed << 5;
+
+	uint32_t nStart = t_nStealSeed % m_nWorkerCount;
+	for (uint32_t i = 0; i < m_nWorkerCount; ++i)
+	{
+		uint32_t nVictim = (nStart + i) % m_nWorkerCount;
+		if (nVictim != nWorker && PopFront(m_Queues[nVictim], job))
+			return true;
+	}
+
+	return false;
+}
+
+bool JobSystem::PopFront(WorkerQueue& queue, Job& job)
+{
+	std::scoped_lock<std::mutex> lock(queue.mutex);
+	if (queue.jobs.empty())
+		return false;
+
+	job = queue.jobs.front();
+	queue.jobs.pop_front();
+	return true;
+}
+
+void JobSystem::Execute(const Job& job)
+{
+	job.pEntry(job.pData, job.nBegin, job.nEnd);
+
+	if (job.pCounter)
+		Finish(job.pCounter);
+}
+
+void JobSystem::Finish(JobCounter* pCounter)
+{
+	// Waiter may destroy the counter as soon as it reads zero, it's not touched after that
+	if (pCounter->m_nValue.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	// Waiters sleep until either work or their counter shows up
+	Wake(true);
+}
+
+// Sleepers register under the lock before checking their condition,
+// so a waker that sees nobody sleeping can't miss one
+void JobSystem::Wake(bool bAll)
+{
+	if (m_nSleeping.load() == 0)
+		return;
+
+	{
+		std::scoped_lock<std::mutex> lock(m_SleepMutex);
+	}
+
+	if (bAll)
+		m_WakeCond.notify_all();
+	else
+		m_WakeCond.notify_one();
+}
+
+struct EcsThread
+{
+	ecs_os_thread_callback_t callback;
+	void* pParam;
+	void* pResult;
+	JobCounter counter;
+};
+
+static void ecs_thread_job(void* pData, size_t, size_t)
+{
+	EcsThread* pThread = static_cast<EcsThread*>(pData);
+	pThread->pResult = pThread->callback(pThread->pParam);
+}
+
+static ecs_os_thread_t ecs_job_thread_new(ecs_os_thread_callback_t callback, void* param)
+{
+	EcsThread* pThread = new EcsThread();
+	pThread->callback = callback;
+	pThread->pParam = param;
+	pThread->pResult = nullptr;
+
+	// flecs workers loop until the world stops them and sync with each other,
+	// so each needs a thread of its own rather than a slot in a worker deque
+	g_pJobSystem->SubmitBlocking(Job{ ecs_thread_job, pThread, 0, 0, &pThread->counter });
+	return reinterpret_cast<ecs_os_thread_t>(pThread);
+}
+
+static void* ecs_job_thread_join(ecs_os_thread_t thread)
+{
+	EcsThread* pThread = reinterpret_cast<EcsThread*>(thread);
+	g_pJobSystem->Wait(&pThread->counter);
+
+	void* pResult = pThread->pResult;
+	delete pThread;
+	return pResult;
+}
+
+void JobSystem::InstallEcsThreadHooks()
+{
+	ecs_os_set_api_defaults();
+	ecs_os_api_t api = ecs_os_api;
+	api.thread_new_ = ecs_job_thread_new;
+	api.thread_join_ = ecs_job_thread_join;
+	ecs_os_set_api(&api);
+
+	// Ignored above when os api was already set (EcsAllocator installed first), patch hooks in place then
+	ecs_os_api.thread_new_ = ecs_job_thread_new;
+	ecs_os_api.thread_join_ = ecs_job_thread_join;
+}
@@ -0,0 +1,168 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+class JobCounter;
+
+// Job body gets [nBegin, nEnd) of whatever range it was given
+typedef void (*TJobEntry)(void* pData, size_t nBegin, size_t nEnd);
+
+struct Job
+{
+	TJobEntry pEntry;
+	void* pData;
+	size_t nBegin;
+	size_t nEnd;
+	// Decremented when job is finished, may be null
+	JobCounter* pCounter;
+};
+
+// Number of unfinished jobs submitted with it.
+// Jobs depend on other jobs by waiting for their counter, see JobSystem::Wait.
+class JobCounter
+{
+public:
+	JobCounter();
+	~JobCounter();
+	JobCounter(const JobCounter&) = delete;
+	JobCounter& operator=(const JobCounter&) = delete;
+
+	bool IsDone() const;
+	uint32_t GetValue() const;
+
+private:
+	friend class JobSystem;
+
+	std::atomic<uint32_t> m_nValue;
+};
+
+// Work stealing scheduler, one worker per core, main thread is worker 0.
+// Every worker owns a deque, pushes and pops its back and steals from the front of others.
+// Threads that are not workers submit to a shared queue.
+// Waiting on a counter runs other jobs meanwhile, so jobs can wait for jobs they spawn.
+class JobSystem
+{
+public:
+	static const uint32_t InvalidWorker = ~0u;
+
+	// Must be created on main thread, nWorkerCount includes it
+	JobSystem(uint32_t nWorkerCount = std::thread::hardware_concurrency());
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Null when no job system exists, parallel helpers then run inline
+	static JobSystem* Get();
+
+	uint32_t GetWorkerCount() const;
+	// Index of calling worker, InvalidWorker for other threads
+	uint32_t GetWorkerIndex() const;
+	bool IsMainThread() const;
+
+	void Submit(const Job& job);
+	void Submit(const Job* pJobs, uint32_t nCount);
+	// Executed only on main thread, from RunMainThreadJobs or while main thread waits
+	void SubmitMainThread(const Job& job);
+	// Job that blocks for long (file io, flecs worker loops) gets a thread of its own,
+	// taken from a pool of such threads that grows on demand
+	void SubmitBlocking(const Job& job);
+
+	void Wait(JobCounter* pCounter);
+	void RunMainThreadJobs();
+
+	// Hooks flecs os api thread_new/thread_join to blocking jobs.
+	// Must be called before the first flecs world is created
+	void InstallEcsThreadHooks();
+
+	// Splits [0, nCount) into at most nChunkCount ranges of at least nMinPerChunk and waits for them.
+	// func gets (chunk index, begin, end), chunk index is below nChunkCount.
+	template <typename Func>
+	void ParallelFor(size_t nCount, size_t nMinPerChunk, uint32_t nChunkCount, Func& func)
+	{
+		size_t nMaxChunks = std::max<size_t>(nCount / std::max<size_t>(nMinPerChunk, 1), 1);
+		nChunkCount = static_cast<uint32_t>(std::min<size_t>(std::max(nChunkCount, 1u), nMaxChunks));
+		if (nChunkCount == 1)
+		{
+			func(0u, 0, nCount);
+			return;
+		}
+
+		ParallelForData<Func> data = { &func, (nCount + nChunkCount - 1) / nChunkCount, nCount };
+
+		JobCounter counter;
+		std::vector<Job> jobs(nChunkCount);
+		for (uint32_t nChunk = 0; nChunk < nChunkCount; ++nChunk)
+			jobs[nChunk] = Job{ &RunParallelForChunk<Func>, &data, nChunk, nChunk + 1, &counter };
+
+		Submit(jobs.data(), nChunkCount);
+		Wait(&counter);
+	}
+
+private:
+	template <typename Func>
+	struct ParallelForData
+	{
+		Func* pFunc;
+		size_t nPerChunk;
+		size_t nCount;
+	};
+
+	template <typename Func>
+	static void RunParallelForChunk(void* pData, size_t nChunk, size_t)
+	{
+		ParallelForData<Func>* pFor = static_cast<ParallelForData<Func>*>(pData);
+		size_t nBegin = std::min(nChunk * pFor->nPerChunk, pFor->nCount);
+		size_t nEnd = std::min(nBegin + pFor->nPerChunk, pFor->nCount);
+		(*pFor->pFunc)(static_cast<uint32_t>(nChunk), nBegin, nEnd);
+	}
+
+	struct alignas(64) WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	uint32_t m_nWorkerCount;
+	std::unique_ptr<WorkerQueue[]> m_Queues;
+	WorkerQueue m_SharedQueue;
+	WorkerQueue m_MainThreadQueue;
+	std::vector<std::thread> m_Workers;
+
+	// Queued jobs any thread can take, main thread jobs are counted separately
+	std::atomic<uint32_t> m_nQueuedJobs;
+	std::atomic<uint32_t> m_nQueuedMainThreadJobs;
+	std::atomic<uint32_t> m_nSleeping;
+	std::mutex m_SleepMutex;
+	std::condition_variable m_WakeCond;
+	std::atomic<bool> m_bQuit;
+
+	std::mutex m_BlockingMutex;
+	std::condition_variable m_BlockingCond;
+	std::deque<Job> m_BlockingJobs;
+	std::vector<std::thread> m_BlockingThreads;
+	uint32_t m_nIdleBlockingThreads;
+
+	void WorkerLoop(uint32_t nWorker);
+	void BlockingLoop();
+
+	void Push(uint32_t nWorker, const Job* pJobs, uint32_t nCount);
+	bool TryRunJob(uint32_t nWorker);
+	bool Pop(uint32_t nWorker, Job& job);
+	bool Steal(uint32_t nWorker, Job& job);
+	bool PopFront(WorkerQueue& queue, Job& job);
+	void Execute(const Job& job);
+	void Finish(JobCounter* pCounter);
+	void Wake(bool bAll);
+};
+
+struct JobSystemPtr
+{
+	JobSystem* ptr;
+};
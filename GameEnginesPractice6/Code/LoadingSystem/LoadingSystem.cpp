@@ -19,6 +19,7 @@ void LoadingSystem::LoadFromXML(const std::string fileName)
 
 	if (doc.LoadFile())
 	{
+		std::vector<EntityInfo> characters;
 		const auto elem = doc.FirstChildElement("scene");
 		for (TiXmlElement* e = elem->FirstChildElement("character"); e != nullptr; e = e->NextSiblingElement("character"))
 		{
@@ -27,7 +28,25 @@ void LoadingSystem::LoadFromXML(const std::string fileName)
 			currentCharacter.scriptName = e->Attribute("scriptName");
 			currentCharacter.position = ParsePosition(e->Attribute("position"));
 
-			m_pEntityManager->CreateEntity(currentCharacter);
+			characters.push_back(currentCharacter);
+		}
+
+		// Runs of characters with the same script and mesh are spawned in bulk, then placed
+		std::vector<EntityHandle> handles;
+		for (size_t nFirst = 0; nFirst < characters.size(); )
+		{
+			size_t nEnd = nFirst + 1;
+			while (nEnd < characters.size() &&
+				characters[nEnd].scriptName == characters[nFirst].scriptName &&
+				characters[nEnd].meshName == characters[nFirst].meshName)
+				++nEnd;
+
+			handles.clear();
+			m_pEntityManager->CreateEntities(static_cast<uint32_t>(nEnd - nFirst), characters[nFirst], &handles);
+			for (size_t i = 1; i < handles.size(); ++i)
+				m_pEntityManager->GetEntity(handles[i])->pScriptNode->SetPosition(characters[nFirst + i].position);
+
+			nFirst = nEnd;
 		}
 	}
 }
@@ -37,14 +56,13 @@ void LoadingSystem::SaveToXML(const std::string fileName)
 	const auto pathName = m_strSavesRootPath + fileName;
 	TiXmlDocument doc(pathName.c_str());
 	const auto elem = doc.FirstChildElement("scene");
-	auto entityQueue = m_pEntityManager->GetEntityQueue();
 
-	for (auto& entity : entityQueue)
+	for (const Entity& entity : m_pEntityManager->GetEntities())
 	{
 		for (TiXmlElement* e = elem->FirstChildElement("character"); e != NULL; e = e->NextSiblingElement("character"))
 		{
 			TiXmlElement* meshElement = e->FirstChildElement("meshName");
-			meshElement->SetAttribute("meshName", entity.second.pScriptNode->GetMeshName().c_str());
+			meshElement->SetAttribute("meshName", entity.pScriptNode->GetMeshName().c_str());
 		}
 	}
 
@@ -1,10 +1,31 @@
 #include <string>
+#include <sstream>
 
 #include "framework.h"
 #include "Main.h"
 
 #include "Game.h"
 #include "RenderEngine.h"
+#include "ECS/ecsDeterminism.h"
+#include "Benchmarks/Benchmarks.h"
+
+// -diffchecksums <logA> <logB>: compares checksum logs of two deterministic runs instead of starting the game.
+// Exit code is 0 if they match, 1 if they diverge, 2 if a log can't be read.
+static bool RunChecksumDiff(const std::string& strCmdLine, int& nExitCode)
+{
+	std::istringstream args(strCmdLine);
+	std::string strCommand, strPathA, strPathB;
+	args >> strCommand >> strPathA >> strPathB;
+	if (strCommand != "-diffchecksums")
+		return false;
+
+	ChecksumLogDiff diff;
+	bool bRead = DiffChecksumLogs(strPathA, strPathB, diff);
+	OutputDebugStringA((diff.strMessage + "\n").c_str());
+
+	nExitCode = !bRead ? 2 : (diff.bDiverged ? 1 : 0);
+	return true;
+}
 
 
 int APIENTRY WinMain(_In_ HINSTANCE hInstance,
@@ -12,6 +33,12 @@ int APIENTRY WinMain(_In_ HINSTANCE hInstance,
                      _In_ LPSTR    lpCmdLine,
                      _In_ int       nCmdShow)
 {
+    int nExitCode = 0;
+    if (lpCmdLine && RunChecksumDiff(lpCmdLine, nExitCode))
+        return nExitCode;
+    if (lpCmdLine && RunBenchmarkCommand(lpCmdLine, nExitCode))
+        return nExitCode;
+
 	Game* pGame = new Game();
     pGame->Run();
 
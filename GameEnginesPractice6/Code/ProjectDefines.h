@@ -7,3 +7,64 @@ typedef unsigned long threadID;
 #define SAFE_OGRE_DELETE(x) { if(x) { OGRE_DELETE(x); (x) = nullptr; } }
 
 #define ASSERT_NOT_IMPLEMENTED { OutputDebugStringA("Not implemented!\n"); __debugbreak(); }
+
+// Job system workers including main thread, 0 means one per core
+#define JOB_SYSTEM_WORKER_COUNT 0
+
+// Uncomment to collect per-system ECS timings and periodically dump them (".json" or ".csv")
+// #define ECS_STATS_DUMP_PATH "ecs_stats.csv"
+#define ECS_STATS_DUMP_PERIOD 5.0f
+
+// Comment out to leave flecs on system heap
+#define ECS_POOL_ALLOCATOR
+// Uncomment to periodically dump per-frame flecs allocation counters as csv
+// #define ECS_ALLOCATOR_DUMP_PATH "ecs_memory.csv"
+#define ECS_ALLOCATOR_DUMP_PERIOD 5.0f
+
+// Comment out to leave lua states on system heap
+#define SCRIPT_POOL_ALLOCATOR
+// Live lua bytes each script instance may hold, 0 means no cap.
+// Allocation over the cap fails with a lua memory error inside that script
+#define SCRIPT_MEMORY_CAP 0
+// Uncomment to periodically dump per-script lua memory counters as csv
+// #define SCRIPT_ALLOCATOR_DUMP_PATH "script_memory.csv"
+#define SCRIPT_ALLOCATOR_DUMP_PERIOD 5.0f
+// Comment out to run thread safe scripts (Entity.Properties.ThreadSafe) on main lua state too
+#define SCRIPT_PARALLEL_UPDATE
+// Lua states thread safe scripts are spread over, updated concurrently.
+// 0 means one per job system worker
+#define SCRIPT_WORKER_STATES 0
+// Uncomment to profile lua through debug hooks. Without it states run with no hooks
+// and updates don't touch the profiler at all
+// #define SCRIPT_PROFILER
+// Instructions between two count hook events, instruction counts are multiples of it
+#define SCRIPT_PROFILER_INSTRUCTION_PERIOD 1000
+// Every period "<path>.folded" gets flamegraph collapsed stacks since start
+// and "<path>.txt" the top (function, archetype) pairs of the last frame
+#define SCRIPT_PROFILER_DUMP_PATH "script_profile"
+#define SCRIPT_PROFILER_DUMP_PERIOD 5.0f
+#define SCRIPT_PROFILER_TOP_COUNT 10
+
+// Edge of a spatial index grid cell, roughly the typical query radius
+#define SPATIAL_INDEX_CELL_SIZE 10.0f
+
+// Scripted entities update every frame up to UPDATE_LOD_BASE_DISTANCE from camera,
+// every 2nd frame up to twice that distance, every 4th up to four times and so on
+#define UPDATE_LOD_BASE_DISTANCE 50.0f
+#define UPDATE_LOD_BUCKET_COUNT 5
+
+// N-body gravity defaults, see NBodySolver
+#define NBODY_GRAV_CONST 6.67f
+#define NBODY_OPENING_ANGLE 0.5f
+#define NBODY_SOFTENING 0.01f
+#define NBODY_EXACT_THRESHOLD 4096
+#define NBODY_INTEGRATOR eINT_Leapfrog
+
+// Uncomment for reproducible runs: fixed timestep, fixed worker count for
+// parallel reductions and a crc32 of simulation components logged every tick.
+// Logs of two runs are compared by starting the game with -diffchecksums <a> <b>
+// #define DETERMINISTIC_MODE
+#define DETERMINISTIC_SEED 12345
+#define DETERMINISTIC_TIMESTEP (1.0f / 60.0f)
+#define DETERMINISTIC_THREAD_COUNT 4
+#define DETERMINISTIC_CHECKSUM_LOG "checksums.log"
@@ -1,5 +1,7 @@
 #include "RenderEngine.h"
 
+#include <algorithm>
+
 #include "ProjectDefines.h"
 
 RenderEngine::RenderEngine(ResourceManager* pResourceManager) :
@@ -152,6 +154,44 @@ void RenderEngine::RT_CreateSceneNode(RenderNode* pRenderNode)
 	m_RenderNodes.push_back(pRenderNode);
 }
 
+void RenderEngine::RT_CreateSceneNodes(RenderNode* const* ppRenderNodes, uint32_t nCount)
+{
+	m_RenderNodes.reserve(m_RenderNodes.size() + nCount);
+
+	for (uint32_t i = 0; i < nCount; ++i)
+		RT_CreateSceneNode(ppRenderNodes[i]);
+}
+
+void RenderEngine::RT_DestroySceneNodes(RenderNode* const* ppRenderNodes, uint32_t nCount)
+{
+	std::vector<RenderNode*> destroyed(ppRenderNodes, ppRenderNodes + nCount);
+	std::sort(destroyed.begin(), destroyed.end());
+
+	// One pass over the node list for the whole batch
+	m_RenderNodes.erase(std::remove_if(m_RenderNodes.begin(), m_RenderNodes.end(),
+		[&destroyed](RenderNode* pRenderNode)
+		{
+			return std::binary_search(destroyed.begin(), destroyed.end(), pRenderNode);
+		}), m_RenderNodes.end());
+
+	for (RenderNode* pRenderNode : destroyed)
+	{
+		Ogre::SceneNode* pSceneNode = pRenderNode->GetSceneNode();
+		if (!pSceneNode)
+			continue;
+
+		while (pSceneNode->numAttachedObjects() > 0)
+		{
+			Ogre::MovableObject* pObject = pSceneNode->getAttachedObject(0);
+			pSceneNode->detachObject(pObject);
+			m_pSceneManager->destroyMovableObject(pObject);
+		}
+		m_pSceneManager->destroySceneNode(pSceneNode);
+
+		pRenderNode->SetSceneNode(nullptr);
+	}
+}
+
 void RenderEngine::ImportV1Mesh(Ogre::String strMeshName)
 {
 	//Load the v1 mesh. Notice the v1 namespace
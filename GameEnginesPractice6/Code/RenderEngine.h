@@ -41,6 +41,8 @@ private:
 	void RT_LoadDefaultResources();
 	void RT_SetupDefaultLight();
 	void RT_CreateSceneNode(RenderNode* pRenderNode);
+	void RT_CreateSceneNodes(RenderNode* const* ppRenderNodes, uint32_t nCount);
+	void RT_DestroySceneNodes(RenderNode* const* ppRenderNodes, uint32_t nCount);
 
 	void ImportV1Mesh(Ogre::String strMeshName);
 
@@ -0,0 +1,69 @@
+#include "RenderNodePool.h"
+
+#include <cassert>
+
+RenderNodePool::RenderNodePool(uint32_t nBlockSize) :
+	m_nBlockSize(nBlockSize > 0 ? nBlockSize : 1),
+	m_nAllocated(0)
+{
+
+}
+
+RenderNodePool::~RenderNodePool()
+{
+	// Scene nodes are owned by Ogre scene manager, so only return the memory here
+	m_FreeSlots.clear();
+	m_Blocks.clear();
+}
+
+void RenderNodePool::AddBlock(uint32_t nSize)
+{
+	NodeStorage* pBlock = new NodeStorage[nSize];
+	m_Blocks.emplace_back(pBlock);
+
+	m_FreeSlots.reserve(m_FreeSlots.size() + nSize);
+	// Push backwards so nodes are handed out in address order
+	for (uint32_t i = nSize; i > 0; --i)
+		m_FreeSlots.push_back(&pBlock[i - 1]);
+}
+
+void RenderNodePool::Reserve(uint32_t nCount)
+{
+	if (m_FreeSlots.size() >= nCount)
+		return;
+
+	uint32_t nMissing = nCount - static_cast<uint32_t>(m_FreeSlots.size());
+	AddBlock(nMissing > m_nBlockSize ? nMissing : m_nBlockSize);
+}
+
+RenderNode* RenderNodePool::Allocate(uint32_t idx, Ogre::String& strMeshName)
+{
+	if (m_FreeSlots.empty())
+		AddBlock(m_nBlockSize);
+
+	NodeStorage* pSlot = m_FreeSlots.back();
+	m_FreeSlots.pop_back();
+	++m_nAllocated;
+
+	return new (pSlot->data) RenderNode(idx, strMeshName);
+}
+
+void RenderNodePool::Free(RenderNode* pRenderNode)
+{
+	if (!pRenderNode)
+		return;
+
+	assert(m_nAllocated > 0);
+
+	// Scene node is destroyed by render thread, don't let RenderNode delete it
+	pRenderNode->SetSceneNode(nullptr);
+	pRenderNode->~RenderNode();
+
+	m_FreeSlots.push_back(reinterpret_cast<NodeStorage*>(pRenderNode));
+	--m_nAllocated;
+}
+
+uint32_t RenderNodePool::GetAllocatedCount() const
+{
+	return m_nAllocated;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <memory>
+
+#include "RenderNode.h"
+
+// Hands out RenderNodes from fixed size blocks, so spawning many entities
+// doesn't hit the heap once per node and nodes of one batch stay close in memory.
+// Nodes never move, pointers stay valid until Free or pool destruction.
+class RenderNodePool
+{
+public:
+	RenderNodePool(uint32_t nBlockSize = 1024);
+	~RenderNodePool();
+	RenderNodePool(const RenderNodePool&) = delete;
+	RenderNodePool& operator=(const RenderNodePool&) = delete;
+
+	RenderNode* Allocate(uint32_t idx, Ogre::String& strMeshName);
+	void Free(RenderNode* pRenderNode);
+
+	// Makes sure next nCount allocations won't need a new block
+	void Reserve(uint32_t nCount);
+
+	uint32_t GetAllocatedCount() const;
+
+private:
+	struct alignas(RenderNode) NodeStorage
+	{
+		unsigned char data[sizeof(RenderNode)];
+	};
+
+	uint32_t m_nBlockSize;
+	uint32_t m_nAllocated;
+
+	std::vector<std::unique_ptr<NodeStorage[]>> m_Blocks;
+	std::vector<NodeStorage*> m_FreeSlots;
+
+	void AddBlock(uint32_t nSize);
+};
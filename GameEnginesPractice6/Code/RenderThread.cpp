@@ -143,6 +143,24 @@ void RenderThread::ProcessCommands()
 			m_pRenderEngine->RT_CreateSceneNode(pRenderNode);
 			break;
 		}
+		case eRC_CreateSceneNodes:
+		{
+			UINT32 nCount = ReadCommand<UINT32>(n);
+			RenderNode* const* ppRenderNodes = reinterpret_cast<RenderNode* const*>(m_Commands[m_nCurrentFrame].data() + n);
+			n += nCount * sizeof(RenderNode*);
+
+			m_pRenderEngine->RT_CreateSceneNodes(ppRenderNodes, nCount);
+			break;
+		}
+		case eRC_DestroySceneNodes:
+		{
+			UINT32 nCount = ReadCommand<UINT32>(n);
+			RenderNode* const* ppRenderNodes = reinterpret_cast<RenderNode* const*>(m_Commands[m_nCurrentFrame].data() + n);
+			n += nCount * sizeof(RenderNode*);
+
+			m_pRenderEngine->RT_DestroySceneNodes(ppRenderNodes, nCount);
+			break;
+		}
 		}
 	}
 
@@ -260,6 +278,46 @@ void RenderThread::RC_CreateSceneNode(RenderNode* pRenderNode)
 	AddRawData(p, pRenderNode);
 }
 
+// One command for the whole batch, node pointers are stored inline after the count
+void RenderThread::RC_CreateSceneNodes(RenderNode* const* ppRenderNodes, uint32_t nCount)
+{
+	if (nCount == 0)
+		return;
+
+	LOADINGCOMMAND_CRITICAL_SECTION;
+
+	if (IsRenderThread())
+	{
+		m_pRenderEngine->RT_CreateSceneNodes(ppRenderNodes, nCount);
+		return;
+	}
+
+	uint32_t nBytes = nCount * sizeof(RenderNode*);
+	byte* p = AddCommand(eRC_CreateSceneNodes, sizeof(UINT32) + nBytes);
+	AddRawData(p, static_cast<UINT32>(nCount));
+	AddBytes(p, (byte*)ppRenderNodes, nBytes);
+}
+
+// Render nodes must stay alive until render thread executed this command
+void RenderThread::RC_DestroySceneNodes(RenderNode* const* ppRenderNodes, uint32_t nCount)
+{
+	if (nCount == 0)
+		return;
+
+	LOADINGCOMMAND_CRITICAL_SECTION;
+
+	if (IsRenderThread())
+	{
+		m_pRenderEngine->RT_DestroySceneNodes(ppRenderNodes, nCount);
+		return;
+	}
+
+	uint32_t nBytes = nCount * sizeof(RenderNode*);
+	byte* p = AddCommand(eRC_DestroySceneNodes, sizeof(UINT32) + nBytes);
+	AddRawData(p, static_cast<UINT32>(nCount));
+	AddBytes(p, (byte*)ppRenderNodes, nBytes);
+}
+
 
 void RenderThread::RC_BeginFrame()
 {
@@ -19,6 +19,8 @@ enum RenderCommand : UINT32
 	eRC_SetupDefaultLight,
 	eRC_BeginFrame,
 	eRC_CreateSceneNode,
+	eRC_CreateSceneNodes,
+	eRC_DestroySceneNodes,
 	eRC_EndFrame
 };
 
@@ -39,6 +41,8 @@ public:
 	void RC_BeginFrame();
 	void RC_EndFrame();
 	void RC_CreateSceneNode(RenderNode* pRenderNode);
+	void RC_CreateSceneNodes(RenderNode* const* ppRenderNodes, uint32_t nCount);
+	void RC_DestroySceneNodes(RenderNode* const* ppRenderNodes, uint32_t nCount);
 
 private:
 	threadID m_nRenderThreadId;
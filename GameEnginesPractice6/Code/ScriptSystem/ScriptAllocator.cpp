@@ -0,0 +1,412 @@
+#include "ScriptAllocator.h"
+
+#include "lua.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#include "../BitUtils.h"
+
+// 16 byte steps up to 256, then 4 classes per power of two up to 16K.
+// Class sizes include the block header.
+static const uint32_t SCRIPT_SMALL_CLASSES = 16;
+static const uint32_t SCRIPT_SMALL_STEP = 16;
+static const uint32_t SCRIPT_CLASS_COUNT = 40;
+static const size_t SCRIPT_MAX_CLASS_SIZE = 16 * 1024;
+static const size_t SCRIPT_SLAB_SIZE = 64 * 1024;
+static const size_t SCRIPT_THREAD_CACHE_BYTES = 32 * 1024;
+
+// Lua passes the old size back, only the account has to be kept.
+// 8 bytes keep lua objects at the alignment of double and pointers.
+union ScriptBlockHeader
+{
+	ScriptMemoryAccount* pAccount;
+	uint64_t nPadding;
+};
+static_assert(sizeof(ScriptBlockHeader) == 8, "script block header must keep 8 byte alignment");
+
+struct ScriptFreeBlock
+{
+	ScriptFreeBlock* pNext;
+};
+
+static uint32_t GetSizeClass(size_t nBlockSize)
+{
+	if (nBlockSize <= SCRIPT_SMALL_CLASSES * SCRIPT_SMALL_STEP)
+		return static_cast<uint32_t>((nBlockSize - 1) / SCRIPT_SMALL_STEP);
+
+	uint32_t nPower = FloorLog2(nBlockSize - 1);
+	uint32_t nSub = static_cast<uint32_t>((nBlockSize - 1) >> (nPower - 2)) & 3;
+	return SCRIPT_SMALL_CLASSES + (nPower - 8) * 4 + nSub;
+}
+
+static size_t GetClassSize(uint32_t nClass)
+{
+	if (nClass < SCRIPT_SMALL_CLASSES)
+		return (nClass + 1) * SCRIPT_SMALL_STEP;
+
+	uint32_t nPower = 8 + (nClass - SCRIPT_SMALL_CLASSES) / 4;
+	uint32_t nSub = (nClass - SCRIPT_SMALL_CLASSES) % 4;
+	return (size_t(1) << nPower) + (nSub + 1) * (size_t(1) << (nPower - 2));
+}
+
+struct ScriptClassPool
+{
+	std::mutex mutex;
+	ScriptFreeBlock* pFree = nullptr;
+};
+
+// Shared by all allocators and never destroyed, thread caches flush into it at thread exit
+struct ScriptPools
+{
+	ScriptClassPool pools[SCRIPT_CLASS_COUNT];
+};
+
+static ScriptPools* GetScriptPools()
+{
+	static ScriptPools* pPools = new ScriptPools();
+	return pPools;
+}
+
+struct ScriptThreadCache
+{
+	ScriptFreeBlock* pFree[SCRIPT_CLASS_COUNT] = {};
+	uint32_t nCount[SCRIPT_CLASS_COUNT] = {};
+
+	~ScriptThreadCache();
+};
+
+static thread_local ScriptThreadCache t_ScriptCache;
+static thread_local ScriptMemoryAccount* t_pCurrentAccount = nullptr;
+
+static uint32_t GetThreadCacheLimit(uint32_t nClass)
+{
+	return static_cast<uint32_t>(std::max<size_t>(SCRIPT_THREAD_CACHE_BYTES / GetClassSize(nClass), 4));
+}
+
+static void FlushThreadCache(ScriptThreadCache& cache, uint32_t nClass, uint32_t nCount)
+{
+	if (nCount == 0)
+		return;
+
+	ScriptFreeBlock* pFirst = cache.pFree[nClass];
+	ScriptFreeBlock* pLast = pFirst;
+	for (uint32_t i = 1; i < nCount; ++i)
+		pLast = pLast->pNext;
+
+	cache.pFree[nClass] = pLast->pNext;
+	cache.nCount[nClass] -= nCount;
+
+	ScriptClassPool& pool = GetScriptPools()->pools[nClass];
+	std::scoped_lock<std::mutex> lock(pool.mutex);
+	pLast->pNext = pool.pFree;
+	pool.pFree = pFirst;
+}
+
+ScriptThreadCache::~ScriptThreadCache()
+{
+	for (uint32_t nClass = 0; nClass < SCRIPT_CLASS_COUNT; ++nClass)
+		FlushThreadCache(*this, nClass, nCount[nClass]);
+}
+
+static void RefillThreadCache(ScriptThreadCache& cache, uint32_t nClass, uint32_t nCount)
+{
+	ScriptClassPool& pool = GetScriptPools()->pools[nClass];
+	std::scoped_lock<std::mutex> lock(pool.mutex);
+
+	if (pool.pFree == nullptr)
+	{
+		size_t nBlockSize = GetClassSize(nClass);
+		size_t nSlabSize = std::max(SCRIPT_SLAB_SIZE, nBlockSize * 4);
+		uint8_t* pSlab = static_cast<uint8_t*>(malloc(nSlabSize));
+		if (pSlab == nullptr)
+			return;
+
+		for (size_t i = nSlabSize / nBlockSize; i-- > 0; )
+		{
+			ScriptFreeBlock* pBlock = reinterpret_cast<ScriptFreeBlock*>(pSlab + i * nBlockSize);
+			pBlock->pNext = pool.pFree;
+			pool.pFree = pBlock;
+		}
+	}
+
+	while (nCount-- > 0 && pool.pFree != nullptr)
+	{
+		ScriptFreeBlock* pBlock = pool.pFree;
+		pool.pFree = pBlock->pNext;
+
+		pBlock->pNext = cache.pFree[nClass];
+		cache.pFree[nClass] = pBlock;
+		++cache.nCount[nClass];
+	}
+}
+
+static void* AllocateBlock(size_t nBlockSize)
+{
+	if (nBlockSize > SCRIPT_MAX_CLASS_SIZE)
+		return malloc(nBlockSize);
+
+	uint32_t nClass = GetSizeClass(nBlockSize);
+	ScriptThreadCache& cache = t_ScriptCache;
+	if (cache.pFree[nClass] == nullptr)
+	{
+		RefillThreadCache(cache, nClass, GetThreadCacheLimit(nClass) / 2);
+		if (cache.pFree[nClass] == nullptr)
+			return nullptr;
+	}
+
+	ScriptFreeBlock* pBlock = cache.pFree[nClass];
+	cache.pFree[nClass] = pBlock->pNext;
+	--cache.nCount[nClass];
+	return pBlock;
+}
+
+static void FreeBlock(void* pBlock, size_t nBlockSize)
+{
+	if (nBlockSize > SCRIPT_MAX_CLASS_SIZE)
+	{
+		free(pBlock);
+		return;
+	}
+
+	uint32_t nClass = GetSizeClass(nBlockSize);
+	ScriptThreadCache& cache = t_ScriptCache;
+	ScriptFreeBlock* pFree = static_cast<ScriptFreeBlock*>(pBlock);
+	pFree->pNext = cache.pFree[nClass];
+	cache.pFree[nClass] = pFree;
+	++cache.nCount[nClass];
+
+	uint32_t nLimit = GetThreadCacheLimit(nClass);
+	if (cache.nCount[nClass] > nLimit)
+		FlushThreadCache(cache, nClass, nLimit / 2);
+}
+
+static bool IsOverCap(const ScriptMemoryAccount* pAccount, int64_t nGrowth)
+{
+	int64_t nCapBytes = pAccount->nCapBytes.load(std::memory_order_relaxed);
+	if (nCapBytes == 0 && pAccount->pParent)
+		nCapBytes = pAccount->pParent->nCapBytes.load(std::memory_order_relaxed);
+
+	return nCapBytes > 0 && pAccount->nLiveBytes.load(std::memory_order_relaxed) + nGrowth > nCapBytes;
+}
+
+// Parents are summed up once a frame, hot path stays at one account
+static void Charge(ScriptMemoryAccount* pAccount, int64_t nDelta, bool bNewBlock)
+{
+	pAccount->nLiveBytes.fetch_add(nDelta, std::memory_order_relaxed);
+	if (nDelta > 0)
+		pAccount->nBytesAllocated.fetch_add(nDelta, std::memory_order_relaxed);
+	if (bNewBlock)
+		pAccount->nAllocCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+ScriptMemoryAccount::ScriptMemoryAccount(const std::string& strAccountName, ScriptMemoryAccount* pParentAccount) :
+	strName(strAccountName),
+	pParent(pParentAccount),
+	nCapBytes(0),
+	nLiveBytes(0),
+	nAllocCount(0),
+	nBytesAllocated(0),
+	nTotalLiveBytes(0),
+	nTotalAllocCount(0),
+	nTotalBytesAllocated(0),
+	nFrameAllocCount(0),
+	nFrameBytesAllocated(0)
+{
+}
+
+ScriptAllocator::ScriptAllocator() :
+	m_nFrame(0),
+	m_fDumpPeriod(0.0f),
+	m_fTimeSinceDump(0.0f)
+{
+	m_pVmAccount = CreateAccount("<vm>", nullptr);
+}
+
+ScriptAllocator::~ScriptAllocator()
+{
+}
+
+lua_State* ScriptAllocator::NewState()
+{
+	return lua_newstate(&ScriptAllocator::Allocate, this);
+}
+
+void* ScriptAllocator::Allocate(void* pUserData, void* pMemory, size_t nOldSize, size_t nNewSize)
+{
+	const size_t nHeaderSize = sizeof(ScriptBlockHeader);
+
+	if (pMemory == nullptr)
+	{
+		// Lua passes the object type as old size of a new block
+		if (nNewSize == 0)
+			return nullptr;
+
+		ScriptMemoryAccount* pAccount = t_pCurrentAccount ? t_pCurrentAccount : static_cast<ScriptAllocator*>(pUserData)->m_pVmAccount;
+		if (IsOverCap(pAccount, static_cast<int64_t>(nNewSize)))
+			return nullptr;
+
+		ScriptBlockHeader* pHeader = static_cast<ScriptBlockHeader*>(AllocateBlock(nHeaderSize + nNewSize));
+		if (pHeader == nullptr)
+			return nullptr;
+
+		pHeader->pAccount = pAccount;
+		Charge(pAccount, static_cast<int64_t>(nNewSize), true);
+		return pHeader + 1;
+	}
+
+	ScriptBlockHeader* pHeader = static_cast<ScriptBlockHeader*>(pMemory) - 1;
+	ScriptMemoryAccount* pAccount = pHeader->pAccount;
+	int64_t nDelta = static_cast<int64_t>(nNewSize) - static_cast<int64_t>(nOldSize);
+
+	if (nNewSize == 0)
+	{
+		Charge(pAccount, nDelta, false);
+		FreeBlock(pHeader, nHeaderSize + nOldSize);
+		return nullptr;
+	}
+
+	// Growth stays with whoever owns the block, lua requires shrinking to succeed
+	if (nDelta > 0 && IsOverCap(pAccount, nDelta))
+		return nullptr;
+
+	size_t nOldBlockSize = nHeaderSize + nOldSize;
+	size_t nNewBlockSize = nHeaderSize + nNewSize;
+	bool bOldPooled = nOldBlockSize <= SCRIPT_MAX_CLASS_SIZE;
+	bool bNewPooled = nNewBlockSize <= SCRIPT_MAX_CLASS_SIZE;
+
+	void* pNewBlock = nullptr;
+	if (bOldPooled && bNewPooled && GetSizeClass(nOldBlockSize) == GetSizeClass(nNewBlockSize))
+		pNewBlock = pHeader;
+	else if (!bOldPooled && !bNewPooled)
+		pNewBlock = realloc(pHeader, nNewBlockSize);
+	else
+	{
+		pNewBlock = AllocateBlock(nNewBlockSize);
+		if (pNewBlock)
+		{
+			memcpy(pNewBlock, pHeader, std::min(nOldBlockSize, nNewBlockSize));
+			FreeBlock(pHeader, nOldBlockSize);
+		}
+	}
+
+	if (pNewBlock == nullptr)
+		return nullptr;
+
+	Charge(pAccount, nDelta, false);
+	return static_cast<ScriptBlockHeader*>(pNewBlock) + 1;
+}
+
+ScriptMemoryAccount* ScriptAllocator::CreateAccount(const std::string& strName, ScriptMemoryAccount* pParent)
+{
+	m_Accounts.emplace_back(strName, pParent);
+	return &m_Accounts.back();
+}
+
+ScriptMemoryAccount* ScriptAllocator::GetVmAccount()
+{
+	return m_pVmAccount;
+}
+
+const std::deque<ScriptMemoryAccount>& ScriptAllocator::GetAccounts() const
+{
+	return m_Accounts;
+}
+
+void ScriptAllocator::EndFrame(float dt)
+{
+	// Previous totals are kept in frame fields until the new totals are known
+	for (ScriptMemoryAccount& account : m_Accounts)
+	{
+		account.nFrameAllocCount = account.nTotalAllocCount;
+		account.nFrameBytesAllocated = account.nTotalBytesAllocated;
+		account.nTotalLiveBytes = 0;
+		account.nTotalAllocCount = 0;
+		account.nTotalBytesAllocated = 0;
+	}
+
+	for (ScriptMemoryAccount& account : m_Accounts)
+	{
+		int64_t nLiveBytes = account.nLiveBytes.load(std::memory_order_relaxed);
+		int64_t nAllocCount = account.nAllocCount.load(std::memory_order_relaxed);
+		int64_t nBytesAllocated = account.nBytesAllocated.load(std::memory_order_relaxed);
+		for (ScriptMemoryAccount* pTotal = &account; pTotal; pTotal = pTotal->pParent)
+		{
+			pTotal->nTotalLiveBytes += nLiveBytes;
+			pTotal->nTotalAllocCount += nAllocCount;
+			pTotal->nTotalBytesAllocated += nBytesAllocated;
+		}
+	}
+
+	for (ScriptMemoryAccount& account : m_Accounts)
+	{
+		account.nFrameAllocCount = account.nTotalAllocCount - account.nFrameAllocCount;
+		account.nFrameBytesAllocated = account.nTotalBytesAllocated - account.nFrameBytesAllocated;
+	}
+	++m_nFrame;
+
+	if (m_strDumpPath.empty())
+		return;
+
+	m_fTimeSinceDump += dt;
+	if (m_fTimeSinceDump < m_fDumpPeriod)
+		return;
+	m_fTimeSinceDump = 0.0f;
+
+	Dump();
+}
+
+void ScriptAllocator::EnableDump(const std::string& strPath, float fPeriod)
+{
+	m_strDumpPath = strPath;
+	m_fDumpPeriod = fPeriod;
+	m_fTimeSinceDump = 0.0f;
+}
+
+void ScriptAllocator::DisableDump()
+{
+	m_strDumpPath.clear();
+}
+
+void ScriptAllocator::Dump()
+{
+	std::ifstream existing(m_strDumpPath);
+	bool bWriteHeader = !existing.good();
+	existing.close();
+
+	std::ofstream file(m_strDumpPath, std::ios::app);
+	if (!file.is_open())
+		return;
+
+	if (bWriteHeader)
+		file << "frame,account,live_bytes,cap_bytes,allocs,bytes_allocated,frame_allocs,frame_bytes_allocated\n";
+
+	for (const ScriptMemoryAccount& account : m_Accounts)
+	{
+		if (account.pParent)
+			continue;
+
+		file << m_nFrame << ','
+			<< account.strName << ','
+			<< account.nTotalLiveBytes << ','
+			<< account.nCapBytes.load(std::memory_order_relaxed) << ','
+			<< account.nTotalAllocCount << ','
+			<< account.nTotalBytesAllocated << ','
+			<< account.nFrameAllocCount << ','
+			<< account.nFrameBytesAllocated << '\n';
+	}
+}
+
+ScriptMemoryScope::ScriptMemoryScope(ScriptMemoryAccount* pAccount) :
+	m_pPrevious(t_pCurrentAccount)
+{
+	t_pCurrentAccount = pAccount;
+}
+
+ScriptMemoryScope::~ScriptMemoryScope()
+{
+	t_pCurrentAccount = m_pPrevious;
+}
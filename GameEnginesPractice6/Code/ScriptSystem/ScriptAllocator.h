@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+struct lua_State;
+
+// Lua memory is charged to an account: a script, one instance of it, or the vm itself
+struct ScriptMemoryAccount
+{
+	ScriptMemoryAccount(const std::string& strAccountName, ScriptMemoryAccount* pParentAccount);
+
+	std::string strName;
+	// Script account of an instance
+	ScriptMemoryAccount* pParent;
+	// Allocation that would take nLiveBytes above it fails with a lua memory error, 0 is no cap.
+	// Cap of a script applies to each of its instances that has none of its own.
+	std::atomic<int64_t> nCapBytes;
+
+	// Only this account, an allocation touches no other counters
+	std::atomic<int64_t> nLiveBytes;
+	std::atomic<int64_t> nAllocCount;
+	std::atomic<int64_t> nBytesAllocated;
+
+	// Main thread only, updated by EndFrame.
+	// Totals include instance accounts, frame values are allocations during the last frame.
+	int64_t nTotalLiveBytes;
+	int64_t nTotalAllocCount;
+	int64_t nTotalBytesAllocated;
+	int64_t nFrameAllocCount;
+	int64_t nFrameBytesAllocated;
+};
+
+// lua_Alloc backed by size class pools. Every thread caches free blocks per class
+// and only takes the shared pool's lock to move them in batches.
+// Blocks remember the account they are charged to, new blocks go to the account
+// of the innermost ScriptMemoryScope of the allocating thread.
+class ScriptAllocator
+{
+public:
+	ScriptAllocator();
+	~ScriptAllocator();
+	ScriptAllocator(const ScriptAllocator&) = delete;
+	ScriptAllocator& operator=(const ScriptAllocator&) = delete;
+
+	// States must be closed before the allocator is destroyed
+	lua_State* NewState();
+	static void* Allocate(void* pUserData, void* pMemory, size_t nOldSize, size_t nNewSize);
+
+	// Main thread only, accounts live as long as the allocator
+	ScriptMemoryAccount* CreateAccount(const std::string& strName, ScriptMemoryAccount* pParent);
+	// Charged for allocations made outside of any scope: compiler, string table, bindings
+	ScriptMemoryAccount* GetVmAccount();
+	const std::deque<ScriptMemoryAccount>& GetAccounts() const;
+
+	// Counters since previous call become last frame counters of every account
+	void EndFrame(float dt);
+	// Appends a csv line per script account per period, instance accounts are left out
+	void EnableDump(const std::string& strPath, float fPeriod);
+	void DisableDump();
+
+private:
+	std::deque<ScriptMemoryAccount> m_Accounts;
+	ScriptMemoryAccount* m_pVmAccount;
+
+	uint64_t m_nFrame;
+	std::string m_strDumpPath;
+	float m_fDumpPeriod;
+	float m_fTimeSinceDump;
+
+	void Dump();
+};
+
+// Charges lua allocations of calling thread to pAccount while it exists
+class ScriptMemoryScope
+{
+public:
+	ScriptMemoryScope(ScriptMemoryAccount* pAccount);
+	~ScriptMemoryScope();
+	ScriptMemoryScope(const ScriptMemoryScope&) = delete;
+	ScriptMemoryScope& operator=(const ScriptMemoryScope&) = delete;
+
+private:
+	ScriptMemoryAccount* m_pPrevious;
+};
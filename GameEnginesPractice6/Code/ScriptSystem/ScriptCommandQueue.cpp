@@ -0,0 +1,102 @@
+#include "ScriptCommandQueue.h"
+
+#include <algorithm>
+
+#include "LuaBridge.h"
+#include "../ECS/ecsPhys.h"
+
+void ScriptCommandQueue::Push(EScriptCommand eCommand, int64_t nEntity, float x, float y, float z, float w)
+{
+	m_Commands.push_back(Command{ eCommand, static_cast<flecs::entity_t>(nEntity), { x, y, z, w } });
+}
+
+void ScriptCommandQueue::SetPosition(int64_t nEntity, const Ogre::Vector3& position)
+{
+	Push(eSCMD_SetPosition, nEntity, position.x, position.y, position.z);
+}
+
+void ScriptCommandQueue::SetVelocity(int64_t nEntity, const Ogre::Vector3& velocity)
+{
+	Push(eSCMD_SetVelocity, nEntity, velocity.x, velocity.y, velocity.z);
+}
+
+void ScriptCommandQueue::AddVelocity(int64_t nEntity, const Ogre::Vector3& velocity)
+{
+	Push(eSCMD_AddVelocity, nEntity, velocity.x, velocity.y, velocity.z);
+}
+
+void ScriptCommandQueue::SetOrientation(int64_t nEntity, const Ogre::Quaternion& orientation)
+{
+	Push(eSCMD_SetOrientation, nEntity, orientation.w, orientation.x, orientation.y, orientation.z);
+}
+
+bool ScriptCommandQueue::IsEmpty() const
+{
+	return m_Commands.empty();
+}
+
+void ScriptCommandQueue::Apply(flecs::world_t* stage)
+{
+	if (m_Commands.empty())
+		return;
+
+	const flecs::world_t* world = ecs_get_world(stage);
+	flecs::id_t positionId = flecs::_::cpp_type<Position>::id(stage);
+	flecs::id_t velocityId = flecs::_::cpp_type<Velocity>::id(stage);
+	flecs::id_t orientationId = flecs::_::cpp_type<Orientation>::id(stage);
+
+	for (const Command& command : m_Commands)
+	{
+		if (!ecs_is_alive(world, command.entity))
+			continue;
+
+		flecs::id_t component = 0;
+		size_t nSize = sizeof(Ogre::Vector3);
+		switch (command.eCommand)
+		{
+		case eSCMD_SetPosition:
+			component = positionId;
+			break;
+		case eSCMD_SetVelocity:
+		case eSCMD_AddVelocity:
+			component = velocityId;
+			break;
+		case eSCMD_SetOrientation:
+			component = orientationId;
+			nSize = sizeof(Ogre::Quaternion);
+			break;
+		default:
+			continue;
+		}
+
+		if (!ecs_owns_id(world, command.entity, component))
+		{
+			// Adding to a component the entity doesn't have has nothing to add to
+			if (command.eCommand != eSCMD_AddVelocity)
+				ecs_set_id(stage, command.entity, component, nSize, command.values);
+			continue;
+		}
+
+		float* pValues = static_cast<float*>(const_cast<void*>(ecs_get_id(world, command.entity, component)));
+		if (command.eCommand == eSCMD_AddVelocity)
+		{
+			for (int i = 0; i < 3; ++i)
+				pValues[i] += command.values[i];
+		}
+		else
+			std::copy(command.values, command.values + nSize / sizeof(float), pValues);
+	}
+
+	m_Commands.clear();
+}
+
+void register_script_commands(lua_State* L)
+{
+	luabridge::getGlobalNamespace(L)
+		.beginClass<ScriptCommandQueue>("ScriptCommandQueue")
+		.addFunction("setPosition", &ScriptCommandQueue::SetPosition)
+		.addFunction("setVelocity", &ScriptCommandQueue::SetVelocity)
+		.addFunction("addVelocity", &ScriptCommandQueue::AddVelocity)
+		.addFunction("setOrientation", &ScriptCommandQueue::SetOrientation)
+		.endClass();
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "flecs.h"
+#include <OgreVector3.h>
+#include <OgreQuaternion.h>
+
+struct lua_State;
+
+enum EScriptCommand : uint32_t
+{
+	eSCMD_SetPosition = 0,
+	eSCMD_SetVelocity,
+	eSCMD_AddVelocity,
+	eSCMD_SetOrientation,
+
+	eSCMD_Max
+};
+
+// Writes a script makes to components of entities other than its own.
+// Scripts updated in parallel may only touch their own entity through Entity.Components,
+// anything else is recorded here and applied after all script updates of the frame.
+// One queue per lua state, so recording needs no locks. Scripts see it as global "commands",
+// entities are addressed by Entity.Id.
+class ScriptCommandQueue
+{
+public:
+	ScriptCommandQueue() = default;
+	ScriptCommandQueue(const ScriptCommandQueue&) = delete;
+	ScriptCommandQueue& operator=(const ScriptCommandQueue&) = delete;
+
+	void SetPosition(int64_t nEntity, const Ogre::Vector3& position);
+	void SetVelocity(int64_t nEntity, const Ogre::Vector3& velocity);
+	void AddVelocity(int64_t nEntity, const Ogre::Vector3& velocity);
+	void SetOrientation(int64_t nEntity, const Ogre::Quaternion& orientation);
+
+	// In recording order. Components the entity owns are written in place, so several
+	// commands on one entity add up, the rest are set through stage and show up after merge.
+	// Commands on dead entities are dropped.
+	void Apply(flecs::world_t* stage);
+	bool IsEmpty() const;
+
+private:
+	struct Command
+	{
+		EScriptCommand eCommand;
+		flecs::entity_t entity;
+		float values[4];
+	};
+
+	// Cleared, not freed, by Apply
+	std::vector<Command> m_Commands;
+
+	void Push(EScriptCommand eCommand, int64_t nEntity, float x, float y, float z, float w = 0.0f);
+};
+
+void register_script_commands(lua_State* L);
@@ -0,0 +1,212 @@
+#include "ScriptComponentView.h"
+
+#include "LuaBridge.h"
+
+ComponentView::ComponentView() :
+	m_pWorld(nullptr),
+	m_nEntity(0),
+	m_nComponent(0),
+	m_Ref{}
+{
+}
+
+bool ComponentView::Bind(flecs::world_t* world, flecs::entity_t entity, flecs::id_t component, size_t nSize)
+{
+	Unbind();
+
+	const EcsComponent* pComponentInfo = ecs_get(world, component, EcsComponent);
+	if (!pComponentInfo || static_cast<size_t>(pComponentInfo->size) != nSize)
+		return false;
+
+	m_pWorld = world;
+	m_nEntity = entity;
+	m_nComponent = component;
+	return true;
+}
+
+void ComponentView::Unbind()
+{
+	m_pWorld = nullptr;
+	m_nEntity = 0;
+	m_nComponent = 0;
+	m_Ref = ecs_ref_t{};
+}
+
+bool ComponentView::IsValid() const
+{
+	return Get() != nullptr;
+}
+
+void* ComponentView::Get() const
+{
+	if (!m_nEntity)
+		return nullptr;
+
+	// Storage is written in place, flecs only hands out const pointers through refs
+	return const_cast<void*>(ecs_get_ref_w_id(m_pWorld, &m_Ref, m_nEntity, m_nComponent));
+}
+
+bool Vector3View::Bind(flecs::world_t* world, flecs::entity_t entity, flecs::id_t component)
+{
+	return ComponentView::Bind(world, entity, component, sizeof(Ogre::Vector3));
+}
+
+Ogre::Vector3* Vector3View::GetVector() const
+{
+	return static_cast<Ogre::Vector3*>(Get());
+}
+
+float Vector3View::GetX() const
+{
+	Ogre::Vector3* pVector = GetVector();
+	return pVector ? pVector->x : 0.0f;
+}
+
+float Vector3View::GetY() const
+{
+	Ogre::Vector3* pVector = GetVector();
+	return pVector ? pVector->y : 0.0f;
+}
+
+float Vector3View::GetZ() const
+{
+	Ogre::Vector3* pVector = GetVector();
+	return pVector ? pVector->z : 0.0f;
+}
+
+void Vector3View::SetX(float x)
+{
+	if (Ogre::Vector3* pVector = GetVector())
+		pVector->x = x;
+}
+
+void Vector3View::SetY(float y)
+{
+	if (Ogre::Vector3* pVector = GetVector())
+		pVector->y = y;
+}
+
+void Vector3View::SetZ(float z)
+{
+	if (Ogre::Vector3* pVector = GetVector())
+		pVector->z = z;
+}
+
+void Vector3View::Set(float x, float y, float z)
+{
+	if (Ogre::Vector3* pVector = GetVector())
+	{
+		pVector->x = x;
+		pVector->y = y;
+		pVector->z = z;
+	}
+}
+
+void Vector3View::Copy(const Ogre::Vector3& v)
+{
+	if (Ogre::Vector3* pVector = GetVector())
+		*pVector = v;
+}
+
+void Vector3View::Add(const Ogre::Vector3& v)
+{
+	if (Ogre::Vector3* pVector = GetVector())
+		*pVector += v;
+}
+
+void Vector3View::AddScaled(const Ogre::Vector3& v, float fScale)
+{
+	if (Ogre::Vector3* pVector = GetVector())
+		*pVector += v * fScale;
+}
+
+void Vector3View::Read(Ogre::Vector3* pOut) const
+{
+	Ogre::Vector3* pVector = GetVector();
+	*pOut = pVector ? *pVector : Ogre::Vector3::ZERO;
+}
+
+bool QuaternionView::Bind(flecs::world_t* world, flecs::entity_t entity, flecs::id_t component)
+{
+	return ComponentView::Bind(world, entity, component, sizeof(Ogre::Quaternion));
+}
+
+Ogre::Quaternion* QuaternionView::GetQuaternion() const
+{
+	return static_cast<Ogre::Quaternion*>(Get());
+}
+
+float QuaternionView::GetW() const
+{
+	Ogre::Quaternion* pQuaternion = GetQuaternion();
+	return pQuaternion ? pQuaternion->w : 1.0f;
+}
+
+float QuaternionView::GetX() const
+{
+	Ogre::Quaternion* pQuaternion = GetQuaternion();
+	return pQuaternion ? pQuaternion->x : 0.0f;
+}
+
+float QuaternionView::GetY() const
+{
+	Ogre::Quaternion* pQuaternion = GetQuaternion();
+	return pQuaternion ? pQuaternion->y : 0.0f;
+}
+
+float QuaternionView::GetZ() const
+{
+	Ogre::Quaternion* pQuaternion = GetQuaternion();
+	return pQuaternion ? pQuaternion->z : 0.0f;
+}
+
+void QuaternionView::Copy(const Ogre::Quaternion& q)
+{
+	if (Ogre::Quaternion* pQuaternion = GetQuaternion())
+		*pQuaternion = q;
+}
+
+void QuaternionView::SetAngleAxis(float fRadians, const Ogre::Vector3& axis)
+{
+	if (Ogre::Quaternion* pQuaternion = GetQuaternion())
+		pQuaternion->FromAngleAxis(Ogre::Radian(fRadians), axis);
+}
+
+void QuaternionView::RotateInto(const Ogre::Vector3& v, Ogre::Vector3* pOut)
+{
+	Ogre::Quaternion* pQuaternion = GetQuaternion();
+	*pOut = pQuaternion ? *pQuaternion * v : v;
+}
+
+void QuaternionView::Read(Ogre::Quaternion* pOut) const
+{
+	Ogre::Quaternion* pQuaternion = GetQuaternion();
+	*pOut = pQuaternion ? *pQuaternion : Ogre::Quaternion::IDENTITY;
+}
+
+void register_script_component_views(lua_State* L)
+{
+	luabridge::getGlobalNamespace(L)
+		.beginClass<Vector3View>("Vector3View")
+		.addProperty("x", &Vector3View::GetX, &Vector3View::SetX)
+		.addProperty("y", &Vector3View::GetY, &Vector3View::SetY)
+		.addProperty("z", &Vector3View::GetZ, &Vector3View::SetZ)
+		.addFunction("valid", &Vector3View::IsValid)
+		.addFunction("set", &Vector3View::Set)
+		.addFunction("copy", &Vector3View::Copy)
+		.addFunction("add", &Vector3View::Add)
+		.addFunction("addScaled", &Vector3View::AddScaled)
+		.addFunction("read", &Vector3View::Read)
+		.endClass()
+		.beginClass<QuaternionView>("QuaternionView")
+		.addProperty("w", &QuaternionView::GetW)
+		.addProperty("x", &QuaternionView::GetX)
+		.addProperty("y", &QuaternionView::GetY)
+		.addProperty("z", &QuaternionView::GetZ)
+		.addFunction("valid", &QuaternionView::IsValid)
+		.addFunction("copy", &QuaternionView::Copy)
+		.addFunction("setAngleAxis", &QuaternionView::SetAngleAxis)
+		.addFunction("rotateInto", &QuaternionView::RotateInto)
+		.addFunction("read", &QuaternionView::Read)
+		.endClass();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "flecs.h"
+#include <OgreVector3.h>
+#include <OgreQuaternion.h>
+
+struct lua_State;
+
+// Script access to one component of one entity, read and written in place in flecs storage.
+// Pointer is cached in a flecs ref, which checks the entity is still in the same table row
+// and the table wasn't reallocated, and looks the component up again otherwise.
+// Only components the entity owns are reachable, inherited ones (prefab) are shared.
+// Unbound view, or entity without the component, reads zeros and drops writes.
+class ComponentView
+{
+public:
+	ComponentView();
+
+	// Script may still hold the view after the node is released
+	void Unbind();
+
+	bool IsValid() const;
+
+protected:
+	// Stays unbound if component isn't nSize bytes, view would read past it
+	bool Bind(flecs::world_t* world, flecs::entity_t entity, flecs::id_t component, size_t nSize);
+	void* Get() const;
+
+private:
+	flecs::world_t* m_pWorld;
+	flecs::entity_t m_nEntity;
+	flecs::id_t m_nComponent;
+	// Refreshed on access, also by reads
+	mutable ecs_ref_t m_Ref;
+};
+
+// Position, Velocity, CameraPosition
+class Vector3View : public ComponentView
+{
+public:
+	bool Bind(flecs::world_t* world, flecs::entity_t entity, flecs::id_t component);
+
+	float GetX() const;
+	float GetY() const;
+	float GetZ() const;
+	void SetX(float x);
+	void SetY(float y);
+	void SetZ(float z);
+
+	void Set(float x, float y, float z);
+	void Copy(const Ogre::Vector3& v);
+	void Add(const Ogre::Vector3& v);
+	void AddScaled(const Ogre::Vector3& v, float fScale);
+	// Writes value into out, for math with the Vector3 bindings
+	void Read(Ogre::Vector3* pOut) const;
+
+private:
+	Ogre::Vector3* GetVector() const;
+};
+
+// Orientation
+class QuaternionView : public ComponentView
+{
+public:
+	bool Bind(flecs::world_t* world, flecs::entity_t entity, flecs::id_t component);
+
+	float GetW() const;
+	float GetX() const;
+	float GetY() const;
+	float GetZ() const;
+
+	void Copy(const Ogre::Quaternion& q);
+	void SetAngleAxis(float fRadians, const Ogre::Vector3& axis);
+	void RotateInto(const Ogre::Vector3& v, Ogre::Vector3* pOut);
+	void Read(Ogre::Quaternion* pOut) const;
+
+private:
+	Ogre::Quaternion* GetQuaternion() const;
+};
+
+void register_script_component_views(lua_State* L);
@@ -0,0 +1,127 @@
+#include "ScriptMath.h"
+
+#include "LuaBridge.h"
+#include "OgreVector3.h"
+#include "OgreQuaternion.h"
+
+static const int VectorTemporaryCount = 64;
+static const char* VectorTemporariesName = "Vector3Temporaries";
+
+static void SetVector(Ogre::Vector3* pVector, float x, float y, float z)
+{
+	pVector->x = x;
+	pVector->y = y;
+	pVector->z = z;
+}
+
+static void CopyVector(Ogre::Vector3* pVector, const Ogre::Vector3& v)
+{
+	*pVector = v;
+}
+
+static void AddVector(Ogre::Vector3* pVector, const Ogre::Vector3& v)
+{
+	*pVector += v;
+}
+
+static void SubVector(Ogre::Vector3* pVector, const Ogre::Vector3& v)
+{
+	*pVector -= v;
+}
+
+static void ScaleVector(Ogre::Vector3* pVector, float fScale)
+{
+	*pVector *= fScale;
+}
+
+static void AddScaledVector(Ogre::Vector3* pVector, const Ogre::Vector3& v, float fScale)
+{
+	*pVector += v * fScale;
+}
+
+static float DotVector(const Ogre::Vector3* pVector, const Ogre::Vector3& v)
+{
+	return pVector->dotProduct(v);
+}
+
+static float VectorLength(const Ogre::Vector3* pVector)
+{
+	return pVector->length();
+}
+
+static void NormaliseVector(Ogre::Vector3* pVector)
+{
+	pVector->normalise();
+}
+
+static void RotateInto(const Ogre::Quaternion* pQuaternion, const Ogre::Vector3& v, Ogre::Vector3* pOut)
+{
+	*pOut = *pQuaternion * v;
+}
+
+static void SetAngleAxis(Ogre::Quaternion* pQuaternion, float fRadians, const Ogre::Vector3& axis)
+{
+	pQuaternion->FromAngleAxis(Ogre::Radian(fRadians), axis);
+}
+
+static void AddRadians(Ogre::Radian* pRadian, float fRadians)
+{
+	*pRadian += Ogre::Radian(fRadians);
+}
+
+static float GetRadians(const Ogre::Radian* pRadian)
+{
+	return pRadian->valueRadians();
+}
+
+// Slot 0 of the ring table holds index of the last handed out vector
+static int PushVectorTemporary(lua_State* L)
+{
+	lua_getfield(L, LUA_REGISTRYINDEX, VectorTemporariesName);
+	lua_rawgeti(L, -1, 0);
+	lua_Integer nIndex = lua_tointeger(L, -1) % VectorTemporaryCount + 1;
+	lua_pop(L, 1);
+	lua_pushinteger(L, nIndex);
+	lua_rawseti(L, -2, 0);
+
+	lua_rawgeti(L, -1, nIndex);
+	lua_remove(L, -2);
+	*luabridge::Stack<Ogre::Vector3*>::get(L, -1) = Ogre::Vector3::ZERO;
+	return 1;
+}
+
+void register_script_math(lua_State* L)
+{
+	luabridge::getGlobalNamespace(L)
+		.beginClass<Ogre::Vector3>("Vector3")
+		.addFunction("set", &SetVector)
+		.addFunction("copy", &CopyVector)
+		.addFunction("add", &AddVector)
+		.addFunction("sub", &SubVector)
+		.addFunction("scale", &ScaleVector)
+		.addFunction("addScaled", &AddScaledVector)
+		.addFunction("dot", &DotVector)
+		.addFunction("length", &VectorLength)
+		.addFunction("normalise", &NormaliseVector)
+		.addStaticFunction("temp", &PushVectorTemporary)
+		.endClass()
+		.beginClass<Ogre::Quaternion>("Quaternion")
+		.addFunction("rotateInto", &RotateInto)
+		.addFunction("setAngleAxis", &SetAngleAxis)
+		.endClass()
+		.beginClass<Ogre::Radian>("Radian")
+		.addFunction("addRadians", &AddRadians)
+		.addFunction("valueRadians", &GetRadians)
+		.endClass();
+
+	std::error_code ec;
+	lua_createtable(L, VectorTemporaryCount, 1);
+	lua_pushinteger(L, 0);
+	lua_rawseti(L, -2, 0);
+	for (int i = 1; i <= VectorTemporaryCount; ++i)
+	{
+		luabridge::push(L, Ogre::Vector3::ZERO, ec);
+		lua_rawseti(L, -2, i);
+	}
+	lua_setfield(L, LUA_REGISTRYINDEX, VectorTemporariesName);
+}
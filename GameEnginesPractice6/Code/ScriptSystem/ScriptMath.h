@@ -0,0 +1,13 @@
+#pragma once
+
+struct lua_State;
+
+// In place Vector3, Quaternion and Radian methods for scripts. Operators bound by
+// ScriptSystem (__add, __mul) return a new userdata per call, these write into
+// an existing one, so an update written with them allocates nothing:
+//   q:rotateInto(v, out)      out = q * v
+//   v:addScaled(dir, s)       v = v + dir * s
+//   Vector3.temp()            scratch vector from a ring of preallocated ones,
+//                             only valid until the ring wraps, don't keep it
+// Must be called after the classes are registered.
+void register_script_math(lua_State* L);
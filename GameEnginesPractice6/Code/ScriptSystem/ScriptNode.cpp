@@ -1,26 +1,182 @@
 #include "ScriptNode.h"
+#include "ScriptSystem.h"
+#include "../ProjectDefines.h"
 
 #include <algorithm>
 
-ScriptNode::ScriptNode(std::string strScriptPath, InputHandler* pInputHandler, flecs::entity& ent) :
-	m_pInputHandler(pInputHandler),
-	m_strScriptPath(strScriptPath)
+ScriptNode::ScriptNode(const ScriptChunk* pChunk, lua_State* L, uint32_t nState, ScriptMemoryAccount* pMemoryAccount) :
+	m_pChunk(pChunk),
+	m_script(L),
+	m_nState(nState),
+	m_pMemoryAccount(pMemoryAccount),
+	m_nEnvRef(LUA_NOREF),
+	m_nEntityRef(LUA_NOREF)
 {
-	m_script = luaL_newstate();
-	luaL_openlibs(m_script);
+	std::fill(std::begin(m_CallbackRefs), std::end(m_CallbackRefs), LUA_NOREF);
+}
+
+// Runs the script from scratch in a new environment, so a recycled node
+// behaves the same as a freshly created one
+bool ScriptNode::Reset(flecs::entity& ent)
+{
+	return Init(ent);
+}
+
+const std::string& ScriptNode::GetScriptPath() const
+{
+	return m_pChunk->strPath;
+}
+
+ScriptMemoryAccount* ScriptNode::GetMemoryAccount() const
+{
+	return m_pMemoryAccount;
+}
+
+// Environment falls back to globals of the shared state (bindings, inputHandler)
+// through a metatable ScriptSystem keeps in registry
+bool ScriptNode::CreateEnvironment()
+{
+	ReleaseEnvironment();
+
+	if (luaL_loadbuffer(m_script, m_pChunk->strBytecode.data(), m_pChunk->strBytecode.size(), m_pChunk->strPath.c_str()) != LUA_OK)
+	{
+		lua_pop(m_script, 1);
+		return false;
+	}
+
+	lua_newtable(m_script);
+	lua_getfield(m_script, LUA_REGISTRYINDEX, ScriptSystem::EnvMetatableName);
+	lua_setmetatable(m_script, -2);
+	lua_pushvalue(m_script, -1);
+	m_nEnvRef = luaL_ref(m_script, LUA_REGISTRYINDEX);
+
+	// First upvalue of a main chunk is its _ENV
+	lua_setupvalue(m_script, -2, 1);
+
+	if (lua_pcall(m_script, 0, 0, 0) != LUA_OK)
+	{
+		lua_pop(m_script, 1);
+		return false;
+	}
+
+	ResolveCallbacks();
+	return true;
+}
+
+void ScriptNode::ReleaseEnvironment()
+{
+	for (int& nRef : m_CallbackRefs)
+	{
+		luaL_unref(m_script, LUA_REGISTRYINDEX, nRef);
+		nRef = LUA_NOREF;
+	}
+
+	luaL_unref(m_script, LUA_REGISTRYINDEX, m_nEntityRef);
+	m_nEntityRef = LUA_NOREF;
+	luaL_unref(m_script, LUA_REGISTRYINDEX, m_nEnvRef);
+	m_nEnvRef = LUA_NOREF;
+}
+
+// Hot path calls then go registry -> function without any string lookups
+const char* ScriptNode::GetCallbackName(EScriptCallback eCallback) const
+{
+	switch (eCallback)
+	{
+	case eSC_OnUpdate: return m_OnUpdateFunctionName;
+	case eSC_OnUpdateBatch: return m_OnUpdateBatchFunctionName;
+	case eSC_GetPosition: return m_GetPositionFunctionName;
+	case eSC_SetPosition: return m_SetPositionFunctionName;
+	case eSC_GetOrientation: return m_GetOrientationFunctionName;
+	case eSC_GetCameraPosition: return m_GetCameraPositionFunctionName;
+	default: return nullptr;
+	}
+}
+
+void ScriptNode::ResolveCallbacks()
+{
+	lua_rawgeti(m_script, LUA_REGISTRYINDEX, m_nEnvRef);
+	lua_getfield(m_script, -1, m_EntityFieldName);
+
+	bool bHasEntity = lua_istable(m_script, -1);
+	for (uint32_t nCallback = 0; nCallback < eSC_Max; ++nCallback)
+	{
+		if (bHasEntity && lua_getfield(m_script, -1, GetCallbackName(static_cast<EScriptCallback>(nCallback))) == LUA_TFUNCTION)
+			m_CallbackRefs[nCallback] = luaL_ref(m_script, LUA_REGISTRYINDEX);
+		else
+		{
+			if (bHasEntity)
+				lua_pop(m_script, 1);
+			m_CallbackRefs[nCallback] = LUA_REFNIL;
+		}
+	}
+
+	m_nEntityRef = luaL_ref(m_script, LUA_REGISTRYINDEX);
+	lua_pop(m_script, 1);
+}
+
+luabridge::LuaRef ScriptNode::GetEntityObject() const
+{
+	lua_rawgeti(m_script, LUA_REGISTRYINDEX, m_nEntityRef);
+	return luabridge::LuaRef::fromStack(m_script);
+}
+
+bool ScriptNode::HasCallback(EScriptCallback eCallback) const
+{
+	return m_CallbackRefs[eCallback] != LUA_REFNIL && m_CallbackRefs[eCallback] != LUA_NOREF;
+}
+
+bool ScriptNode::PushCallback(EScriptCallback eCallback) const
+{
+	if (!HasCallback(eCallback))
+		return false;
+
+	lua_rawgeti(m_script, LUA_REGISTRYINDEX, m_CallbackRefs[eCallback]);
+	return true;
+}
+
+// Script errors and wrong return types give fallback instead of raising through C++
+template <typename T>
+T ScriptNode::CallReturning(EScriptCallback eCallback, const T& fallback) const
+{
+	if (!PushCallback(eCallback))
+		return fallback;
+
+	ScriptMemoryScope memoryScope(m_pMemoryAccount);
+	if (lua_pcall(m_script, 0, 1, 0) != LUA_OK)
+	{
+		lua_pop(m_script, 1);
+		return fallback;
+	}
 
-	AddDependencies(m_script);
+	T result = luabridge::Stack<T>::isInstance(m_script, -1) ? T(luabridge::Stack<T>::get(m_script, -1)) : fallback;
+	lua_pop(m_script, 1);
+	return result;
+}
 
-	luaL_dofile(m_script, m_strScriptPath.c_str());
-	lua_pcall(m_script, 0, 0, 0);
+bool ScriptNode::Init(flecs::entity& ent)
+{
+	m_Entity = ent;
+	ScriptMemoryScope memoryScope(m_pMemoryAccount);
+	// Indexing a nil Entity below would raise outside of any pcall
+	if (!CreateEnvironment() || !GetEntityObject().isTable())
+	{
+		ReleaseEnvironment();
+		return false;
+	}
 
-	luabridge::LuaRef object = luabridge::getGlobal(m_script, m_EntityFieldName);
+	luabridge::LuaRef object = GetEntityObject();
 	luabridge::LuaRef properties = object[m_PropertiesFieldName];
-	luabridge::LuaRef controllable = properties[m_ControllableFieldName];
-	
-	bool bControllable = controllable.cast<bool>();
+	bool bHasProperties = properties.isTable();
+
+	bool bControllable = bHasProperties && properties[m_ControllableFieldName].cast<bool>();
 
-	ent.set_name(properties[m_NameFieldName].cast<std::string>().c_str());
+	// Name is a pair flecs can't carry over from a prefab, unnamed scripts don't move the entity for it
+	if (bHasProperties)
+	{
+		luabridge::LuaRef name = properties[m_NameFieldName];
+		if (name.isString())
+			ent.set_name(name.cast<std::string>().c_str());
+	}
 
 	if (bControllable)
 		ent.add<Controllable>();
@@ -41,98 +197,188 @@ ScriptNode::ScriptNode(std::string strScriptPath, InputHandler* pInputHandler, f
 	Ogre::Vector3 vPosition = GetPosition();
 	ent.set(Position{ vPosition.x , vPosition.y, vPosition.z });
 
-	luabridge::LuaResult orientation = object[m_GetOrientationFunctionName]();
-	if (orientation.wasOk())
+	if (HasCallback(eSC_GetOrientation))
 	{
 		Ogre::Quaternion vOrientation = GetOrientation();
 		ent.set(Orientation{ vOrientation.w, vOrientation.x , vOrientation.y, vOrientation.z });
 	}
 
+	// Player and camera react every frame, the rest may update less often far from camera
+	bool bEveryFrame = bControllable || !camera.isNil();
+	ent.set(MakeUpdateLod(0, bEveryFrame ? 0 : UpdateLodScheduler::MaxBuckets - 1));
+
+	BindComponents(ent);
+	return true;
+}
+
+// Views are bound whether or not the entity has the component yet, they resolve it on
+// every access, so Velocity added by physics later is picked up and script checks valid()
+void ScriptNode::BindComponents(flecs::entity& ent)
+{
+	flecs::world_t* world = ent.world().c_ptr();
+	m_PositionView.Bind(world, ent.id(), flecs::_::cpp_type<Position>::id(world));
+	m_VelocityView.Bind(world, ent.id(), flecs::_::cpp_type<Velocity>::id(world));
+	m_CameraPositionView.Bind(world, ent.id(), flecs::_::cpp_type<CameraPosition>::id(world));
+	m_OrientationView.Bind(world, ent.id(), flecs::_::cpp_type<Orientation>::id(world));
+
+	// Userdata only points at the views, lua never owns or frees them
+	luabridge::LuaRef object = GetEntityObject();
+	// Lets other scripts address this entity in commands
+	object[m_IdFieldName] = static_cast<int64_t>(ent.id());
+
+	luabridge::LuaRef components = luabridge::newTable(m_script);
+	components[m_PositionFieldName] = &m_PositionView;
+	components[m_VelocityFieldName] = &m_VelocityView;
+	components[m_CameraPositionFieldName] = &m_CameraPositionView;
+	components[m_OrientationFieldName] = &m_OrientationView;
+
+	object[m_ComponentsFieldName] = components;
+}
+
+void ScriptNode::UnbindComponents()
+{
+	m_PositionView.Unbind();
+	m_VelocityView.Unbind();
+	m_CameraPositionView.Unbind();
+	m_OrientationView.Unbind();
 }
 
 ScriptNode::~ScriptNode()
 {
-	lua_close(m_script);
+	ReleaseEnvironment();
 }
 
 void ScriptNode::Update(float dt)
 {
-	luabridge::LuaRef object = luabridge::getGlobal(m_script, m_EntityFieldName);
-	object[m_OnUpdateFunctionName](dt);
+	if (!PushCallback(eSC_OnUpdate))
+		return;
+
+	ScriptMemoryScope memoryScope(m_pMemoryAccount);
+#ifdef SCRIPT_PROFILER
+	ScriptProfileScope profileScope(m_script, m_Entity.world().c_ptr(), m_Entity.id(), GetCallbackName(eSC_OnUpdate));
+#endif
+	lua_pushnumber(m_script, dt);
+	if (lua_pcall(m_script, 1, 0, 0) != LUA_OK)
+		lua_pop(m_script, 1);
 }
 
-Ogre::Vector3 ScriptNode::GetPosition() const
+bool ScriptNode::HasBatchUpdate() const
 {
-	luabridge::LuaRef object = luabridge::getGlobal(m_script, m_EntityFieldName);
-
-	luabridge::LuaResult position = object[m_GetPositionFunctionName]();
-	assert(position.wasOk());
-	
-	Ogre::Vector3 vPosition = position[0].cast<Ogre::Vector3>();
+	return HasCallback(eSC_OnUpdateBatch);
+}
 
-	return vPosition;
+Ogre::Vector3 ScriptNode::GetPosition() const
+{
+	return CallReturning(eSC_GetPosition, Ogre::Vector3::ZERO);
 }
 
 void ScriptNode::SetPosition(Ogre::Vector3 position)
 {
-	luabridge::LuaRef object = luabridge::getGlobal(m_script, m_EntityFieldName);
-	object[m_SetPositionFunctionName](position.x, position.y, position.z);
+	m_PositionView.Copy(position);
+
+	if (!PushCallback(eSC_SetPosition))
+		return;
+
+	ScriptMemoryScope memoryScope(m_pMemoryAccount);
+	lua_pushnumber(m_script, position.x);
+	lua_pushnumber(m_script, position.y);
+	lua_pushnumber(m_script, position.z);
+	if (lua_pcall(m_script, 3, 0, 0) != LUA_OK)
+		lua_pop(m_script, 1);
 }
 
 Ogre::Vector3 ScriptNode::GetCameraPosition() const
 {
-	luabridge::LuaRef object = luabridge::getGlobal(m_script, m_EntityFieldName);
-	
-	luabridge::LuaResult cameraPosition = object[m_GetCameraPositionFunctionName]();
-	assert(cameraPosition.wasOk());
-
-	Ogre::Vector3 vPosition = cameraPosition[0].cast<Ogre::Vector3>();
-
-	return vPosition;
+	return CallReturning(eSC_GetCameraPosition, Ogre::Vector3::ZERO);
 }
 
 Ogre::Quaternion ScriptNode::GetOrientation() const
 {
-	luabridge::LuaRef object = luabridge::getGlobal(m_script, m_EntityFieldName);
-	
-	luabridge::LuaResult orientation = object[m_GetOrientationFunctionName]();
-	assert(orientation.wasOk());
-
-	Ogre::Quaternion vOrientation = orientation[0].cast<Ogre::Quaternion>();
-
-	return vOrientation;
+	return CallReturning(eSC_GetOrientation, Ogre::Quaternion::IDENTITY);
 }
 
 std::string ScriptNode::GetMeshName() const
 {
-	luabridge::LuaRef object = luabridge::getGlobal(m_script, m_EntityFieldName);
+	luabridge::LuaRef object = GetEntityObject();
+	if (!object.isTable())
+		return std::string();
 
 	luabridge::LuaRef properties = object[m_PropertiesFieldName];
+	if (!properties.isTable())
+		return std::string();
+
 	luabridge::LuaRef meshName = properties[m_MeshNameFieldName];
-	return meshName.cast<std::string>();
+	return meshName.isString() ? meshName.cast<std::string>() : std::string();
 }
 
-void ScriptNode::ReloadScript()
+// Environment table the chunk ran in, nil if it didn't load or run
+static luabridge::LuaRef LoadChunkEnvironment(const ScriptChunk* pChunk, lua_State* L)
 {
-	luabridge::LuaRef currentObject = luabridge::getGlobal(m_script, m_EntityFieldName);
+	ScriptMemoryScope memoryScope(pChunk->pMemoryAccount);
+	if (luaL_loadbuffer(L, pChunk->strBytecode.data(), pChunk->strBytecode.size(), pChunk->strPath.c_str()) != LUA_OK)
+	{
+		lua_pop(L, 1);
+		return luabridge::LuaRef(L);
+	}
 
-	lua_State* script = luaL_newstate();
-	luaL_openlibs(script);
+	lua_newtable(L);
+	lua_getfield(L, LUA_REGISTRYINDEX, ScriptSystem::EnvMetatableName);
+	lua_setmetatable(L, -2);
+	luabridge::LuaRef env = luabridge::LuaRef::fromStack(L, -1);
+	lua_setupvalue(L, -2, 1);
 
-	AddDependencies(script);
+	if (lua_pcall(L, 0, 0, 0) != LUA_OK)
+	{
+		lua_pop(L, 1);
+		return luabridge::LuaRef(L);
+	}
 
-	luaL_dofile(script, m_strScriptPath.c_str());
-	lua_pcall(script, 0, 0, 0);
+	return env;
+}
 
-	luabridge::LuaRef object = luabridge::getGlobal(script, m_EntityFieldName);
-	luabridge::LuaRef parameters = object[m_ParametersFieldName];
-	luabridge::Range parametersRange = luabridge::pairs(parameters);
+luabridge::LuaRef ScriptNode::LoadChunkParameters() const
+{
+	luabridge::LuaRef env = LoadChunkEnvironment(m_pChunk, m_script);
+	if (!env.isTable())
+		return luabridge::LuaRef(m_script);
+
+	luabridge::LuaRef object = env[m_EntityFieldName];
+	if (!object.isTable())
+		return luabridge::LuaRef(m_script);
 
-	if (parameters.isNil())
+	return object[m_ParametersFieldName];
+}
+
+bool ScriptNode::LoadChunkThreadSafe(const ScriptChunk* pChunk, lua_State* L)
+{
+	luabridge::LuaRef env = LoadChunkEnvironment(pChunk, L);
+	if (!env.isTable())
+		return false;
+
+	luabridge::LuaRef object = env["Entity"];
+	if (!object.isTable())
+		return false;
+
+	luabridge::LuaRef properties = object["Properties"];
+	if (!properties.isTable())
+		return false;
+
+	luabridge::LuaRef threadSafe = properties["ThreadSafe"];
+	return threadSafe.isNumber() ? threadSafe.cast<int>() != 0 : threadSafe.cast<bool>();
+}
+
+void ScriptNode::ReloadParameters(const luabridge::LuaRef& parameters)
+{
+	ScriptMemoryScope memoryScope(m_pMemoryAccount);
+	luabridge::LuaRef currentObject = GetEntityObject();
+
+	if (!parameters.isTable() || !currentObject.isTable())
 	{
 		return;
 	}
 
+	luabridge::Range parametersRange = luabridge::pairs(parameters);
+
 	std::string strParameterName;
 	float fValue;
 	for (auto it = parametersRange.begin(); it != parametersRange.end(); ++it)
@@ -145,38 +391,10 @@ void ScriptNode::ReloadScript()
 
 bool ScriptNode::GetIsStatic() const 
 {
-	luabridge::LuaRef object = luabridge::getGlobal(m_script, m_EntityFieldName);
+	luabridge::LuaRef object = GetEntityObject();
+	if (!object.isTable())
+		return false;
+
 	luabridge::LuaRef isStatic = object[m_StaticsFieldName];
 	return isStatic.cast<bool>();
 }
-
-void ScriptNode::AddDependencies(lua_State* L)
-{
-	std::error_code ec;
-
-	luabridge::getGlobalNamespace(L)
-		.beginClass<InputHandler>("InputHandler")
-		.addConstructor<void(*) (const std::string&)>()
-		.addFunction("isCommandActive", &(InputHandler::IsCommandActive))
-		.endClass()
-		.beginClass<Ogre::Vector3>("Vector3")
-		.addConstructor<void(*) (float, float, float)>()
-		.addFunction("__add", (Ogre::Vector3(Ogre::Vector3::*)(const Ogre::Vector3&) const) &Ogre::Vector3::operator+)
-		.addFunction("__mul", (Ogre::Vector3(Ogre::Vector3::*)(const float) const) &Ogre::Vector3::operator*)
-		.addProperty("x", &Ogre::Vector3::x, true)
-		.addProperty("y", &Ogre::Vector3::y, true)
-		.addProperty("z", &Ogre::Vector3::z, true)
-		.endClass()
-		.beginClass<Ogre::Radian>("Radian")
-		.addConstructor<void(*) (float)>()
-		.addFunction("__add", (Ogre::Radian(Ogre::Radian::*)(const Ogre::Radian&) const) &Ogre::Radian::operator+)
-		.endClass()
-		.beginClass<Ogre::Quaternion>("Quaternion")
-		.addConstructor<void(*) (const Ogre::Radian&, const Ogre::Vector3&)>()
-		.addFunction("setOrientation", &(Ogre::Quaternion::FromAngleAxis))
-		.addFunction("__mul", (Ogre::Vector3(Ogre::Quaternion::*)(const Ogre::Vector3&) const) &Ogre::Quaternion::operator*)
-		.endClass();
-
-	luabridge::push(L, m_pInputHandler, ec);
-	lua_setglobal(L, "inputHandler");
-}
\ No newline at end of file
@@ -12,7 +12,10 @@
 #include "../ECS/ecsControl.h"
 #include "../ECS/ecsStatic.h"
 #include "../ECS/ecsScript.h"
+#include "../ECS/ecsLod.h"
 #include "../FileSystem/GEFile.h"
+#include "ScriptAllocator.h"
+#include "ScriptComponentView.h"
 
 template <typename T>
 struct EnumWrapper
@@ -37,17 +40,62 @@ namespace luabridge {
 
 }
 
+// Script file compiled once, instances are loaded from its bytecode without parsing
+struct ScriptChunk
+{
+	std::string strPath;
+	std::string strBytecode;
+	// Milliseconds it took to parse the source, measured when it was last compiled
+	float fCompileTime;
+	// Parent of the accounts of all instances
+	ScriptMemoryAccount* pMemoryAccount;
+	// Entity.Properties.ThreadSafe, read once when the script is first loaded
+	bool bThreadSafe;
+};
+
+// Entity functions called every frame, resolved once per load into registry references
+enum EScriptCallback : uint32_t
+{
+	eSC_OnUpdate = 0,
+	eSC_OnUpdateBatch,
+	eSC_GetPosition,
+	eSC_SetPosition,
+	eSC_GetOrientation,
+	eSC_GetCameraPosition,
+
+	eSC_Max
+};
+
+// Instance of a script in the shared lua state of ScriptSystem.
+// Chunk runs in an environment table of its own, so globals the script
+// defines (Entity and its functions) belong to this instance only.
 class ScriptNode
 {
 public:
-	ScriptNode(std::string strScriptPath, InputHandler* pInputHandler, flecs::entity& ent);
+	// Node does nothing until Reset binds it to an entity
+	ScriptNode(const ScriptChunk* pChunk, lua_State* L, uint32_t nState, ScriptMemoryAccount* pMemoryAccount);
 	~ScriptNode();
 
 	void Update(float dt);
-	void ReloadScript();
+	// Script defines Entity.OnUpdateBatch, ScriptSystem updates all its instances in one call
+	bool HasBatchUpdate() const;
+	// Runs the script's current chunk in a throwaway environment, returns its Entity.Parameters
+	luabridge::LuaRef LoadChunkParameters() const;
+	// Same for Entity.Properties.ThreadSafe of any chunk
+	static bool LoadChunkThreadSafe(const ScriptChunk* pChunk, lua_State* L);
+	// Copies parameters of a reloaded script over the instance's, rest of instance state is kept
+	void ReloadParameters(const luabridge::LuaRef& parameters);
+	// False if the chunk raised an error or defined no Entity table, node must not be used then
+	bool Reset(flecs::entity& ent);
+
+	const std::string& GetScriptPath() const;
+	ScriptMemoryAccount* GetMemoryAccount() const;
 
 	Ogre::Vector3 GetPosition() const;
+	// Tells the script and writes Position component
 	void SetPosition(Ogre::Vector3 position);
+	// Entity.Components views stop reaching the entity, called when node is released
+	void UnbindComponents();
 
 	Ogre::Vector3 GetCameraPosition() const;
 	Ogre::Quaternion GetOrientation() const;
@@ -55,14 +103,44 @@ public:
 	bool GetIsStatic() const;
 
 private:
-	std::string m_strScriptPath;
+	friend class ScriptSystem;
 
-	InputHandler* m_pInputHandler;
-	
-	lua_State* m_script;
-	GEFile* m_pScriptFile;
+	const ScriptChunk* m_pChunk;
 
-	void AddDependencies(lua_State* L);
+	// Shared with other nodes of the state, owned by ScriptSystem
+	lua_State* m_script;
+	// Index of the state in ScriptSystem
+	uint32_t m_nState;
+	flecs::entity m_Entity;
+	// Charged for everything lua allocates while this instance runs
+	ScriptMemoryAccount* m_pMemoryAccount;
+	// Registry reference to environment table of this instance
+	int m_nEnvRef;
+	// Registry references to Entity and its callbacks, LUA_REFNIL if script has none.
+	// Functions assigned to Entity after load are not picked up.
+	int m_nEntityRef;
+	int m_CallbackRefs[eSC_Max];
+
+	// Entity.Components, the script writes its transform straight into these
+	Vector3View m_PositionView;
+	Vector3View m_VelocityView;
+	Vector3View m_CameraPositionView;
+	QuaternionView m_OrientationView;
+
+	bool Init(flecs::entity& ent);
+	void BindComponents(flecs::entity& ent);
+	bool CreateEnvironment();
+	void ReleaseEnvironment();
+	void ResolveCallbacks();
+	// Field of Entity the callback is read from
+	const char* GetCallbackName(EScriptCallback eCallback) const;
+	luabridge::LuaRef GetEntityObject() const;
+
+	bool HasCallback(EScriptCallback eCallback) const;
+	// Leaves function on stack and returns true if script defines it
+	bool PushCallback(EScriptCallback eCallback) const;
+	template <typename T>
+	T CallReturning(EScriptCallback eCallback, const T& fallback) const;
 
 	const char* m_EntityFieldName = "Entity";
 	const char* m_PropertiesFieldName = "Properties";
@@ -72,6 +150,12 @@ private:
 	const char* m_NameFieldName = "Name";
 	const char* m_ParametersFieldName = "Parameters";
 	const char* m_StaticsFieldName = "IsStatic";
+	const char* m_IdFieldName = "Id";
+	const char* m_ComponentsFieldName = "Components";
+	const char* m_PositionFieldName = "Position";
+	const char* m_VelocityFieldName = "Velocity";
+	const char* m_CameraPositionFieldName = "CameraPosition";
+	const char* m_OrientationFieldName = "Orientation";
 
 	const char* m_GetPositionFunctionName = "GetPosition";
 	const char* m_SetPositionFunctionName = "SetPosition";
@@ -81,4 +165,5 @@ private:
 	const char* m_GetOrientationFunctionName = "GetOrientation";
 	const char* m_OnInitFunctionName = "OnInit";
 	const char* m_OnUpdateFunctionName = "OnUpdate";
+	const char* m_OnUpdateBatchFunctionName = "OnUpdateBatch";
 };
@@ -0,0 +1,594 @@
+#include "ScriptProfiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <unordered_map>
+
+#include "lua.hpp"
+
+static const uint32_t InvalidProfileIndex = ~0u;
+
+struct ScriptProfileCounters
+{
+	// Milliseconds
+	double fSelfTime;
+	double fTotalTime;
+	uint64_t nSelfInstructions;
+	uint64_t nTotalInstructions;
+	uint64_t nCalls;
+
+	void Add(const ScriptProfileCounters& other)
+	{
+		fSelfTime += other.fSelfTime;
+		fTotalTime += other.fTotalTime;
+		nSelfInstructions += other.nSelfInstructions;
+		nTotalInstructions += other.nTotalInstructions;
+		nCalls += other.nCalls;
+	}
+};
+
+// Function called from a path in the call tree. Roots stand for archetypes and have no function
+struct ScriptProfileNode
+{
+	uint32_t nFunction;
+	uint32_t nParent;
+	uint32_t nArchetype;
+	// Script file, functions without one (bound C++) count to the file of their caller
+	uint32_t nFile;
+	// Function to node, few per node, searched linearly
+	std::vector<std::pair<uint32_t, uint32_t>> children;
+
+	ScriptProfileCounters frame;
+	ScriptProfileCounters lastFrame;
+	ScriptProfileCounters total;
+};
+
+struct ScriptProfileFunction
+{
+	std::string strName;
+	uint32_t nFile;
+};
+
+class ScriptProfileRecorder
+{
+public:
+	ScriptProfileRecorder(uint32_t nInstructionPeriod);
+
+	void Enter(flecs::world_t* world, flecs::entity_t entity, const char* szCallbackName);
+	void Leave();
+
+	void OnCall(lua_State* L, lua_Debug* ar, bool bTailCall);
+	void OnReturn();
+	void OnCount();
+
+	void EndFrame();
+
+private:
+	// Reads the tree on main thread between frames
+	friend class ScriptProfiler;
+
+	typedef std::chrono::steady_clock TClock;
+
+	// Strings lua hands to hooks are interned, their addresses identify a function
+	struct FunctionKey
+	{
+		const char* pSource;
+		const char* pName;
+		int nLine;
+
+		bool operator==(const FunctionKey& other) const
+		{
+			return pSource == other.pSource && pName == other.pName && nLine == other.nLine;
+		}
+	};
+
+	struct FunctionKeyHash
+	{
+		size_t operator()(const FunctionKey& key) const
+		{
+			return std::hash<const void*>()(key.pSource) ^ (std::hash<const void*>()(key.pName) << 1) ^ static_cast<size_t>(key.nLine);
+		}
+	};
+
+	struct Frame
+	{
+		uint32_t nNode;
+		TClock::time_point start;
+		uint64_t nStartInstructions;
+		double fChildTime;
+		uint64_t nChildInstructions;
+	};
+
+	std::vector<ScriptProfileNode> m_Nodes;
+	std::vector<ScriptProfileFunction> m_Functions;
+	std::vector<std::string> m_Files;
+	std::vector<std::string> m_Archetypes;
+
+	uint32_t m_nInstructionPeriod;
+	uint64_t m_nInstructionClock;
+
+	std::unordered_map<FunctionKey, uint32_t, FunctionKeyHash> m_FunctionIds;
+	std::unordered_map<std::string, uint32_t> m_FileIds;
+	std::unordered_map<ecs_type_t, uint32_t> m_ArchetypeIds;
+	// Root node by archetype
+	std::vector<uint32_t> m_Roots;
+
+	std::vector<Frame> m_Stack;
+	uint32_t m_nArchetype;
+	// Name of the outermost call of current scope
+	const char* m_szCallbackName;
+
+	// pFallbackName is used when lua doesn't know the function's name
+	uint32_t GetFunction(lua_Debug* ar, const char* pFallbackName);
+	uint32_t GetFile(const std::string& strFile);
+	uint32_t AddArchetype(const std::string& strName);
+	uint32_t GetChild(uint32_t nNode, uint32_t nFunction);
+	void CloseFrame(TClock::time_point now);
+	void CloseFrames(TClock::time_point now);
+	bool HasAncestorCalling(uint32_t nNode, uint32_t nFunction) const;
+};
+
+ScriptProfileRecorder::ScriptProfileRecorder(uint32_t nInstructionPeriod) :
+	m_nInstructionPeriod(nInstructionPeriod),
+	m_nInstructionClock(0),
+	m_nArchetype(0),
+	m_szCallbackName(nullptr)
+{
+	// Calls outside of any scope, script loads and Init
+	AddArchetype("-");
+}
+
+uint32_t ScriptProfileRecorder::AddArchetype(const std::string& strName)
+{
+	uint32_t nArchetype = static_cast<uint32_t>(m_Archetypes.size());
+	m_Archetypes.push_back(strName);
+
+	ScriptProfileNode root = {};
+	root.nFunction = InvalidProfileIndex;
+	root.nParent = InvalidProfileIndex;
+	root.nArchetype = nArchetype;
+	root.nFile = InvalidProfileIndex;
+	m_Roots.push_back(static_cast<uint32_t>(m_Nodes.size()));
+	m_Nodes.push_back(root);
+	return nArchetype;
+}
+
+void ScriptProfileRecorder::Enter(flecs::world_t* world, flecs::entity_t entity, const char* szCallbackName)
+{
+	// Left over from a call that raised an error outside of a scope
+	CloseFrames(TClock::now());
+	m_szCallbackName = szCallbackName;
+
+	ecs_type_t type = ecs_get_type(world, entity);
+	auto archetype = m_ArchetypeIds.find(type);
+	if (archetype != m_ArchetypeIds.end())
+	{
+		m_nArchetype = archetype->second;
+		return;
+	}
+
+	// Collapsed stacks split frames on ';'
+	char* pTypeName = ecs_type_str(world, type);
+	std::string strName = pTypeName ? pTypeName : "-";
+	ecs_os_free(pTypeName);
+	std::replace(strName.begin(), strName.end(), ';', ',');
+
+	m_nArchetype = AddArchetype(strName);
+	m_ArchetypeIds.emplace(type, m_nArchetype);
+}
+
+void ScriptProfileRecorder::Leave()
+{
+	CloseFrames(TClock::now());
+	m_nArchetype = 0;
+	m_szCallbackName = nullptr;
+}
+
+uint32_t ScriptProfileRecorder::GetFile(const std::string& strFile)
+{
+	auto file = m_FileIds.find(strFile);
+	if (file != m_FileIds.end())
+		return file->second;
+
+	uint32_t nFile = static_cast<uint32_t>(m_Files.size());
+	m_Files.push_back(strFile);
+	m_FileIds.emplace(strFile, nFile);
+	return nFile;
+}
+
+uint32_t ScriptProfileRecorder::GetFunction(lua_Debug* ar, const char* pFallbackName)
+{
+	const char* pName = ar->name ? ar->name : pFallbackName;
+	FunctionKey key = { ar->source, pName, ar->linedefined };
+	auto function = m_FunctionIds.find(key);
+	if (function != m_FunctionIds.end())
+		return function->second;
+
+	ScriptProfileFunction newFunction;
+	newFunction.nFile = InvalidProfileIndex;
+	if (!pName)
+		pName = "?";
+
+	if (strcmp(ar->what, "C") == 0)
+		newFunction.strName = std::string("[C] ") + pName;
+	else
+	{
+		// Chunks are named "@" + path, only file name is kept
+		std::string strSource = ar->source ? ar->source : "?";
+		if (!strSource.empty() && (strSource[0] == '@' || strSource[0] == '='))
+			strSource.erase(0, 1);
+		size_t nSlash = strSource.find_last_of("/\\");
+		if (nSlash != std::string::npos)
+			strSource.erase(0, nSlash + 1);
+
+		newFunction.nFile = GetFile(strSource);
+		if (strcmp(ar->what, "main") == 0)
+			newFunction.strName = strSource + " main";
+		else
+			newFunction.strName = strSource + ":" + std::to_string(ar->linedefined) + " " + pName;
+	}
+	// Collapsed stacks split frames on ';'
+	std::replace(newFunction.strName.begin(), newFunction.strName.end(), ';', ',');
+
+	uint32_t nFunction = static_cast<uint32_t>(m_Functions.size());
+	m_Functions.push_back(newFunction);
+	m_FunctionIds.emplace(key, nFunction);
+	return nFunction;
+}
+
+uint32_t ScriptProfileRecorder::GetChild(uint32_t nNode, uint32_t nFunction)
+{
+	for (const std::pair<uint32_t, uint32_t>& child : m_Nodes[nNode].children)
+	{
+		if (child.first == nFunction)
+			return child.second;
+	}
+
+	ScriptProfileNode newNode = {};
+	newNode.nFunction = nFunction;
+	newNode.nParent = nNode;
+	newNode.nArchetype = m_Nodes[nNode].nArchetype;
+	newNode.nFile = m_Functions[nFunction].nFile != InvalidProfileIndex ? m_Functions[nFunction].nFile : m_Nodes[nNode].nFile;
+
+	uint32_t nChild = static_cast<uint32_t>(m_Nodes.size());
+	m_Nodes[nNode].children.emplace_back(nFunction, nChild);
+	m_Nodes.push_back(std::move(newNode));
+	return nChild;
+}
+
+void ScriptProfileRecorder::OnCall(lua_State* L, lua_Debug* ar, bool bTailCall)
+{
+	// Function that made a tail call is gone, its callee takes its place in the tree
+	if (bTailCall && !m_Stack.empty())
+		CloseFrame(TClock::now());
+
+	lua_getinfo(L, "Sn", ar);
+	// Callbacks are called through registry references, lua has no name for the outermost one
+	uint32_t nFunction = GetFunction(ar, m_Stack.empty() && !bTailCall ? m_szCallbackName : nullptr);
+	uint32_t nParent = m_Stack.empty() ? m_Roots[m_nArchetype] : m_Stack.back().nNode;
+
+	Frame frame;
+	frame.nNode = GetChild(nParent, nFunction);
+	frame.nStartInstructions = m_nInstructionClock;
+	frame.fChildTime = 0.0;
+	frame.nChildInstructions = 0;
+	// Last, so the bookkeeping above isn't timed as part of the call
+	frame.start = TClock::now();
+	m_Stack.push_back(frame);
+}
+
+void ScriptProfileRecorder::OnReturn()
+{
+	// Returns of calls that started before the hook was set
+	if (m_Stack.empty())
+		return;
+
+	CloseFrame(TClock::now());
+}
+
+void ScriptProfileRecorder::OnCount()
+{
+	m_nInstructionClock += m_nInstructionPeriod;
+}
+
+void ScriptProfileRecorder::CloseFrame(TClock::time_point now)
+{
+	Frame frame = m_Stack.back();
+	m_Stack.pop_back();
+
+	double fTotalTime = std::chrono::duration<double, std::milli>(now - frame.start).count();
+	uint64_t nTotalInstructions = m_nInstructionClock - frame.nStartInstructions;
+
+	ScriptProfileCounters& counters = m_Nodes[frame.nNode].frame;
+	counters.fTotalTime += fTotalTime;
+	counters.fSelfTime += std::max(fTotalTime - frame.fChildTime, 0.0);
+	counters.nTotalInstructions += nTotalInstructions;
+	counters.nSelfInstructions += nTotalInstructions - std::min(frame.nChildInstructions, nTotalInstructions);
+	++counters.nCalls;
+
+	if (!m_Stack.empty())
+	{
+		m_Stack.back().fChildTime += fTotalTime;
+		m_Stack.back().nChildInstructions += nTotalInstructions;
+	}
+}
+
+void ScriptProfileRecorder::CloseFrames(TClock::time_point now)
+{
+	while (!m_Stack.empty())
+		CloseFrame(now);
+}
+
+void ScriptProfileRecorder::EndFrame()
+{
+	for (ScriptProfileNode& node : m_Nodes)
+	{
+		node.lastFrame = node.frame;
+		node.total.Add(node.frame);
+		node.frame = ScriptProfileCounters{};
+	}
+}
+
+bool ScriptProfileRecorder::HasAncestorCalling(uint32_t nNode, uint32_t nFunction) const
+{
+	for (uint32_t nParent = m_Nodes[nNode].nParent; nParent != InvalidProfileIndex; nParent = m_Nodes[nParent].nParent)
+	{
+		if (m_Nodes[nParent].nFunction == nFunction)
+			return true;
+	}
+	return false;
+}
+
+static void ProfilerHook(lua_State* L, lua_Debug* ar)
+{
+	ScriptProfileRecorder* pRecorder = *static_cast<ScriptProfileRecorder**>(lua_getextraspace(L));
+
+	switch (ar->event)
+	{
+	case LUA_HOOKCALL:
+		pRecorder->OnCall(L, ar, false);
+		break;
+	case LUA_HOOKTAILCALL:
+		pRecorder->OnCall(L, ar, true);
+		break;
+	case LUA_HOOKRET:
+		pRecorder->OnReturn();
+		break;
+	case LUA_HOOKCOUNT:
+		pRecorder->OnCount();
+		break;
+	}
+}
+
+// Extra space of a state that was never attached holds garbage, the hook tells if it's ours
+static ScriptProfileRecorder* GetRecorder(lua_State* L)
+{
+	if (lua_gethook(L) != &ProfilerHook)
+		return nullptr;
+
+	return *static_cast<ScriptProfileRecorder**>(lua_getextraspace(L));
+}
+
+ScriptProfiler::ScriptProfiler(uint32_t nInstructionPeriod) :
+	m_nInstructionPeriod(std::max(nInstructionPeriod, 1u)),
+	m_nFrame(0),
+	m_fDumpPeriod(0.0f),
+	m_fTimeSinceDump(0.0f),
+	m_nDumpTopCount(0)
+{
+}
+
+ScriptProfiler::~ScriptProfiler()
+{
+	for (ScriptProfileRecorder* pRecorder : m_Recorders)
+		delete pRecorder;
+}
+
+void ScriptProfiler::Attach(lua_State* L)
+{
+	if (GetRecorder(L))
+		return;
+
+	ScriptProfileRecorder* pRecorder = nullptr;
+	auto state = std::find(m_States.begin(), m_States.end(), L);
+	if (state != m_States.end())
+		pRecorder = m_Recorders[state - m_States.begin()];
+	else
+	{
+		pRecorder = new ScriptProfileRecorder(m_nInstructionPeriod);
+		m_States.push_back(L);
+		m_Recorders.push_back(pRecorder);
+	}
+
+	*static_cast<ScriptProfileRecorder**>(lua_getextraspace(L)) = pRecorder;
+	lua_sethook(L, &ProfilerHook, LUA_MASKCALL | LUA_MASKRET | LUA_MASKCOUNT, static_cast<int>(m_nInstructionPeriod));
+}
+
+void ScriptProfiler::Detach(lua_State* L)
+{
+	if (ScriptProfileRecorder* pRecorder = GetRecorder(L))
+	{
+		pRecorder->Leave();
+		lua_sethook(L, nullptr, 0, 0);
+	}
+}
+
+void ScriptProfiler::EndFrame(float dt)
+{
+	for (ScriptProfileRecorder* pRecorder : m_Recorders)
+		pRecorder->EndFrame();
+	++m_nFrame;
+
+	if (m_strDumpPath.empty())
+		return;
+
+	m_fTimeSinceDump += dt;
+	if (m_fTimeSinceDump < m_fDumpPeriod)
+		return;
+	m_fTimeSinceDump = 0.0f;
+
+	Dump();
+}
+
+std::string ScriptProfiler::GetFrameSummary(uint32_t nCount) const
+{
+	struct Row
+	{
+		const std::string* pFunction;
+		const std::string* pArchetype;
+		ScriptProfileCounters counters;
+	};
+
+	// Same function and archetype on several states is one row
+	std::map<std::pair<std::string, std::string>, Row> rows;
+	std::map<std::string, ScriptProfileCounters> files;
+	ScriptProfileCounters frameTotal = {};
+
+	for (const ScriptProfileRecorder* pRecorder : m_Recorders)
+	{
+		for (uint32_t nNode = 0; nNode < pRecorder->m_Nodes.size(); ++nNode)
+		{
+			const ScriptProfileNode& node = pRecorder->m_Nodes[nNode];
+			if (node.nFunction == InvalidProfileIndex || node.lastFrame.nCalls == 0)
+				continue;
+
+			const std::string& strFunction = pRecorder->m_Functions[node.nFunction].strName;
+			const std::string& strArchetype = pRecorder->m_Archetypes[node.nArchetype];
+			Row& row = rows.emplace(std::make_pair(strFunction, strArchetype), Row{ &strFunction, &strArchetype, {} }).first->second;
+
+			// Recursive calls are already in total of the outermost one
+			ScriptProfileCounters counters = node.lastFrame;
+			if (pRecorder->HasAncestorCalling(nNode, node.nFunction))
+			{
+				counters.fTotalTime = 0.0;
+				counters.nTotalInstructions = 0;
+			}
+			row.counters.Add(counters);
+
+			ScriptProfileCounters fileCounters = {};
+			fileCounters.fSelfTime = node.lastFrame.fSelfTime;
+			fileCounters.nSelfInstructions = node.lastFrame.nSelfInstructions;
+			files[node.nFile != InvalidProfileIndex ? pRecorder->m_Files[node.nFile] : "-"].Add(fileCounters);
+
+			frameTotal.fSelfTime += node.lastFrame.fSelfTime;
+			frameTotal.nSelfInstructions += node.lastFrame.nSelfInstructions;
+		}
+	}
+
+	std::vector<const Row*> sortedRows;
+	for (const auto& row : rows)
+		sortedRows.push_back(&row.second);
+	std::sort(sortedRows.begin(), sortedRows.end(), [](const Row* a, const Row* b)
+		{
+			return a->counters.fSelfTime > b->counters.fSelfTime;
+		});
+	if (sortedRows.size() > nCount)
+		sortedRows.resize(nCount);
+
+	std::string strSummary;
+	char line[512];
+	snprintf(line, sizeof(line), "frame %llu: %.3f ms, %llu instructions in scripts\n",
+		static_cast<unsigned long long>(m_nFrame), frameTotal.fSelfTime, static_cast<unsigned long long>(frameTotal.nSelfInstructions));
+	strSummary += line;
+	strSummary += "  self ms  total ms   self instr  total instr    calls  function  archetype\n";
+	for (const Row* pRow : sortedRows)
+	{
+		snprintf(line, sizeof(line), "%9.3f %9.3f %12llu %12llu %8llu  %s  %s\n",
+			pRow->counters.fSelfTime, pRow->counters.fTotalTime,
+			static_cast<unsigned long long>(pRow->counters.nSelfInstructions),
+			static_cast<unsigned long long>(pRow->counters.nTotalInstructions),
+			static_cast<unsigned long long>(pRow->counters.nCalls),
+			pRow->pFunction->c_str(), pRow->pArchetype->c_str());
+		strSummary += line;
+	}
+
+	strSummary += "  self ms   self instr  file\n";
+	for (const auto& file : files)
+	{
+		snprintf(line, sizeof(line), "%9.3f %12llu  %s\n",
+			file.second.fSelfTime, static_cast<unsigned long long>(file.second.nSelfInstructions), file.first.c_str());
+		strSummary += line;
+	}
+
+	return strSummary;
+}
+
+bool ScriptProfiler::DumpCollapsed(const std::string& strPath) const
+{
+	std::ofstream file(strPath, std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	// Same stack on several states is one line
+	std::map<std::string, double> stacks;
+	std::vector<uint32_t> path;
+	for (const ScriptProfileRecorder* pRecorder : m_Recorders)
+	{
+		for (uint32_t nNode = 0; nNode < pRecorder->m_Nodes.size(); ++nNode)
+		{
+			const ScriptProfileNode& node = pRecorder->m_Nodes[nNode];
+			if (node.nFunction == InvalidProfileIndex || node.total.fSelfTime <= 0.0)
+				continue;
+
+			path.clear();
+			for (uint32_t nPathNode = nNode; pRecorder->m_Nodes[nPathNode].nFunction != InvalidProfileIndex; nPathNode = pRecorder->m_Nodes[nPathNode].nParent)
+				path.push_back(pRecorder->m_Nodes[nPathNode].nFunction);
+
+			std::string strStack = pRecorder->m_Archetypes[node.nArchetype];
+			for (auto function = path.rbegin(); function != path.rend(); ++function)
+			{
+				strStack += ';';
+				strStack += pRecorder->m_Functions[*function].strName;
+			}
+			stacks[strStack] += node.total.fSelfTime;
+		}
+	}
+
+	for (const auto& stack : stacks)
+	{
+		long long nMicroseconds = std::llround(stack.second * 1000.0);
+		if (nMicroseconds > 0)
+			file << stack.first << ' ' << nMicroseconds << '\n';
+	}
+	return true;
+}
+
+void ScriptProfiler::EnableDump(const std::string& strPath, float fPeriod, uint32_t nTopCount)
+{
+	m_strDumpPath = strPath;
+	m_fDumpPeriod = fPeriod;
+	m_fTimeSinceDump = 0.0f;
+	m_nDumpTopCount = nTopCount;
+}
+
+void ScriptProfiler::DisableDump()
+{
+	m_strDumpPath.clear();
+}
+
+void ScriptProfiler::Dump()
+{
+	DumpCollapsed(m_strDumpPath + ".folded");
+
+	std::ofstream file(m_strDumpPath + ".txt", std::ios::app);
+	if (file.is_open())
+		file << GetFrameSummary(m_nDumpTopCount) << '\n';
+}
+
+ScriptProfileScope::ScriptProfileScope(lua_State* L, flecs::world_t* world, flecs::entity_t entity, const char* szCallbackName) :
+	m_pRecorder(GetRecorder(L))
+{
+	if (m_pRecorder)
+		m_pRecorder->Enter(world, entity, szCallbackName);
+}
+
+ScriptProfileScope::~ScriptProfileScope()
+{
+	if (m_pRecorder)
+		m_pRecorder->Leave();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "flecs.h"
+
+struct lua_State;
+
+class ScriptProfileRecorder;
+
+// Lua profiler on call, return and count hooks.
+// Every attached state gets a recorder of its own, written only by the thread running
+// the state, so worker states are profiled while they run concurrently.
+// Calls are recorded as a tree per entity archetype, nodes sum self and total
+// time and instructions. Instructions are counted every nInstructionPeriod,
+// so counts are multiples of it. Times include the cost of the hooks themselves.
+// States that are not attached run without hooks and cost nothing.
+class ScriptProfiler
+{
+public:
+	ScriptProfiler(uint32_t nInstructionPeriod);
+	~ScriptProfiler();
+	ScriptProfiler(const ScriptProfiler&) = delete;
+	ScriptProfiler& operator=(const ScriptProfiler&) = delete;
+
+	// Main thread, while the state isn't running. Results of a detached state are kept
+	void Attach(lua_State* L);
+	void Detach(lua_State* L);
+
+	// Main thread, between frames
+	void EndFrame(float dt);
+
+	// Last frame: nCount (function, archetype) pairs with most self time, then time per script file.
+	// Time spent in bound C++ functions counts to the script file that called them
+	std::string GetFrameSummary(uint32_t nCount) const;
+	// Totals since start as flamegraph collapsed stacks,
+	// "archetype;function;...;function self_microseconds" per line
+	bool DumpCollapsed(const std::string& strPath) const;
+	// Every fPeriod seconds rewrites strPath.folded and appends frame summary to strPath.txt
+	void EnableDump(const std::string& strPath, float fPeriod, uint32_t nTopCount);
+	void DisableDump();
+
+private:
+	uint32_t m_nInstructionPeriod;
+	std::vector<lua_State*> m_States;
+	std::vector<ScriptProfileRecorder*> m_Recorders;
+
+	uint64_t m_nFrame;
+	std::string m_strDumpPath;
+	float m_fDumpPeriod;
+	float m_fTimeSinceDump;
+	uint32_t m_nDumpTopCount;
+
+	void Dump();
+};
+
+// Attributes lua calls on calling thread to archetype of the entity while it exists.
+// Meant around the outermost call into a state, frames an error unwound without
+// return events are closed here. Function called from C++ through a reference has
+// no name lua knows of, the outermost call is named szCallbackName instead.
+class ScriptProfileScope
+{
+public:
+	ScriptProfileScope(lua_State* L, flecs::world_t* world, flecs::entity_t entity, const char* szCallbackName);
+	~ScriptProfileScope();
+	ScriptProfileScope(const ScriptProfileScope&) = delete;
+	ScriptProfileScope& operator=(const ScriptProfileScope&) = delete;
+
+private:
+	ScriptProfileRecorder* m_pRecorder;
+};
@@ -0,0 +1,121 @@
+#include "ScriptSpatial.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "LuaBridge.h"
+#include "../ECS/ecsSpatial.h"
+
+static const SpatialIndex* GetSpatialIndex(lua_State* L)
+{
+	return static_cast<const SpatialIndex*>(lua_touserdata(L, lua_upvalueindex(1)));
+}
+
+static Ogre::Vector3 CheckVector(lua_State* L, int nArg)
+{
+	const Ogre::Vector3* pVector = luabridge::Stack<const Ogre::Vector3*>::get(L, nArg);
+	if (!pVector)
+		luaL_typeerror(L, nArg, "Vector3");
+	return *pVector;
+}
+
+// Leaves the table at nArg, cleared, on top of the stack, or a new one if there is none
+static void PushResultTable(lua_State* L, int nArg, int nCount)
+{
+	if (!lua_istable(L, nArg))
+	{
+		lua_createtable(L, nCount, 0);
+		return;
+	}
+
+	lua_pushvalue(L, nArg);
+	for (lua_Integer i = luaL_len(L, -1); i > nCount; --i)
+	{
+		lua_pushnil(L);
+		lua_rawseti(L, -2, i);
+	}
+}
+
+// Queries of different states run on different threads
+static thread_local std::vector<flecs::entity_t> t_Entities;
+static thread_local std::vector<SpatialHit> t_Hits;
+
+static int QueryRadius(lua_State* L)
+{
+	Ogre::Vector3 vCenter = CheckVector(L, 1);
+	float fRadius = static_cast<float>(luaL_checknumber(L, 2));
+
+	t_Entities.clear();
+	GetSpatialIndex(L)->QueryRadius(vCenter, fRadius, t_Entities);
+
+	int nCount = static_cast<int>(t_Entities.size());
+	PushResultTable(L, 3, nCount);
+	for (int i = 0; i < nCount; ++i)
+	{
+		lua_pushinteger(L, static_cast<lua_Integer>(t_Entities[i]));
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
+static int QueryNearest(lua_State* L)
+{
+	Ogre::Vector3 vCenter = CheckVector(L, 1);
+	lua_Integer nCount = luaL_checkinteger(L, 2);
+	float fMaxDistance = static_cast<float>(luaL_checknumber(L, 3));
+
+	t_Hits.clear();
+	if (nCount > 0)
+		GetSpatialIndex(L)->QueryNearest(vCenter, static_cast<uint32_t>(nCount), fMaxDistance, t_Hits);
+
+	int nHitCount = static_cast<int>(t_Hits.size());
+	PushResultTable(L, 4, nHitCount);
+	PushResultTable(L, 5, nHitCount);
+	for (int i = 0; i < nHitCount; ++i)
+	{
+		lua_pushinteger(L, static_cast<lua_Integer>(t_Hits[i].entity));
+		lua_rawseti(L, -3, i + 1);
+		lua_pushnumber(L, t_Hits[i].fDistance);
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 2;
+}
+
+static int Raycast(lua_State* L)
+{
+	Ogre::Vector3 vOrigin = CheckVector(L, 1);
+	Ogre::Vector3 vDirection = CheckVector(L, 2);
+	float fMaxDistance = static_cast<float>(luaL_checknumber(L, 3));
+	float fEntityRadius = static_cast<float>(luaL_optnumber(L, 4, 0.0));
+
+	const SpatialIndex* pSpatialIndex = GetSpatialIndex(L);
+	// Grid traversal can't test further than one cell around the ray
+	fEntityRadius = std::min(fEntityRadius, pSpatialIndex->GetCellSize());
+
+	SpatialHit hit;
+	if (vDirection.isZeroLength() || !pSpatialIndex->Raycast(vOrigin, vDirection.normalisedCopy(), fMaxDistance, fEntityRadius, hit))
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_pushinteger(L, static_cast<lua_Integer>(hit.entity));
+	lua_pushnumber(L, hit.fDistance);
+	return 2;
+}
+
+void register_script_spatial(lua_State* L, const SpatialIndex* pSpatialIndex)
+{
+	const luaL_Reg functions[] =
+	{
+		{ "queryRadius", QueryRadius },
+		{ "nearest", QueryNearest },
+		{ "raycast", Raycast },
+		{ nullptr, nullptr }
+	};
+
+	lua_createtable(L, 0, 3);
+	lua_pushlightuserdata(L, const_cast<SpatialIndex*>(pSpatialIndex));
+	luaL_setfuncs(L, functions, 1);
+	lua_setglobal(L, "spatial");
+}
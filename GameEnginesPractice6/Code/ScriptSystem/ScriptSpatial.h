@@ -0,0 +1,15 @@
+#pragma once
+
+struct lua_State;
+class SpatialIndex;
+
+// Spatial index queries for scripts, global "spatial". Entities are Entity.Id values:
+//   spatial.queryRadius(center, radius [, out])            ids within radius
+//   spatial.nearest(center, count, maxDistance [, out [, outDistances]])
+//                                                          ids closest first and their distances
+//   spatial.raycast(origin, direction, maxDistance, entityRadius)
+//                                                          id and distance of first hit, nil if none
+// Result tables are returned, out tables are cleared and refilled instead of creating new ones.
+// Index is updated after scripts, queries see positions of the previous frame.
+// Queries only read the index, so scripts on worker states may use them too.
+void register_script_spatial(lua_State* L, const SpatialIndex* pSpatialIndex);
@@ -1,23 +1,648 @@
 #include "ScriptSystem.h"
+#include "ScriptMath.h"
+#include "ScriptComponentView.h"
+#include "../ECS/ecsParallel.h"
+#include "../ProjectDefines.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
 
-ScriptSystem::ScriptSystem(InputHandler* pInputHandler, std::string strScriptsRoot) :
+#include <windows.h>
+
+// Cache file is this header followed by the bytecode
+struct ScriptCacheHeader
+{
+	uint32_t nMagic;
+	uint32_t nLuaVersion;
+	uint32_t nSourceCrc;
+	uint32_t nSourceSize;
+	float fCompileTime;
+};
+
+static const uint32_t ScriptCacheMagic = 0x4342554C; // "LUBC"
+
+static int WriteChunk(lua_State*, const void* pData, size_t nSize, void* pBuffer)
+{
+	static_cast<std::string*>(pBuffer)->append(static_cast<const char*>(pData), nSize);
+	return 0;
+}
+
+static bool CompileSource(lua_State* L, const std::string& strSource, const std::string& strPath, std::string& strBytecode, float& fCompileTime)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	std::string strChunkName = "@" + strPath;
+	if (luaL_loadbufferx(L, strSource.data(), strSource.size(), strChunkName.c_str(), "t") != LUA_OK)
+	{
+		lua_pop(L, 1);
+		return false;
+	}
+
+	std::chrono::duration<float, std::milli> time = std::chrono::steady_clock::now() - start;
+	fCompileTime = time.count();
+
+	strBytecode.clear();
+	lua_dump(L, WriteChunk, &strBytecode, 0);
+	lua_pop(L, 1);
+	return true;
+}
+
+// Main thread and the watcher thread may write the same script's cache at once. Each writes
+// a temporary file of its own and renames it over the cache, so readers only ever see
+// a complete file with header and bytecode of the same version.
+static void WriteCacheFile(const std::string& strCachePath, uint32_t nSourceCrc, const std::string& strSource, const std::string& strBytecode, float fCompileTime)
+{
+	ScriptCacheHeader header = { ScriptCacheMagic, LUA_VERSION_RELEASE_NUM, nSourceCrc, static_cast<uint32_t>(strSource.size()), fCompileTime };
+	std::string strTempPath = strCachePath + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+	bool bWritten = false;
+	{
+		std::ofstream file(strTempPath, std::ios::binary | std::ios::trunc);
+		if (!file)
+			return;
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(strBytecode.data(), strBytecode.size());
+		file.close();
+		bWritten = !file.fail();
+	}
+
+	std::error_code ec;
+	if (bWritten)
+		std::filesystem::rename(strTempPath, strCachePath, ec);
+	if (!bWritten || ec)
+		std::filesystem::remove(strTempPath, ec);
+}
+
+static bool ReadFile(const std::string& strPath, std::string& strContents)
+{
+	std::ifstream file(strPath, std::ios::binary);
+	if (!file)
+		return false;
+
+	strContents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+ScriptSystem::ScriptSystem(InputHandler* pInputHandler, std::string strScriptsRoot, std::string strCacheRoot, uint32_t nWorkerStateCount) :
 	m_pInputHandler(pInputHandler),
-	m_strScriptsRoot(strScriptsRoot)
+	m_strScriptsRoot(strScriptsRoot),
+	m_strCacheRoot(strCacheRoot),
+	m_CacheStats{},
+	m_pProfiler(nullptr),
+	m_bReloadPending(false)
 {
+	crc32::generate_table(m_CrcTable);
+
+	// Without the directory cache files just fail to open and scripts are compiled every run
+	std::error_code ec;
+	std::filesystem::create_directories(m_strCacheRoot, ec);
+
+	m_pAllocator = new ScriptAllocator();
+	for (uint32_t nState = 0; nState <= nWorkerStateCount; ++nState)
+		m_States.push_back(CreateState());
+	m_pLuaState = m_States.front()->L;
 
+#ifdef SCRIPT_POOL_ALLOCATOR
+	m_pCompileState = m_pAllocator->NewState();
+#else
+	m_pCompileState = luaL_newstate();
+#endif
+	m_pScriptWatcher = new FileWatcher(JobSystem::Get(), m_strScriptsRoot, &ScriptSystem::OnScriptFileChanged, this);
 }
 
 ScriptSystem::~ScriptSystem()
 {
+	delete m_pScriptWatcher;
+	lua_close(m_pCompileState);
+
+	// Nodes unref their environments, states must still be open
+	for (ScriptNode* pScriptNode : m_LiveScriptNodes)
+		delete pScriptNode;
+	m_LiveScriptNodes.clear();
+
+	for (auto& freeNodes : m_FreeScriptNodes)
+	{
+		for (ScriptNode* pScriptNode : freeNodes.second)
+			delete pScriptNode;
+	}
+	m_FreeScriptNodes.clear();
 
+	for (ScriptState* pState : m_States)
+	{
+		lua_close(pState->L);
+		delete pState;
+	}
+	m_States.clear();
+	delete m_pProfiler;
+	// Every block is back once states are closed
+	delete m_pAllocator;
 }
 
 ScriptNode* ScriptSystem::CreateScriptNode(std::string strScriptName, flecs::entity entity)
 {
 	std::string strScriptPath = m_strScriptsRoot + strScriptName;
 
-	ScriptNode* pScriptNode = new ScriptNode(strScriptPath, m_pInputHandler, entity);
+	auto freeNodes = m_FreeScriptNodes.find(strScriptPath);
+	if (freeNodes != m_FreeScriptNodes.end() && !freeNodes->second.empty())
+	{
+		ScriptNode* pScriptNode = freeNodes->second.back();
+		freeNodes->second.pop_back();
+		pScriptNode->GetMemoryAccount()->strName = strScriptName + "#" + std::to_string(entity.id());
+		if (!pScriptNode->Reset(entity))
+		{
+			// Script that ran before fails now, e.g. reloaded with an error
+			freeNodes->second.push_back(pScriptNode);
+			return nullptr;
+		}
+		++m_States[pScriptNode->m_nState]->nNodeCount;
+		m_LiveScriptNodes.insert(pScriptNode);
+		return pScriptNode;
+	}
+
+	const ScriptChunk* pChunk = GetChunk(strScriptPath);
+	if (!pChunk)
+		return nullptr;
+
+	uint32_t nState = PickState(pChunk);
+	ScriptMemoryAccount* pAccount = m_pAllocator->CreateAccount(strScriptName + "#" + std::to_string(entity.id()), pChunk->pMemoryAccount);
+	ScriptNode* pScriptNode = new ScriptNode(pChunk, m_States[nState]->L, nState, pAccount);
+	if (!pScriptNode->Reset(entity))
+	{
+		delete pScriptNode;
+		return nullptr;
+	}
+	++m_States[nState]->nNodeCount;
+	m_LiveScriptNodes.insert(pScriptNode);
 
 	return pScriptNode;
 }
+
+void ScriptSystem::ReleaseScriptNode(ScriptNode* pScriptNode)
+{
+	if (!pScriptNode)
+		return;
+
+	m_LiveScriptNodes.erase(pScriptNode);
+	--m_States[pScriptNode->m_nState]->nNodeCount;
+	pScriptNode->UnbindComponents();
+	m_FreeScriptNodes[pScriptNode->GetScriptPath()].push_back(pScriptNode);
+}
+
+lua_State* ScriptSystem::GetLuaState() const
+{
+	return m_pLuaState;
+}
+
+void ScriptSystem::EnableProfiler(uint32_t nInstructionPeriod)
+{
+	if (!m_pProfiler)
+		m_pProfiler = new ScriptProfiler(nInstructionPeriod);
+
+	for (ScriptState* pState : m_States)
+		m_pProfiler->Attach(pState->L);
+}
+
+void ScriptSystem::DisableProfiler()
+{
+	if (!m_pProfiler)
+		return;
+
+	for (ScriptState* pState : m_States)
+		m_pProfiler->Detach(pState->L);
+}
+
+ScriptProfiler* ScriptSystem::GetProfiler() const
+{
+	return m_pProfiler;
+}
+
+void ScriptSystem::SetSpatialIndex(const SpatialIndex* pSpatialIndex)
+{
+	for (ScriptState* pState : m_States)
+		register_script_spatial(pState->L, pSpatialIndex);
+}
+
+uint32_t ScriptSystem::GetWorkerStateCount() const
+{
+	return static_cast<uint32_t>(m_States.size() - 1);
+}
+
+uint32_t ScriptSystem::PickState(const ScriptChunk* pChunk) const
+{
+	if (!pChunk->bThreadSafe || m_States.size() == 1)
+		return 0;
+
+	uint32_t nBest = 1;
+	for (uint32_t nState = 2; nState < m_States.size(); ++nState)
+	{
+		if (m_States[nState]->nNodeCount < m_States[nBest]->nNodeCount)
+			nBest = nState;
+	}
+	return nBest;
+}
+
+ScriptAllocator* ScriptSystem::GetAllocator() const
+{
+	return m_pAllocator;
+}
+
+void ScriptSystem::SetMemoryCap(const std::string& strScriptName, int64_t nCapBytes)
+{
+	if (const ScriptChunk* pChunk = GetChunk(m_strScriptsRoot + strScriptName))
+		pChunk->pMemoryAccount->nCapBytes.store(nCapBytes, std::memory_order_relaxed);
+}
+
+size_t ScriptSystem::GetMemoryUsage() const
+{
+	size_t nBytes = 0;
+	for (const ScriptState* pState : m_States)
+		nBytes += static_cast<size_t>(lua_gc(pState->L, LUA_GCCOUNT, 0)) * 1024 + lua_gc(pState->L, LUA_GCCOUNTB, 0);
+	return nBytes;
+}
+
+const ScriptChunk* ScriptSystem::GetChunk(const std::string& strScriptPath)
+{
+	auto chunk = m_Chunks.find(strScriptPath);
+	if (chunk != m_Chunks.end())
+	{
+		++m_CacheStats.nMemoryHits;
+		m_CacheStats.fParseTimeSaved += chunk->second.fCompileTime;
+		return &chunk->second;
+	}
+
+	std::string strSource;
+	if (!ReadFile(strScriptPath, strSource))
+		return nullptr;
+
+	uint32_t nSourceCrc = crc32::update(m_CrcTable, 0, strSource.data(), strSource.size());
+	std::string strCachePath = GetCachePath(strScriptPath);
+
+	ScriptChunk newChunk;
+	newChunk.strPath = strScriptPath;
+	newChunk.pMemoryAccount = nullptr;
+	newChunk.bThreadSafe = false;
+	if (!LoadCachedChunk(strCachePath, nSourceCrc, strSource.size(), newChunk) &&
+		!CompileChunk(strSource, nSourceCrc, strCachePath, newChunk))
+		return nullptr;
+
+	std::string strName = strScriptPath.compare(0, m_strScriptsRoot.size(), m_strScriptsRoot) == 0 ?
+		strScriptPath.substr(m_strScriptsRoot.size()) : strScriptPath;
+	newChunk.pMemoryAccount = m_pAllocator->CreateAccount(strName, nullptr);
+	newChunk.pMemoryAccount->nCapBytes.store(SCRIPT_MEMORY_CAP, std::memory_order_relaxed);
+	// Script runs once to read it, worker states never run scripts that didn't ask for it
+	newChunk.bThreadSafe = m_States.size() > 1 && ScriptNode::LoadChunkThreadSafe(&newChunk, m_pLuaState);
+
+	return &m_Chunks.emplace(strScriptPath, std::move(newChunk)).first->second;
+}
+
+const ScriptCacheStats& ScriptSystem::GetCacheStats() const
+{
+	return m_CacheStats;
+}
+
+std::string ScriptSystem::GetCachePath(const std::string& strScriptPath) const
+{
+	std::string strName = strScriptPath;
+	if (strName.compare(0, m_strScriptsRoot.size(), m_strScriptsRoot) == 0)
+		strName.erase(0, m_strScriptsRoot.size());
+
+	// Scripts in subfolders are flattened into one cache folder
+	for (char& c : strName)
+	{
+		if (c == '/' || c == '\\' || c == ':')
+			c = '_';
+	}
+
+	return m_strCacheRoot + strName + ".luac";
+}
+
+bool ScriptSystem::LoadCachedChunk(const std::string& strCachePath, uint32_t nSourceCrc, size_t nSourceSize, ScriptChunk& chunk)
+{
+	std::string strCache;
+	if (!ReadFile(strCachePath, strCache) || strCache.size() <= sizeof(ScriptCacheHeader))
+		return false;
+
+	ScriptCacheHeader header;
+	memcpy(&header, strCache.data(), sizeof(header));
+	if (header.nMagic != ScriptCacheMagic || header.nLuaVersion != LUA_VERSION_RELEASE_NUM ||
+		header.nSourceCrc != nSourceCrc || header.nSourceSize != nSourceSize)
+		return false;
+
+	auto start = std::chrono::steady_clock::now();
+
+	// Binary only, a damaged file fails here and the source gets compiled instead
+	const char* pBytecode = strCache.data() + sizeof(header);
+	size_t nBytecodeSize = strCache.size() - sizeof(header);
+	std::string strChunkName = "@" + chunk.strPath;
+	if (luaL_loadbufferx(m_pLuaState, pBytecode, nBytecodeSize, strChunkName.c_str(), "b") != LUA_OK)
+	{
+		lua_pop(m_pLuaState, 1);
+		return false;
+	}
+	lua_pop(m_pLuaState, 1);
+
+	std::chrono::duration<float, std::milli> time = std::chrono::steady_clock::now() - start;
+
+	chunk.strBytecode.assign(pBytecode, nBytecodeSize);
+	chunk.fCompileTime = header.fCompileTime;
+
+	++m_CacheStats.nCacheHits;
+	m_CacheStats.fCacheLoadTime += time.count();
+	m_CacheStats.fParseTimeSaved += std::max(header.fCompileTime - time.count(), 0.0f);
+	return true;
+}
+
+bool ScriptSystem::CompileChunk(const std::string& strSource, uint32_t nSourceCrc, const std::string& strCachePath, ScriptChunk& chunk)
+{
+	if (!CompileSource(m_pLuaState, strSource, chunk.strPath, chunk.strBytecode, chunk.fCompileTime))
+		return false;
+
+	++m_CacheStats.nCompiled;
+	m_CacheStats.fCompileTime += chunk.fCompileTime;
+
+	WriteCacheFile(strCachePath, nSourceCrc, strSource, chunk.strBytecode, chunk.fCompileTime);
+	return true;
+}
+
+void ScriptSystem::OnScriptFileChanged(void* pUserData, const std::string& strFileName)
+{
+	ScriptSystem* pScriptSystem = static_cast<ScriptSystem*>(pUserData);
+
+	const std::string strExtension = ".lua";
+	if (strFileName.size() <= strExtension.size() ||
+		strFileName.compare(strFileName.size() - strExtension.size(), strExtension.size(), strExtension) != 0)
+		return;
+
+	std::string strScriptPath = pScriptSystem->m_strScriptsRoot + strFileName;
+	std::string strSource;
+	if (!ReadFile(strScriptPath, strSource))
+		return;
+
+	// A script saved with errors leaves the last good version running
+	ScriptReload reload;
+	if (!CompileSource(pScriptSystem->m_pCompileState, strSource, strScriptPath, reload.strBytecode, reload.fCompileTime))
+		return;
+
+	uint32_t nSourceCrc = crc32::update(pScriptSystem->m_CrcTable, 0, strSource.data(), strSource.size());
+	WriteCacheFile(pScriptSystem->GetCachePath(strScriptPath), nSourceCrc, strSource, reload.strBytecode, reload.fCompileTime);
+
+	std::scoped_lock<std::mutex> lock(pScriptSystem->m_ReloadMutex);
+	pScriptSystem->m_PendingReloads[strScriptPath] = std::move(reload);
+	pScriptSystem->m_bReloadPending.store(true, std::memory_order_release);
+}
+
+void ScriptSystem::ApplyScriptReloads()
+{
+	if (!m_bReloadPending.load(std::memory_order_acquire))
+		return;
+
+	std::unordered_map<std::string, ScriptReload> reloads;
+	{
+		std::scoped_lock<std::mutex> lock(m_ReloadMutex);
+		reloads.swap(m_PendingReloads);
+		m_bReloadPending.store(false, std::memory_order_relaxed);
+	}
+
+	for (auto& reload : reloads)
+	{
+		// Scripts not loaded yet read the fresh cache file when first needed
+		auto chunk = m_Chunks.find(reload.first);
+		if (chunk == m_Chunks.end())
+			continue;
+
+		ScriptChunk& scriptChunk = chunk->second;
+		scriptChunk.strBytecode = std::move(reload.second.strBytecode);
+		scriptChunk.fCompileTime = reload.second.fCompileTime;
+		++m_CacheStats.nReloaded;
+
+		// Instances that stayed on worker states after ThreadSafe was dropped would race
+		bool bThreadSafe = m_States.size() > 1 && ScriptNode::LoadChunkThreadSafe(&scriptChunk, m_pLuaState);
+		if (bThreadSafe != scriptChunk.bThreadSafe)
+		{
+			scriptChunk.bThreadSafe = bThreadSafe;
+			// Moved instances run the new script from scratch, parameters included
+			MoveScriptNodes(&scriptChunk);
+			continue;
+		}
+
+		// New script runs once, its parameters are shared by all instances
+		luabridge::LuaRef parameters(m_pLuaState);
+		bool bLoaded = false;
+		for (ScriptNode* pScriptNode : m_LiveScriptNodes)
+		{
+			if (pScriptNode->m_pChunk != &scriptChunk)
+				continue;
+
+			if (!bLoaded)
+			{
+				parameters = pScriptNode->LoadChunkParameters();
+				bLoaded = true;
+			}
+			pScriptNode->ReloadParameters(parameters);
+		}
+	}
+}
+
+void ScriptSystem::MoveScriptNodes(const ScriptChunk* pChunk)
+{
+	// Free nodes belong to the old state, new ones are created where the chunk goes now
+	auto freeNodes = m_FreeScriptNodes.find(pChunk->strPath);
+	if (freeNodes != m_FreeScriptNodes.end())
+	{
+		for (ScriptNode* pScriptNode : freeNodes->second)
+			delete pScriptNode;
+		freeNodes->second.clear();
+	}
+
+	uint32_t nMoved = 0;
+	uint32_t nFailed = 0;
+	for (ScriptNode* pScriptNode : m_LiveScriptNodes)
+	{
+		if (pScriptNode->m_pChunk != pChunk)
+			continue;
+
+		uint32_t nState = PickState(pChunk);
+		if (nState == pScriptNode->m_nState)
+			continue;
+
+		// Environment is a registry reference of the old state, released there
+		pScriptNode->ReleaseEnvironment();
+		--m_States[pScriptNode->m_nState]->nNodeCount;
+		pScriptNode->m_script = m_States[nState]->L;
+		pScriptNode->m_nState = nState;
+		++m_States[nState]->nNodeCount;
+		++nMoved;
+
+		// Script starts over in the new state, the entity stays where it is
+		flecs::entity ent = pScriptNode->m_Entity;
+		const Position* pPosition = ent.get<Position>();
+		Ogre::Vector3 vPosition = pPosition ? *pPosition : Ogre::Vector3::ZERO;
+		if (!pScriptNode->Reset(ent))
+			++nFailed;
+		else if (pPosition)
+			pScriptNode->SetPosition(vPosition);
+	}
+
+	OutputDebugStringA(("ScriptSystem: " + pChunk->strPath + (pChunk->bThreadSafe ? " is now" : " is no longer") +
+		" thread safe, " + std::to_string(nMoved) + " instances moved, " + std::to_string(nFailed) + " failed to restart\n").c_str());
+}
+
+bool ScriptSystem::QueueUpdate(ScriptNode* pScriptNode, float dt)
+{
+	ScriptState* pState = m_States[pScriptNode->m_nState];
+	ScriptBatchQueue* pQueue = nullptr;
+	if (pScriptNode->HasBatchUpdate())
+		pQueue = &pState->batchQueues[pScriptNode->m_pChunk];
+	else if (pScriptNode->m_nState != 0)
+		pQueue = &pState->updateQueue;
+	else
+		return false;
+
+	pQueue->nodes.push_back(pScriptNode);
+	pQueue->dts.push_back(dt);
+	return true;
+}
+
+void ScriptSystem::RunBatchUpdates(float dt)
+{
+	RunBatchQueues(m_States.front(), dt);
+}
+
+void ScriptSystem::RunParallelUpdates(float dt)
+{
+	uint32_t nWorkerStateCount = GetWorkerStateCount();
+	if (nWorkerStateCount == 0)
+		return;
+
+	parallel_for(nWorkerStateCount, 1, nWorkerStateCount, [this, dt](uint32_t, size_t nBegin, size_t nEnd)
+		{
+			for (size_t nState = nBegin; nState < nEnd; ++nState)
+			{
+				ScriptState* pState = m_States[nState + 1];
+				ScriptBatchQueue& queue = pState->updateQueue;
+				for (size_t i = 0; i < queue.nodes.size(); ++i)
+					queue.nodes[i]->Update(queue.dts[i]);
+				queue.nodes.clear();
+				queue.dts.clear();
+
+				RunBatchQueues(pState, dt);
+			}
+		});
+}
+
+void ScriptSystem::ApplyCommands(flecs::world_t* stage)
+{
+	for (ScriptState* pState : m_States)
+		pState->commands.Apply(stage);
+}
+
+void ScriptSystem::RunBatchQueues(ScriptState* pState, float dt)
+{
+	lua_State* L = pState->L;
+
+	for (auto& batch : pState->batchQueues)
+	{
+		ScriptBatchQueue& queue = batch.second;
+		if (queue.nodes.empty())
+			continue;
+
+		// Every instance holds the same function, first one's is called for all
+		if (queue.nodes.front()->PushCallback(eSC_OnUpdateBatch))
+		{
+			ScriptMemoryScope memoryScope(batch.first->pMemoryAccount);
+#ifdef SCRIPT_PROFILER
+			// One call for all instances, counted to archetype of the first one
+			ScriptProfileScope profileScope(L, queue.nodes.front()->m_Entity.world().c_ptr(), queue.nodes.front()->m_Entity.id(),
+				queue.nodes.front()->GetCallbackName(eSC_OnUpdateBatch));
+#endif
+			int nCount = static_cast<int>(queue.nodes.size());
+			lua_pushnumber(L, dt);
+
+			lua_createtable(L, nCount, 0);
+			for (int i = 0; i < nCount; ++i)
+			{
+				lua_rawgeti(L, LUA_REGISTRYINDEX, queue.nodes[i]->m_nEntityRef);
+				lua_rawseti(L, -2, i + 1);
+			}
+
+			lua_createtable(L, nCount, 0);
+			for (int i = 0; i < nCount; ++i)
+			{
+				lua_pushnumber(L, queue.dts[i]);
+				lua_rawseti(L, -2, i + 1);
+			}
+
+			if (lua_pcall(L, 3, 0, 0) != LUA_OK)
+				lua_pop(L, 1);
+		}
+
+		queue.nodes.clear();
+		queue.dts.clear();
+	}
+}
+
+ScriptState* ScriptSystem::CreateState()
+{
+	ScriptState* pState = new ScriptState();
+	pState->nNodeCount = 0;
+#ifdef SCRIPT_POOL_ALLOCATOR
+	pState->L = m_pAllocator->NewState();
+#else
+	pState->L = luaL_newstate();
+#endif
+	lua_State* L = pState->L;
+	luaL_openlibs(L);
+
+	AddDependencies(L);
+
+	std::error_code ec;
+	luabridge::push(L, &pState->commands, ec);
+	lua_setglobal(L, "commands");
+
+	// Instance environments read missing names from globals, writes stay in the instance
+	lua_newtable(L);
+	lua_pushglobaltable(L);
+	lua_setfield(L, -2, "__index");
+	lua_setfield(L, LUA_REGISTRYINDEX, EnvMetatableName);
+
+	return pState;
+}
+
+void ScriptSystem::AddDependencies(lua_State* L)
+{
+	std::error_code ec;
+
+	luabridge::getGlobalNamespace(L)
+		.beginClass<InputHandler>("InputHandler")
+		.addConstructor<void(*) (const std::string&)>()
+		.addFunction("isCommandActive", &(InputHandler::IsCommandActive))
+		.endClass()
+		.beginClass<Ogre::Vector3>("Vector3")
+		.addConstructor<void(*) (float, float, float)>()
+		.addFunction("__add", (Ogre::Vector3(Ogre::Vector3::*)(const Ogre::Vector3&) const) &Ogre::Vector3::operator+)
+		.addFunction("__mul", (Ogre::Vector3(Ogre::Vector3::*)(const float) const) &Ogre::Vector3::operator*)
+		.addProperty("x", &Ogre::Vector3::x, true)
+		.addProperty("y", &Ogre::Vector3::y, true)
+		.addProperty("z", &Ogre::Vector3::z, true)
+		.endClass()
+		.beginClass<Ogre::Radian>("Radian")
+		.addConstructor<void(*) (float)>()
+		.addFunction("__add", (Ogre::Radian(Ogre::Radian::*)(const Ogre::Radian&) const) &Ogre::Radian::operator+)
+		.endClass()
+		.beginClass<Ogre::Quaternion>("Quaternion")
+		.addConstructor<void(*) (const Ogre::Radian&, const Ogre::Vector3&)>()
+		.addFunction("setOrientation", &(Ogre::Quaternion::FromAngleAxis))
+		.addFunction("__mul", (Ogre::Vector3(Ogre::Quaternion::*)(const Ogre::Vector3&) const) &Ogre::Quaternion::operator*)
+		.endClass();
+
+	register_script_math(L);
+	register_script_component_views(L);
+	register_script_commands(L);
+
+	luabridge::push(L, m_pInputHandler, ec);
+	lua_setglobal(L, "inputHandler");
+}
@@ -1,19 +1,164 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
 #include "ScriptNode.h"
+#include "ScriptCommandQueue.h"
+#include "ScriptProfiler.h"
+#include "ScriptSpatial.h"
+#include "crc32.h"
+#include "../FileSystem/FileWatcher.h"
+
+// Where script chunks came from, times in milliseconds
+struct ScriptCacheStats
+{
+	uint32_t nCompiled;
+	uint32_t nCacheHits;
+	// Nodes created from an already loaded chunk
+	uint32_t nMemoryHits;
+	// Scripts recompiled after they changed on disk
+	uint32_t nReloaded;
+	float fCompileTime;
+	float fCacheLoadTime;
+	// Compile time of chunks that were not parsed again, less the time spent loading them instead
+	float fParseTimeSaved;
+};
+
+struct ScriptBatchQueue
+{
+	std::vector<ScriptNode*> nodes;
+	std::vector<float> dts;
+};
 
+// Lua state with its own copy of the bindings, nodes living in it and work queued for them.
+// Only one thread runs a state at a time.
+struct ScriptState
+{
+	lua_State* L;
+	// Vectors are cleared, not freed, queues are reused every frame
+	std::unordered_map<const ScriptChunk*, ScriptBatchQueue> batchQueues;
+	ScriptBatchQueue updateQueue;
+	// Global "commands" of the state
+	ScriptCommandQueue commands;
+	uint32_t nNodeCount;
+};
+
+// Owns the lua states script nodes live in. The main state holds every script
+// that isn't marked thread safe and is only ever run on the calling thread.
+// Scripts with Entity.Properties.ThreadSafe are spread over worker states instead,
+// which are updated in parallel, one job per state, by RunParallelUpdates.
+// A thread safe script writes only its own entity through Entity.Components,
+// other entities are written through commands, applied after all updates by ApplyCommands.
+// Every script file is compiled once, nodes are instances of its chunk, and every state
+// loads the same bytecode.
+// Compiled chunks are also kept in strCacheRoot, keyed by source crc and lua version,
+// so next runs load bytecode instead of parsing sources that didn't change.
+// Scripts edited while the game runs are recompiled on the file watcher's thread
+// and picked up by ApplyScriptReloads.
 class ScriptSystem
 {
 public:
-	ScriptSystem(InputHandler* pInputHandler, std::string strScriptsRoot);
+	// Registry key of the metatable that makes instance environments see globals
+	static constexpr const char* EnvMetatableName = "ScriptEnvironment";
+
+	// nWorkerStateCount 0 keeps every script in main state
+	ScriptSystem(InputHandler* pInputHandler, std::string strScriptsRoot, std::string strCacheRoot, uint32_t nWorkerStateCount);
 	~ScriptSystem();
 	ScriptSystem(const ScriptSystem&) = delete;
 	ScriptSystem& operator=(const ScriptSystem&) = delete;
 
+	// Null if the script doesn't compile, raises an error when run or defines no Entity table
 	ScriptNode* CreateScriptNode(std::string strScriptName, flecs::entity entity);
+	// Node is kept around and handed out again for the same script
+	void ReleaseScriptNode(ScriptNode* pScriptNode);
+
+	// Main state
+	lua_State* GetLuaState() const;
+	uint32_t GetWorkerStateCount() const;
+	ScriptAllocator* GetAllocator() const;
+	// Caps live lua memory of every instance of a script, 0 removes the cap
+	void SetMemoryCap(const std::string& strScriptName, int64_t nCapBytes);
+	// Bytes allocated by all lua states
+	size_t GetMemoryUsage() const;
+
+	// Hooks every state, call between frames. Disabling removes the hooks and keeps results
+	void EnableProfiler(uint32_t nInstructionPeriod);
+	void DisableProfiler();
+	// Null until profiler was first enabled
+	ScriptProfiler* GetProfiler() const;
+	// Global "spatial" of every state, see register_script_spatial
+	void SetSpatialIndex(const SpatialIndex* pSpatialIndex);
+
+	// Compiled or loaded from cache on first request, null if the script doesn't compile
+	const ScriptChunk* GetChunk(const std::string& strScriptPath);
+	const ScriptCacheStats& GetCacheStats() const;
+
+	// Call on main thread at a frame boundary. Live instances of changed scripts get
+	// the new Parameters, instances created afterwards run the new script.
+	// Costs one atomic load while nothing has changed.
+	void ApplyScriptReloads();
+
+	// Queues nodes with OnUpdateBatch and nodes of worker states, returns false
+	// if the node is neither and caller has to update it right away
+	bool QueueUpdate(ScriptNode* pScriptNode, float dt);
+	// One Entity.OnUpdateBatch(dt, entities, dts) call per script with queued nodes of main state.
+	// entities[i] is the Entity table of an instance, dts[i] the time it has to advance,
+	// which differs from dt for entities updated less often than every frame.
+	void RunBatchUpdates(float dt);
+	// Queued updates and batch updates of worker states, states run concurrently
+	void RunParallelUpdates(float dt);
+	// Commands of all states in state order, main state first
+	void ApplyCommands(flecs::world_t* stage);
 
 private:
-	std::string m_strScriptsRoot;
+	// Same order as constructor initializes them
 	InputHandler* m_pInputHandler;
-};
+	std::string m_strScriptsRoot;
+	std::string m_strCacheRoot;
+
+	ScriptAllocator* m_pAllocator;
+	// First state is main state
+	std::vector<ScriptState*> m_States;
+	lua_State* m_pLuaState;
 
+	// Pointers to chunks are handed to nodes, unordered_map nodes never move
+	std::unordered_map<std::string, ScriptChunk> m_Chunks;
+	ScriptCacheStats m_CacheStats;
+	uint32_t m_CrcTable[256];
+	ScriptProfiler* m_pProfiler;
+
+	// Free nodes by script path, reused instead of allocating new ones
+	std::unordered_map<std::string, std::vector<ScriptNode*>> m_FreeScriptNodes;
+	std::unordered_set<ScriptNode*> m_LiveScriptNodes;
+
+	struct ScriptReload
+	{
+		std::string strBytecode;
+		float fCompileTime;
+	};
+	FileWatcher* m_pScriptWatcher;
+	// Only used by the watcher thread, compiling doesn't need bindings
+	lua_State* m_pCompileState;
+	std::mutex m_ReloadMutex;
+	// Latest compiled version by script path, repeated saves replace each other
+	std::unordered_map<std::string, ScriptReload> m_PendingReloads;
+	std::atomic<bool> m_bReloadPending;
+
+	static void OnScriptFileChanged(void* pUserData, const std::string& strFileName);
+
+	ScriptState* CreateState();
+	void AddDependencies(lua_State* L);
+	// Worker state with the fewest nodes, main state for scripts that aren't thread safe
+	uint32_t PickState(const ScriptChunk* pChunk) const;
+	// After a reload changed ThreadSafe of the chunk, restarts its live instances in states it belongs to now
+	void MoveScriptNodes(const ScriptChunk* pChunk);
+	static void RunBatchQueues(ScriptState* pState, float dt);
+
+	std::string GetCachePath(const std::string& strScriptPath) const;
+	bool LoadCachedChunk(const std::string& strCachePath, uint32_t nSourceCrc, size_t nSourceSize, ScriptChunk& chunk);
+	bool CompileChunk(const std::string& strSource, uint32_t nSourceCrc, const std::string& strCachePath, ScriptChunk& chunk);
+};
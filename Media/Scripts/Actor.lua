@@ -2,7 +2,9 @@ Entity = {
     Properties = {
         Controllable = 0,
         HasPhysics = 0,
-        IsStatic = 1
+        IsStatic = 1,
+        -- Touches nothing but its own entity, may run on a worker lua state
+        ThreadSafe = 1
     },
     
     up_vector = Vector3(0.0, 1.0, 0.0),
@@ -14,7 +16,9 @@ Entity.OnInit = function()
     Entity.orientation = Quaternion(Radian(0.0), Entity.up_vector);
 end
 
-Entity.OnUpdate = function(dt)
+-- Called once per frame for all actors, entities[i] is the Entity table of an actor
+-- that has to advance by dts[i]. Use entities[i] here, Entity is only one of them.
+Entity.OnUpdateBatch = function(dt, entities, dts)
 
 end
 
@@ -0,0 +1,25 @@
+-- Does nothing when updated, what is left is the cost of calling a script
+Entity = {
+    Properties = {
+        Controllable = 0,
+        HasPhysics = 0,
+        IsStatic = 0,
+    },
+
+    orientation = Quaternion(Radian(0.0), Vector3(0.0, 1.0, 0.0)),
+    position = Vector3(0.0, 0.0, 0.0),
+}
+
+Entity.OnInit = function()
+end
+
+Entity.OnUpdate = function(dt)
+end
+
+Entity.GetPosition = function()
+    return Entity.position;
+end
+
+Entity.GetOrientation = function()
+    return Entity.orientation;
+end
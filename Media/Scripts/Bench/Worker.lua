@@ -0,0 +1,40 @@
+-- Thread safe script with some work to do every update, for script thread scaling
+Entity = {
+    Properties = {
+        Controllable = 0,
+        HasPhysics = 0,
+        IsStatic = 0,
+        ThreadSafe = 1
+    },
+
+    Parameters = {
+        -- Loop iterations per update, stands in for entity logic
+        work = 200,
+    },
+
+    phase = 0.0,
+    push = Vector3(0.0, 0.0, 0.0),
+    position = Vector3(0.0, 0.0, 0.0),
+}
+
+Entity.OnInit = function()
+end
+
+Entity.OnUpdate = function(dt)
+    local phase = Entity.phase;
+    for i = 1, Entity.Parameters.work do
+        phase = phase + math.sin(phase + i * dt) * 0.001;
+    end
+    Entity.phase = phase;
+
+    local position = Entity.Components.Position;
+    position.x = position.x + phase * dt;
+
+    -- Goes through the command queue like a write to another entity would
+    Entity.push.y = phase;
+    commands:addVelocity(Entity.Id, Entity.push);
+end
+
+Entity.GetPosition = function()
+    return Entity.position;
+end
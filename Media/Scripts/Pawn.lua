@@ -19,6 +19,9 @@ Entity = {
     orientation = Quaternion(Radian(0.0), Vector3(0.0, 1.0, 0.0)),
     position = Vector3(0.0, 0.0, 0.0),
     forward_vector = Vector3(0.0, 0.0, 1.0),
+    -- Scratch values written in place every update instead of allocating new ones
+    move_direction = Vector3(0.0, 0.0, 0.0),
+    camera_position = Vector3(0.0, 0.0, 0.0),
 }
 
 Entity.OnInit = function()
@@ -45,10 +48,21 @@ Entity.OnUpdate = function(dt)
     deltaMoveVelocity = deltaMoveVelocity * dt;
     deltaRotationVelocity = deltaRotationVelocity * dt;
     
-    Entity.radian = Entity.radian + Radian(deltaRotationVelocity);
+    Entity.radian:addRadians(deltaRotationVelocity);
     
     Entity.orientation:setOrientation(Entity.radian, Entity.up_vector);
-    Entity.position = Entity.position + Entity.orientation * Entity.forward_vector * deltaMoveVelocity;
+    Entity.orientation:rotateInto(Entity.forward_vector, Entity.move_direction);
+    
+    -- Written straight into the entity's components, nothing copies them out afterwards
+    local components = Entity.Components;
+    components.Position:addScaled(Entity.move_direction, deltaMoveVelocity);
+    components.Orientation:copy(Entity.orientation);
+    
+    local cameraPosition = Entity.camera_position;
+    components.Position:read(cameraPosition);
+    Entity.position:copy(cameraPosition);
+    cameraPosition:add(Entity.Camera.offset);
+    components.CameraPosition:copy(cameraPosition);
 end
 
 Entity.GetPosition = function()
@@ -62,10 +76,9 @@ Entity.SetPosition = function(x, y, z)
 end
 
 Entity.GetCameraPosition = function()
-    local pos = Vector3(0.0, 0.0, 0.0);
-    pos.x = Entity.Camera.offset.x + Entity.position.x;
-    pos.y = Entity.Camera.offset.y + Entity.position.y;
-    pos.z = Entity.Camera.offset.z + Entity.position.z;
+    local pos = Entity.camera_position;
+    pos:copy(Entity.position);
+    pos:add(Entity.Camera.offset);
     return pos;
 end
 
@@ -74,9 +87,7 @@ Entity.GetCameraOffset = function()
 end
 
 Entity.SetCameraOffset = function(v)
-    Entity.Camera.offset.x = v.x;
-    Entity.Camera.offset.y = v.y;
-    Entity.Camera.offset.z = v.z;
+    Entity.Camera.offset:copy(v);
 end
 
 Entity.GetOrientation = function()